@@ -0,0 +1,134 @@
+// Benchmark for the NymphRPC packed array conversion kernels.
+//
+// Compares the scalar and SIMD conversions, and encoding & decoding of
+// numeric data as a packed array versus an array of individual values.
+
+#include "../hayai/hayai.hpp"
+#include "../hayai/hayai_main.hpp"
+
+#include "../../src/nymph.h"
+
+#include <vector>
+#include <cstring>
+
+#define TEST_COUNT 65536
+
+
+class PackedFixture : public ::hayai::Fixture {
+public:
+	virtual void SetUp() {
+		floats.resize(TEST_COUNT);
+		doubles.resize(TEST_COUNT);
+		ints.resize(TEST_COUNT);
+		shorts.resize(TEST_COUNT);
+		for (int i = 0; i < TEST_COUNT; ++i) {
+			floats[i] = i * 0.5f;
+			ints[i] = i - (TEST_COUNT / 2);
+		}
+		
+		buffer.resize((TEST_COUNT * 16) + 32);
+		NymphSimd::setLevel(NYMPH_SIMD_AVX2);
+	}
+	
+	virtual void TearDown() {
+		NymphSimd::setLevel(NYMPH_SIMD_AVX2);
+	}
+	
+	std::vector<float> floats;
+	std::vector<double> doubles;
+	std::vector<int32_t> ints;
+	std::vector<int16_t> shorts;
+	std::vector<uint8_t> buffer;
+};
+
+
+// Conversions.
+BENCHMARK_F(PackedFixture, FloatToDouble_Scalar, 10, 100) {
+	NymphSimd::setLevel(NYMPH_SIMD_SCALAR);
+	NymphSimd::convert(NYMPH_FLOAT, floats.data(), NYMPH_DOUBLE, doubles.data(), TEST_COUNT);
+}
+
+BENCHMARK_F(PackedFixture, FloatToDouble_SSE2, 10, 100) {
+	NymphSimd::setLevel(NYMPH_SIMD_SSE2);
+	NymphSimd::convert(NYMPH_FLOAT, floats.data(), NYMPH_DOUBLE, doubles.data(), TEST_COUNT);
+}
+
+BENCHMARK_F(PackedFixture, FloatToDouble_AVX2, 10, 100) {
+	NymphSimd::convert(NYMPH_FLOAT, floats.data(), NYMPH_DOUBLE, doubles.data(), TEST_COUNT);
+}
+
+BENCHMARK_F(PackedFixture, Int32ToFloat_Scalar, 10, 100) {
+	NymphSimd::setLevel(NYMPH_SIMD_SCALAR);
+	NymphSimd::convert(NYMPH_SINT32, ints.data(), NYMPH_FLOAT, floats.data(), TEST_COUNT);
+}
+
+BENCHMARK_F(PackedFixture, Int32ToFloat_AVX2, 10, 100) {
+	NymphSimd::convert(NYMPH_SINT32, ints.data(), NYMPH_FLOAT, floats.data(), TEST_COUNT);
+}
+
+BENCHMARK_F(PackedFixture, Int32ToInt16_Scalar, 10, 100) {
+	NymphSimd::setLevel(NYMPH_SIMD_SCALAR);
+	NymphSimd::convert(NYMPH_SINT32, ints.data(), NYMPH_SINT16, shorts.data(), TEST_COUNT);
+}
+
+BENCHMARK_F(PackedFixture, Int32ToInt16_AVX2, 10, 100) {
+	NymphSimd::convert(NYMPH_SINT32, ints.data(), NYMPH_SINT16, shorts.data(), TEST_COUNT);
+}
+
+BENCHMARK_F(PackedFixture, Float_Memcpy, 10, 100) {
+	memcpy(doubles.data(), floats.data(), TEST_COUNT * sizeof(float));
+}
+
+
+// Encoding & decoding.
+BENCHMARK_F(PackedFixture, Encode_Array, 10, 100) {
+	std::vector<NymphType*>* values = new std::vector<NymphType*>();
+	values->reserve(TEST_COUNT);
+	for (int i = 0; i < TEST_COUNT; ++i) {
+		values->push_back(new NymphType(floats[i]));
+	}
+	
+	NymphType array(values, true);
+	uint8_t* index = buffer.data();
+	array.serialize(index);
+}
+
+BENCHMARK_F(PackedFixture, Encode_Packed, 10, 100) {
+	NymphType packed(NYMPH_FLOAT, floats.data(), TEST_COUNT);
+	uint8_t* index = buffer.data();
+	packed.serialize(index);
+}
+
+BENCHMARK_F(PackedFixture, Encode_PackedWiden, 10, 100) {
+	NymphType packed(NYMPH_DOUBLE, NYMPH_FLOAT, floats.data(), TEST_COUNT);
+	uint8_t* index = buffer.data();
+	packed.serialize(index);
+}
+
+BENCHMARK_F(PackedFixture, Decode_Packed, 10, 100) {
+	NymphType packed(NYMPH_FLOAT, floats.data(), TEST_COUNT);
+	uint8_t* index = buffer.data();
+	packed.serialize(index);
+	
+	NymphType parsed;
+	uint64_t pos = 1;
+	parsed.parseValue(buffer[0], buffer.data(), pos, buffer.size());
+	parsed.getPackedValues(NYMPH_DOUBLE, doubles.data());
+}
+
+
+int main(int argc, char* argv[]) {
+	NymphLogger::setLogLevel(Poco::Message::PRIO_ERROR);
+	
+	// Set up the main runner.
+	::hayai::MainRunner runner;
+	
+	// Parse the arguments.
+	int result = runner.ParseArgs(argc, argv);
+	if (result) {
+		return result;
+	}
+	
+	// Execute based on the selected mode.
+	return runner.Run();
+}
@@ -14,6 +14,7 @@
 #include "callback_request.h"
 #include "nymph_listener.h"
 #include "nymph_logger.h"
+#include "dispatcher.h"
 
 
 // --- SET MESSAGE ---
@@ -24,8 +25,54 @@ void CallbackRequest::setMessage(uint32_t session, NymphMessage* msg, void* data
 }
 
 
+// --- ENQUEUE ---
+// Adds the callback message to the connection's queue. If no request is 
+// processing the queue, a new one is added to the worker pool for it.
+void CallbackRequest::enqueue(std::shared_ptr<NymphCallbackQueue> queue, NymphMessage* msg) {
+	queue->mutex.lock();
+	queue->messages.push_back(msg);
+	bool start = !queue->active;
+	queue->active = true;
+	queue->mutex.unlock();
+	
+	if (!start) { return; }
+	
+	CallbackRequest* req = new CallbackRequest;
+	req->session = queue->session;
+	req->data = queue->data;
+	req->queue = queue;
+	Dispatcher::addRequest(req);
+}
+
+
 // --- PROCESS ---
+// Calls the callback for the message, or for each message in the queue until
+// it is empty.
 void CallbackRequest::process() {
+	if (!queue) {
+		call(msg);
+		return;
+	}
+	
+	while (1) {
+		queue->mutex.lock();
+		if (queue->messages.empty()) {
+			queue->active = false;
+			queue->mutex.unlock();
+			break;
+		}
+		
+		NymphMessage* next = queue->messages.front();
+		queue->messages.pop_front();
+		queue->mutex.unlock();
+		
+		call(next);
+	}
+}
+
+
+// --- CALL ---
+void CallbackRequest::call(NymphMessage* msg) {
 	if (!NymphListener::callCallback(session, msg, data)) {
 		//NYMPH_LOG_ERROR("Calling callback failed. Skipping message.");
 		delete msg;
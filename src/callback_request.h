@@ -23,17 +23,34 @@
 #include <atomic>
 #include <condition_variable>
 #include <mutex>
+#include <deque>
+#include <memory>
+
+
+// Callbacks received on a single connection. At most one request processes the
+// queue at any time, calling the callbacks in the order they were received.
+struct NymphCallbackQueue {
+	uint32_t session;
+	void* data;
+	std::mutex mutex;
+	std::deque<NymphMessage*> messages;
+	bool active = false;		// A request is processing the queue.
+};
 
 
 class CallbackRequest : public AbstractRequest {
 	uint32_t session;
-	NymphMessage* msg;
+	NymphMessage* msg = 0;
 	void* data;
+	std::shared_ptr<NymphCallbackQueue> queue;
 	std::string loggerName;
 	
+	void call(NymphMessage* msg);
+	
 public:
 	CallbackRequest() { loggerName = "CallbackRequest"; }
 	void setMessage(uint32_t session, NymphMessage* msg, void* data);
+	static void enqueue(std::shared_ptr<NymphCallbackQueue> queue, NymphMessage* msg);
 	void process();
 	void finish();
 };
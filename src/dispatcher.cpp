@@ -7,122 +7,219 @@
 			- 
 			
 	Notes:
-			- 
-			
+			- Requests added by a worker go into its own queue, others are
+				spread over the workers round-robin. A parked worker is woken
+				up for each new request, if any.
+			- Worker threads are started as needed, up to the pool size, unless
+				they are all started by init().
+	
 	2016/11/19, Maya Posch
 	(c) Nyanko.ws
 */
 
 
 #include "dispatcher.h"
+#include "nymph_logger.h"
+
+#ifdef NPOCO
+#include <npoco/NumberFormatter.h>
+#else
+#include <Poco/NumberFormatter.h>
+#endif
 
-#include <iostream>
 using namespace std;
 
 
 // Static initialisations.
 int Dispatcher::poolSize = 0;
-queue<AbstractRequest*> Dispatcher::requests;
-queue<Worker*> Dispatcher::workers;
-mutex Dispatcher::requestsMutex;
-mutex Dispatcher::workersMutex;
 vector<Worker*> Dispatcher::allWorkers;
 vector<thread*> Dispatcher::threads;
+atomic<int> Dispatcher::started = { 0 };
+atomic<uint32_t> Dispatcher::nextWorker = { 0 };
+atomic<int64_t> Dispatcher::queued = { 0 };
+atomic<uint32_t> Dispatcher::spinCount = { 64 };
+atomic<bool> Dispatcher::stopping = { false };
+atomic<int> Dispatcher::adding = { 0 };
+mutex Dispatcher::spawnMutex;
+string Dispatcher::loggerName = "Dispatcher";
 
 
 // --- INIT ---
-// Set the maximum pool size.
-bool Dispatcher::init(int workers) {
+// Set the pool size. With 'workers' set to 0, one worker per hardware thread is
+// used. If 'spawn' is set, all worker threads are started right away, else as
+// requests come in. Keeps the existing pool if already initialised, so that an
+// application can set up the pool before initialising NymphRPC.
+bool Dispatcher::init(int workers, bool spawn) {
+	spawnMutex.lock();
+	if (!allWorkers.empty()) {
+		spawnMutex.unlock();
+		return true;
+	}
+	
+	if (workers <= 0) { workers = thread::hardware_concurrency(); }
+	if (workers <= 0) { workers = 2; }
 	poolSize = workers;
+	for (int i = 0; i < poolSize; ++i) {
+		allWorkers.push_back(new Worker(i));
+	}
+	
+	stopping = false;
+	spawnMutex.unlock();
 	
-	std::cout << "Dispatcher: Setting max pool size to " << poolSize << " workers." << std::endl;
+	NYMPH_LOG_INFORMATION("Setting pool size to " + Poco::NumberFormatter::format(poolSize) + " workers.");
+	
+	if (spawn) {
+		while (Dispatcher::spawn()) { }
+	}
 	
 	return true;
 }
 
 
 // --- STOP ---
-// Terminate the worker threads and clean up.
+// Terminate the worker threads and clean up. Requests added from then on are 
+// processed on the calling thread.
 bool Dispatcher::stop() {
-	for (int i = 0; i < allWorkers.size(); ++i) {
+	// Stop accepting requests, then wait for those being added to be queued.
+	// After this the workers are only used by their own threads.
+	stopping = true;
+	while (adding > 0) { this_thread::yield(); }
+	
+	// Requests still running may add new ones, so the lock is not held while
+	// waiting for the threads. No further threads are started.
+	spawnMutex.lock();
+	poolSize = started;
+	spawnMutex.unlock();
+	
+	for (int i = 0; i < started; ++i) {
 		allWorkers[i]->stop();
-		delete allWorkers[i];
 	}
 	
-	cout << "Stopped workers.\n";
-	
-	for (int j = 0; j < threads.size(); ++j) {
+	for (uint32_t j = 0; j < threads.size(); ++j) {
 		threads[j]->join();
 		delete threads[j];
-		
-		cout << "Joined threads.\n";
 	}
 	
+	NYMPH_LOG_INFORMATION("Stopped workers.");
+	
+	spawnMutex.lock();
+	if (queued > 0) {
+		NYMPH_LOG_WARNING("Discarding " + Poco::NumberFormatter::format((int64_t) queued) + " requests.");
+	}
+	
+	for (uint32_t i = 0; i < allWorkers.size(); ++i) {
+		delete allWorkers[i];
+	}
+	
+	allWorkers.clear();
+	threads.clear();
+	started = 0;
+	poolSize = 0;
+	queued = 0;
+	spawnMutex.unlock();
+	
 	return true;
 }
 
 
+// --- SET SPIN ---
+// Sets the number of times an idle worker looks for requests before parking.
+// Spinning avoids the wake-up latency under load, at the cost of CPU time.
+void Dispatcher::setSpin(uint32_t iterations) {
+	spinCount = iterations;
+}
+
+
+// --- SPAWN ---
+// Starts the thread of the next worker. Returns 0 if all are running.
+Worker* Dispatcher::spawn() {
+	spawnMutex.lock();
+	if (started >= poolSize) {
+		spawnMutex.unlock();
+		return 0;
+	}
+	
+	Worker* w = allWorkers[started];
+	threads.push_back(new thread(&Worker::run, w));
+	started++;
+	spawnMutex.unlock();
+	
+	NYMPH_LOG_DEBUG("Started worker thread " + Poco::NumberFormatter::format(w->getIndex()) + ".");
+	
+	return w;
+}
+
+
 // --- ADD REQUEST ---
 void Dispatcher::addRequest(AbstractRequest* request) {
-	// Check whether there's a worker available in the workers queue, else add
-	// the request to the requests queue.
-	workersMutex.lock();
-	if (!workers.empty()) {
-		Worker* worker = workers.front();
-		worker->setRequest(request);
-		condition_variable* cv;
-		mutex* mtx;
-		worker->getCondition(cv);
-		worker->getMutex(mtx);
-		unique_lock<mutex> lock(*mtx);
-		cv->notify_one();
-		workers.pop();
-		workersMutex.unlock();
-	}
-	else if (threads.size() < poolSize) {
-		// Create new worker thread.
-		std::cout << "Dispatcher: Creating new thread..." << std::endl;
-		thread* t = 0;
-		Worker* w = 0;
-		w = new Worker;
-		w->setRequest(request);
-		allWorkers.push_back(w);
-		t = new thread(&Worker::run, w);
-		threads.push_back(t);
-		workersMutex.unlock();
+	// The workers are not deleted while a request is being added. Once stopping,
+	// no request is added to them anymore.
+	adding++;
+	if (stopping) {
+		adding--;
+		NYMPH_LOG_WARNING("Dispatcher is stopping. Processing request on calling thread.");
+		request->process();
+		request->finish();
+		return;
 	}
-	else {
-		workersMutex.unlock();
-		requestsMutex.lock();
-		requests.push(request);
-		requestsMutex.unlock();
+	
+	// A worker adds requests to its own queue, keeping related requests on the
+	// same thread unless another worker is idle. Otherwise a new thread is
+	// started if no worker is idle, else the next worker is picked.
+	Worker* worker = Worker::self();
+	if (!worker) {
+		int count = started;
+		bool idle = false;
+		for (int i = 0; i < count && !idle; ++i) { idle = allWorkers[i]->isParked(); }
+		if (!idle) { worker = spawn(); }
+		if (!worker) {
+			count = started;
+			if (count == 0) {
+				adding--;
+				NYMPH_LOG_ERROR("No workers available. Processing request on calling thread.");
+				request->process();
+				request->finish();
+				return;
+			}
+			
+			worker = allWorkers[nextWorker++ % count];
+		}
 	}
 	
+	worker->push(request);
+	queued++;
 	
+	// Wake up the worker, or any other parked one to steal the request.
+	if (!worker->wake()) {
+		int count = started;
+		for (int i = 1; i < count; ++i) {
+			if (allWorkers[(worker->getIndex() + i) % count]->wake()) { break; }
+		}
+	}
+	
+	adding--;
 }
 
 
-// --- ADD WORKER ---
-bool Dispatcher::addWorker(Worker* worker) {
-	// If a request is waiting in the requests queue, assign it to the worker.
-	// Else add the worker to the workers queue.
-	// Returns true if the worker was added to the queue and has to wait for
-	// its condition variable.
-	bool wait = true;
-	requestsMutex.lock();
-	if (!requests.empty()) {
-		AbstractRequest* request = requests.front();
-		worker->setRequest(request);
-		requests.pop();
-		wait = false;
-		requestsMutex.unlock();
-	}
-	else {
-		requestsMutex.unlock();
-		workersMutex.lock();
-		workers.push(worker);
-		workersMutex.unlock();
+// --- GET REQUEST ---
+// Returns the next request for the worker from its own queue, else steals one
+// from another worker. Spins for a while before returning 0 if none is found.
+AbstractRequest* Dispatcher::getRequest(Worker* worker) {
+	uint32_t spins = spinCount;
+	for (uint32_t s = 0; s <= spins; ++s) {
+		AbstractRequest* request = worker->pop();
+		int count = started;
+		for (int i = 1; i < count && !request; ++i) {
+			request = allWorkers[(worker->getIndex() + i) % count]->steal();
+		}
+		
+		if (request) {
+			queued--;
+			return request;
+		}
+		
+		this_thread::yield();
 	}
 	
-	return wait;
+	return 0;
 }
@@ -4,8 +4,10 @@
 	Revision 0
 	
 	Notes:
-			- 
-			
+			- Work-stealing pool: requests are spread over the queues of the
+				workers, and idle workers steal from the other queues. There
+				is no central queue or lock.
+	
 	2016/11/19, Maya Posch
 	(c) Nyanko.ws.
 */
@@ -18,26 +20,35 @@
 #include "abstract_request.h"
 #include "worker.h"
 
-#include <queue>
 #include <mutex>
 #include <thread>
 #include <vector>
+#include <atomic>
+#include <string>
 
 
 class Dispatcher {
 	static int poolSize;
-	static std::queue<AbstractRequest*> requests;
-	static std::queue<Worker*> workers;
-	static std::mutex requestsMutex;
-	static std::mutex workersMutex;
 	static std::vector<Worker*> allWorkers;
 	static std::vector<std::thread*> threads;
+	static std::atomic<int> started;
+	static std::atomic<uint32_t> nextWorker;
+	static std::atomic<int64_t> queued;
+	static std::atomic<uint32_t> spinCount;
+	static std::atomic<bool> stopping;
+	static std::atomic<int> adding;
+	static std::mutex spawnMutex;
+	static std::string loggerName;
+	
+	static Worker* spawn();
 	
 public:
-	static bool init(int workers);
+	static bool init(int workers = 0, bool spawn = false);
 	static bool stop();
+	static void setSpin(uint32_t iterations);
 	static void addRequest(AbstractRequest* request);
-	static bool addWorker(Worker* worker);
+	static AbstractRequest* getRequest(Worker* worker);
+	static bool hasRequests() { return queued.load() > 0; }
 };
 
 #endif
@@ -0,0 +1,41 @@
+/*
+	method_request.cpp - implementation of the MethodRequest class.
+	
+	Revision 0
+	
+	Notes:
+			- 
+			
+	(c) Nyanko.ws
+*/
+
+
+#include "method_request.h"
+
+
+// --- SET MESSAGE ---
+// If the message is part of a batch, its response is added to the batch.
+void MethodRequest::setMessage(NymphSession* session, NymphMessage* msg, NymphSessionBatch* batch) {
+	this->session = session;
+	this->msg = msg;
+	this->batch = batch;
+	messageId = msg->getMessageId();
+	tracked = (msg->getCancelToken() != 0);
+}
+
+
+// --- PROCESS ---
+void MethodRequest::process() {
+	session->processMessage(msg, batch);
+	if (tracked) { session->untrackCall(messageId); }
+}
+
+
+// --- FINISH ---
+void MethodRequest::finish() {
+	// Signal the session that we're done. The session may be deleted after this.
+	session->requestDone();
+	
+	// Call own destructor.
+	delete this;
+}
@@ -0,0 +1,36 @@
+/*
+	method_request.h - header file for the MethodRequest class.
+	
+	Revision 0
+	
+	Notes:
+			- Executes a method call for a server session on a worker thread.
+			
+	(c) Nyanko.ws
+*/
+
+
+#pragma once
+#ifndef METHOD_REQUEST_H
+#define METHOD_REQUEST_H
+
+
+#include "abstract_request.h"
+#include "nymph_message.h"
+#include "nymph_session.h"
+
+
+class MethodRequest : public AbstractRequest {
+	NymphSession* session;
+	NymphMessage* msg;
+	NymphSessionBatch* batch;
+	uint64_t messageId;
+	bool tracked;
+	
+public:
+	void setMessage(NymphSession* session, NymphMessage* msg, NymphSessionBatch* batch = 0);
+	void process();
+	void finish();
+};
+
+#endif
@@ -18,5 +18,9 @@
 
 #include "remote_server.h"
 #include "remote_client.h"
+#include "nymph_buffer_pool.h"
+#include "nymph_simd.h"
+#include "nymph_send_queue.h"
+#include "nymph_upload.h"
 
 #endif
@@ -0,0 +1,59 @@
+/*
+	nymph_arena.cpp - implementation file for the NymphRPC Arena class.
+	
+	Revision 0
+	
+	Notes:
+			- 
+			
+	(c) Nyanko.ws
+*/
+
+
+#include "nymph_arena.h"
+
+
+static const size_t arenaAlign = alignof(std::max_align_t);
+static const size_t firstBlockSize = 1024;
+static const size_t maxBlockSize = 64 * 1024;
+
+
+// --- CONSTRUCTOR ---
+// No memory is allocated until first use.
+NymphArena::NymphArena() {
+	current = 0;
+	used = 0;
+	capacity = 0;
+	nextBlock = firstBlockSize;
+}
+
+
+// --- DESTRUCTOR ---
+NymphArena::~NymphArena() {
+	for (size_t i = 0; i < blocks.size(); ++i) {
+		delete[] blocks[i];
+	}
+}
+
+
+// --- ALLOCATE ---
+// Returns suitably aligned memory of at least 'size' bytes. Blocks grow in size
+// up to a maximum, with larger requests getting their own block.
+void* NymphArena::allocate(size_t size) {
+	size = (size + arenaAlign - 1) & ~(arenaAlign - 1);
+	if (used + size > capacity) {
+		size_t blockSize = nextBlock;
+		if (size > blockSize) { blockSize = size; }
+		if (nextBlock < maxBlockSize) { nextBlock *= 2; }
+		
+		// Memory from new[] is aligned for any fundamental type.
+		current = new uint8_t[blockSize];
+		blocks.push_back(current);
+		used = 0;
+		capacity = blockSize;
+	}
+	
+	void* ptr = current + used;
+	used += size;
+	return ptr;
+}
@@ -0,0 +1,48 @@
+/*
+	nymph_arena.h - header file for the NymphRPC Arena class.
+	
+	Revision 0
+	
+	Notes:
+			- Bump allocator for the values decoded from a message. Memory is
+				only released when the arena is destroyed, along with its 
+				message. Objects created in it must be destroyed explicitly.
+			
+	(c) Nyanko.ws
+*/
+
+
+#pragma once
+#ifndef NYMPH_ARENA_H
+#define NYMPH_ARENA_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+
+class NymphArena {
+	std::vector<uint8_t*> blocks;
+	uint8_t* current;
+	size_t used;
+	size_t capacity;
+	size_t nextBlock;
+	
+	NymphArena(const NymphArena&);
+	NymphArena& operator=(const NymphArena&);
+	
+public:
+	NymphArena();
+	~NymphArena();
+	
+	void* allocate(size_t size);
+	
+	template<class T, class... Args>
+	T* create(Args&&... args) {
+		return new (allocate(sizeof(T))) T(std::forward<Args>(args)...);
+	}
+};
+
+#endif
@@ -0,0 +1,270 @@
+/*
+	nymph_buffer_pool.cpp - implementation file for the NymphRPC Buffer Pool class.
+	
+	Revision 0
+	
+	Notes:
+			- 
+			
+	(c) Nyanko.ws
+*/
+
+
+#include "nymph_buffer_pool.h"
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+using namespace std;
+
+
+static const uint32_t minClassShift = 6;	// 64 bytes.
+static const uint32_t maxClassShift = 20;	// 1 MB.
+static const uint32_t classCount = maxClassShift - minClassShift + 1;
+static const uint32_t localBuffers = 16;	// Per size class and thread.
+
+
+struct NymphPoolClass {
+	vector<uint8_t*> buffers;
+	mutex lock;
+};
+
+
+struct NymphPoolState {
+	NymphPoolClass classes[classCount];
+	atomic<uint32_t> maxBuffers = { 256 };
+	atomic<uint64_t> maxBytes = { 64 * 1024 * 1024 };
+	atomic<uint64_t> hits = { 0 };
+	atomic<uint64_t> misses = { 0 };
+	atomic<uint64_t> retainedBytes = { 0 };
+	atomic<uint64_t> retainedBuffers = { 0 };
+};
+
+
+// --- POOL ---
+// Never destroyed, so that thread caches can return buffers at any time.
+static NymphPoolState& pool() {
+	static NymphPoolState* poolStatic = new NymphPoolState;
+	return *poolStatic;
+}
+
+
+// --- SIZE CLASS ---
+// Returns the size class for the size, or -1 if it is too large to pool.
+static int sizeClass(uint64_t size) {
+	uint32_t shift = minClassShift;
+	while ((1ull << shift) < size) {
+		if (++shift > maxClassShift) { return -1; }
+	}
+	
+	return shift - minClassShift;
+}
+
+
+// --- RETAIN ---
+// Returns whether a buffer of the size class may be added to the shared pool.
+static bool retain(NymphPoolState &p, int cls) {
+	uint64_t bytes = 1ull << (cls + minClassShift);
+	uint64_t current = p.retainedBytes;
+	do {
+		if (current + bytes > p.maxBytes) { return false; }
+	} while (!p.retainedBytes.compare_exchange_weak(current, current + bytes));
+	
+	p.retainedBuffers++;
+	return true;
+}
+
+
+// --- UNRETAIN ---
+static void unretain(NymphPoolState &p, int cls, uint64_t count) {
+	p.retainedBytes -= count << (cls + minClassShift);
+	p.retainedBuffers -= count;
+}
+
+
+// Per-thread buffer cache. Returns its buffers to the shared pool on exit.
+struct NymphThreadCache {
+	vector<uint8_t*> classes[classCount];
+	
+	~NymphThreadCache() {
+		NymphPoolState &p = pool();
+		for (uint32_t i = 0; i < classCount; ++i) {
+			unretain(p, i, classes[i].size());
+			for (uint32_t j = 0; j < classes[i].size(); ++j) {
+				NymphBufferPool::release(classes[i][j], 1u << (i + minClassShift));
+			}
+		}
+	}
+};
+
+
+static thread_local NymphThreadCache* cache = 0;
+static thread_local bool cacheDestroyed = false;
+
+
+// --- LOCAL CACHE ---
+// Returns the cache of the current thread, or null while it is exiting.
+static NymphThreadCache* localCache() {
+	if (cache || cacheDestroyed) { return cache; }
+	
+	// The owner deletes the cache when the thread exits.
+	struct Owner {
+		~Owner() { 
+			NymphThreadCache* c = cache;
+			cache = 0;
+			cacheDestroyed = true;
+			delete c;
+		}
+	};
+	
+	static thread_local Owner owner;
+	cache = new NymphThreadCache;
+	return cache;
+}
+
+
+// --- ACQUIRE ---
+// Get a buffer of at least 'size' bytes. Release it with the same size.
+uint8_t* NymphBufferPool::acquire(uint64_t size) {
+	NymphPoolState &p = pool();
+	int cls = sizeClass(size);
+	if (cls < 0) {
+		p.misses++;
+		return new uint8_t[size];
+	}
+	
+	NymphThreadCache* c = localCache();
+	if (c) {
+		vector<uint8_t*> &local = c->classes[cls];
+		if (local.empty()) {
+			// Refill half of the local cache from the shared pool.
+			NymphPoolClass &shared = p.classes[cls];
+			shared.lock.lock();
+			while (!shared.buffers.empty() && local.size() < localBuffers / 2) {
+				local.push_back(shared.buffers.back());
+				shared.buffers.pop_back();
+			}
+			
+			shared.lock.unlock();
+		}
+		
+		if (!local.empty()) {
+			uint8_t* buffer = local.back();
+			local.pop_back();
+			unretain(p, cls, 1);
+			p.hits++;
+			return buffer;
+		}
+	}
+	else {
+		NymphPoolClass &shared = p.classes[cls];
+		shared.lock.lock();
+		if (!shared.buffers.empty()) {
+			uint8_t* buffer = shared.buffers.back();
+			shared.buffers.pop_back();
+			shared.lock.unlock();
+			unretain(p, cls, 1);
+			p.hits++;
+			return buffer;
+		}
+		
+		shared.lock.unlock();
+	}
+	
+	p.misses++;
+	return new uint8_t[1u << (cls + minClassShift)];
+}
+
+
+// --- RELEASE ---
+// Return a buffer obtained from acquire() with the same size.
+void NymphBufferPool::release(uint8_t* buffer, uint64_t size) {
+	if (!buffer) { return; }
+	
+	NymphPoolState &p = pool();
+	int cls = sizeClass(size);
+	if (cls < 0 || !retain(p, cls)) {
+		delete[] buffer;
+		return;
+	}
+	
+	NymphThreadCache* c = localCache();
+	if (c) {
+		vector<uint8_t*> &local = c->classes[cls];
+		if (local.size() < localBuffers) {
+			local.push_back(buffer);
+			return;
+		}
+		
+		// Move half of the local cache to the shared pool.
+		NymphPoolClass &shared = p.classes[cls];
+		shared.lock.lock();
+		while (local.size() > localBuffers / 2) {
+			if (shared.buffers.size() < p.maxBuffers) {
+				shared.buffers.push_back(local.back());
+			}
+			else {
+				unretain(p, cls, 1);
+				delete[] local.back();
+			}
+			
+			local.pop_back();
+		}
+		
+		shared.lock.unlock();
+		local.push_back(buffer);
+		return;
+	}
+	
+	NymphPoolClass &shared = p.classes[cls];
+	shared.lock.lock();
+	if (shared.buffers.size() < p.maxBuffers) {
+		shared.buffers.push_back(buffer);
+		shared.lock.unlock();
+		return;
+	}
+	
+	shared.lock.unlock();
+	unretain(p, cls, 1);
+	delete[] buffer;
+}
+
+
+// --- SET LIMITS ---
+// Set the maximum number of buffers per size class in the shared pool, and the
+// maximum number of bytes retained in total. Defaults are 256 and 64 MB.
+void NymphBufferPool::setLimits(uint32_t maxBuffersPerClass, uint64_t maxRetainedBytes) {
+	NymphPoolState &p = pool();
+	p.maxBuffers = maxBuffersPerClass;
+	p.maxBytes = maxRetainedBytes;
+}
+
+
+// --- STATS ---
+NymphBufferPoolStats NymphBufferPool::stats() {
+	NymphPoolState &p = pool();
+	NymphBufferPoolStats s;
+	s.hits = p.hits;
+	s.misses = p.misses;
+	s.retainedBytes = p.retainedBytes;
+	s.retainedBuffers = p.retainedBuffers;
+	return s;
+}
+
+
+// --- CLEAR ---
+// Free all buffers in the shared pool. Thread caches are freed on thread exit.
+void NymphBufferPool::clear() {
+	NymphPoolState &p = pool();
+	for (uint32_t i = 0; i < classCount; ++i) {
+		p.classes[i].lock.lock();
+		unretain(p, i, p.classes[i].buffers.size());
+		for (uint32_t j = 0; j < p.classes[i].buffers.size(); ++j) {
+			delete[] p.classes[i].buffers[j];
+		}
+		
+		p.classes[i].buffers.clear();
+		p.classes[i].lock.unlock();
+	}
+}
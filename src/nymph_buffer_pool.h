@@ -0,0 +1,40 @@
+/*
+	nymph_buffer_pool.h - header file for the NymphRPC Buffer Pool class.
+	
+	Revision 0
+	
+	Notes:
+			- Recycles message receive buffers, using power of two size classes
+				from 64 bytes to 1 MB. Larger buffers are not pooled.
+			- Each thread keeps a small cache per size class, which exchanges 
+				buffers in batches with the shared pool.
+			
+	(c) Nyanko.ws
+*/
+
+
+#pragma once
+#ifndef NYMPH_BUFFER_POOL_H
+#define NYMPH_BUFFER_POOL_H
+
+#include <cstdint>
+
+
+struct NymphBufferPoolStats {
+	uint64_t hits;				// Buffers served from the pool.
+	uint64_t misses;			// Buffers which had to be allocated.
+	uint64_t retainedBytes;		// Bytes held in the pool and thread caches.
+	uint64_t retainedBuffers;	// Buffers held in the pool and thread caches.
+};
+
+
+class NymphBufferPool {
+public:
+	static uint8_t* acquire(uint64_t size);
+	static void release(uint8_t* buffer, uint64_t size);
+	static void setLimits(uint32_t maxBuffersPerClass, uint64_t maxRetainedBytes);
+	static NymphBufferPoolStats stats();
+	static void clear();
+};
+
+#endif
@@ -0,0 +1,172 @@
+/*
+	nymph_continuation.cpp - implementation file for the NymphRPC Continuation
+									class.
+	
+	Revision 0
+	
+	Notes:
+			- 
+	
+	(c) Nyanko.ws
+*/
+
+
+#include "nymph_continuation.h"
+#include "nymph_message.h"
+#include "nymph_logger.h"
+
+#ifdef NPOCO
+#include <npoco/NumberFormatter.h>
+#else
+#include <Poco/NumberFormatter.h>
+#endif
+
+#include <new>
+#include <algorithm>
+
+using namespace std;
+
+
+// --- DECONSTRUCTOR ---
+NymphContinuation::~NymphContinuation() {
+	reset();
+}
+
+
+// --- FRAME ---
+// Called with the header of a frame which starts or continues a message sent
+// as continuation frames. Returns where the frame's data is to be read into, 
+// after which frameDone() has to be called. Returns 0 if the frame is invalid,
+// in which case the message is discarded.
+uint8_t* NymphContinuation::frame(uint32_t signature, uint32_t frameLength) {
+	if (!active()) {
+		// The first frame holds the length of the message body.
+		if (signature != nymphContinuationSignature || frameLength != 8) {
+			NYMPH_LOG_ERROR("Invalid first continuation frame.");
+			return 0;
+		}
+		
+		pending = 8;
+		last = false;
+		return (uint8_t*) &length;
+	}
+	
+	if ((signature != nymphContinuationSignature && signature != nymphFrameSignature) || 
+			frameLength == 0 || frameLength > length - received) {
+		NYMPH_LOG_ERROR("Invalid continuation frame.");
+		reset();
+		return 0;
+	}
+	
+	pending = frameLength;
+	last = (signature == nymphFrameSignature);
+	return buffer + received;
+}
+
+
+// --- FRAME DONE ---
+// Called once the data of the frame has been read. Returns the message once its
+// final frame has been read, else 0. The message owns the buffer.
+NymphMessage* NymphContinuation::frameDone() {
+	if (!buffer) {
+		// The length of the message body was read. Check that it can hold at
+		// least the smallest valid message.
+		if (length < 18) {
+			NYMPH_LOG_ERROR("Invalid continuation message length: " + 
+								Poco::NumberFormatter::format(length) + ".");
+			length = 0;
+			return 0;
+		}
+		
+		buffer = new (nothrow) uint8_t[length];
+		if (!buffer) {
+			NYMPH_LOG_ERROR("Failed to allocate " + Poco::NumberFormatter::format(length) + 
+								" bytes for message.");
+			length = 0;
+			return 0;
+		}
+		
+		received = 0;
+		return 0;
+	}
+	
+	received += pending;
+	pending = 0;
+	if (!last) { return 0; }
+	
+	if (received != length) {
+		NYMPH_LOG_ERROR("Continuation message ended after " + 
+							Poco::NumberFormatter::format(received) + " of " + 
+							Poco::NumberFormatter::format(length) + " bytes.");
+		reset();
+		return 0;
+	}
+	
+	NymphMessage* msg = new NymphMessage(buffer, length);
+	buffer = 0;
+	length = 0;
+	received = 0;
+	return msg;
+}
+
+
+// --- READ ---
+// Reads the frame with the provided header from a blocking socket. Sets 'msg' 
+// once the final frame of the message has been read, else to 0. Returns false
+// if the frame is invalid, or could not be read within ten seconds of the last
+// data arriving.
+bool NymphContinuation::read(Poco::Net::StreamSocket &socket, uint32_t signature, 
+											uint32_t frameLength, NymphMessage* &msg) {
+	msg = 0;
+	uint8_t* dest = frame(signature, frameLength);
+	if (!dest) { return false; }
+	
+	Poco::Timespan timeout(1, 0);
+	uint32_t done = 0;
+	uint32_t idle = 0;
+#ifndef NPOCO
+	try {
+#endif
+		while (done < frameLength) {
+			if (!socket.poll(timeout, Poco::Net::Socket::SELECT_READ)) {
+				if (++idle == 10) { 
+					NYMPH_LOG_ERROR("Timed out reading continuation frame.");
+					reset();
+					return false;
+				}
+				
+				continue;
+			}
+			
+			// Limit each read, as the length is passed as an int.
+			int res = socket.receiveBytes(dest + done, (int) min<uint32_t>(frameLength - done, 1 << 30));
+			if (res <= 0) {
+				reset();
+				return false;
+			}
+			
+			idle = 0;
+			done += res;
+		}
+#ifndef NPOCO
+	}
+	catch (...) {
+		reset();
+		return false;
+	}
+#endif
+
+	msg = frameDone();
+	return true;
+}
+
+
+// --- RESET ---
+// Discards any partially received message.
+void NymphContinuation::reset() {
+	delete[] buffer;
+	buffer = 0;
+	length = 0;
+	received = 0;
+	pending = 0;
+}
@@ -0,0 +1,61 @@
+/*
+	nymph_continuation.h - header file for the NymphRPC Continuation class.
+	
+	Revision 0
+	
+	Notes:
+			- Assembles a message received as continuation frames. The first
+				'DRGC' frame holds the length of the message body, for which a
+				single buffer is allocated. Further 'DRGC' frames and the final
+				'DRGN' frame are read straight into this buffer.
+	
+	(c) Nyanko.ws
+*/
+
+
+#pragma once
+#ifndef NYMPH_CONTINUATION_H
+#define NYMPH_CONTINUATION_H
+
+#ifdef NPOCO
+#include <npoco/net/StreamSocket.h>
+#else
+#include <Poco/Net/StreamSocket.h>
+#endif
+
+#include <string>
+#include <cstdint>
+
+
+class NymphMessage;
+
+
+// Signatures of message frames, in LE format.
+static const uint32_t nymphFrameSignature = 0x4452474e;			// 'DRGN'
+static const uint32_t nymphContinuationSignature = 0x4347524e;	// 'DRGC'
+
+
+class NymphContinuation {
+	uint8_t* buffer = 0;
+	uint64_t length = 0;
+	uint64_t received = 0;
+	uint32_t pending = 0;	// Length of the frame being read.
+	bool last = false;
+	std::string loggerName = "NymphContinuation";
+	
+	NymphContinuation(const NymphContinuation&);
+	NymphContinuation& operator=(const NymphContinuation&);
+	
+public:
+	NymphContinuation() { }
+	~NymphContinuation();
+	
+	bool active() { return length > 0; }
+	uint8_t* frame(uint32_t signature, uint32_t frameLength);
+	NymphMessage* frameDone();
+	bool read(Poco::Net::StreamSocket &socket, uint32_t signature, uint32_t frameLength, 
+																NymphMessage* &msg);
+	void reset();
+};
+
+#endif
@@ -0,0 +1,149 @@
+/*
+	nymph_frame_reader.cpp - implementation of the NymphRPC Frame Reader class.
+	
+	Revision 0
+	
+	Notes:
+			- 
+			
+	(c) Nyanko.ws
+*/
+
+
+#include "nymph_frame_reader.h"
+#include "nymph_buffer_pool.h"
+#include "nymph_message.h"
+#include "nymph_logger.h"
+
+#ifdef NPOCO
+#include <npoco/NumberFormatter.h>
+#else
+#include <Poco/NumberFormatter.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <cerrno>
+#endif
+
+#include <cstring>
+#include <algorithm>
+
+using namespace Poco;
+using namespace std;
+
+
+// Smallest valid message: version, method ID, flags, message ID & terminator.
+static const uint32_t minimumLength = 18;
+
+
+// --- CONSTRUCTOR ---
+NymphFrameReader::NymphFrameReader() {
+	loggerName = "NymphFrameReader";
+	headerRead = 0;
+	buffer = 0;
+	target = 0;
+	length = 0;
+	bodyRead = 0;
+	continued = false;
+}
+
+
+// --- DESTRUCTOR ---
+NymphFrameReader::~NymphFrameReader() {
+	// Discard any partially received frame.
+	if (buffer) { NymphBufferPool::release(buffer, length); }
+}
+
+
+// --- READ ---
+// Reads whatever is available on the socket without blocking. Each completed
+// frame is parsed into a new NymphMessage and appended to 'messages'.
+// Returns false if the remote disconnected, or the stream is no longer usable.
+bool NymphFrameReader::read(int fd, vector<NymphMessage*> &messages) {
+#ifdef _WIN32
+	NYMPH_LOG_ERROR("Non-blocking frame reading is not supported on this platform.");
+	return false;
+#else
+	while (1) {
+		ssize_t received;
+		if (headerRead < 8) {
+			received = ::recv(fd, header + headerRead, 8 - headerRead, MSG_DONTWAIT);
+		}
+		else {
+			received = ::recv(fd, target + bodyRead, min<uint32_t>(length - bodyRead, 1 << 30), MSG_DONTWAIT);
+		}
+		
+		if (received == 0) {
+			// Remote disconnected.
+			NYMPH_LOG_INFORMATION("Received remote disconnected notice.");
+			return false;
+		}
+		else if (received < 0) {
+			if (errno == EINTR) { continue; }
+			if (errno == EAGAIN || errno == EWOULDBLOCK) { return true; }
+			
+			NYMPH_LOG_ERROR("Error reading from socket: " + NumberFormatter::format(errno));
+			return false;
+		}
+		
+		if (headerRead < 8) {
+			headerRead += received;
+			if (headerRead < 8) { continue; }
+			
+			// Validate the header (0x4452474e), then read the uint32 following
+			// it. This contains the data length (LE format).
+			uint32_t signature;
+			memcpy(&signature, header, 4);
+			if (signature == nymphContinuationSignature || continuation.active()) {
+				// Part of a message which is too large for a single frame.
+				memcpy(&length, (header + 4), 4);
+				target = continuation.frame(signature, length);
+				if (!target) { return false; }
+				
+				continued = true;
+				bodyRead = 0;
+				continue;
+			}
+			
+			if (signature != 0x4452474e) { // 'DRGN' ASCII in LE format.
+				// We cannot find the start of the next frame any more.
+				NYMPH_LOG_ERROR("Invalid header: 0x" + NumberFormatter::formatHex(signature));
+				return false;
+			}
+			
+			memcpy(&length, (header + 4), 4);
+			if (length < minimumLength) {
+				NYMPH_LOG_ERROR("Invalid message length: " + NumberFormatter::format(length));
+				return false;
+			}
+			
+			NYMPH_LOG_DEBUG("Message length: " + NumberFormatter::format(length) + " bytes.");
+			
+			buffer = NymphBufferPool::acquire(length);
+			target = buffer;
+			bodyRead = 0;
+			continue;
+		}
+		
+		bodyRead += received;
+		if (bodyRead < length) { continue; }
+		
+		if (continued) {
+			NymphMessage* msg = continuation.frameDone();
+			if (msg) { messages.push_back(msg); }
+		}
+		else {
+			// Full message was read. Buffer ownership is transferred to the message.
+			messages.push_back(new NymphMessage(buffer, length, true));
+		}
+		
+		buffer = 0;
+		target = 0;
+		length = 0;
+		headerRead = 0;
+		continued = false;
+	}
+#endif
+}
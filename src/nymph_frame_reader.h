@@ -0,0 +1,48 @@
+/*
+	nymph_frame_reader.h - header file for the NymphRPC Frame Reader class.
+	
+	Revision 0
+	
+	Notes:
+			- Assembles Nymph messages from a non-blocking socket, for use with
+				the reactor. Bytes are read as they become available, keeping 
+				the state of any partially received frame between calls.
+			- Continuation frames are read straight into the buffer of the
+				message they belong to.
+	
+	(c) Nyanko.ws
+*/
+
+
+#pragma once
+#ifndef NYMPH_FRAME_READER_H
+#define NYMPH_FRAME_READER_H
+
+#include "nymph_continuation.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+
+class NymphMessage;
+
+
+class NymphFrameReader {
+	uint8_t header[8];
+	uint32_t headerRead;
+	uint8_t* buffer;
+	uint8_t* target;	// Where the body of the current frame is read into.
+	uint32_t length;
+	uint32_t bodyRead;
+	NymphContinuation continuation;
+	bool continued;		// Set if the current frame is a continuation frame.
+	std::string loggerName;
+	
+public:
+	NymphFrameReader();
+	~NymphFrameReader();
+	bool read(int fd, std::vector<NymphMessage*> &messages);
+};
+
+#endif
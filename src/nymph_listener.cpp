@@ -40,22 +40,52 @@ using namespace Poco;
 map<int, NymphSocketListener*> NymphListener::listeners;
 Mutex NymphListener::listenersMutex;
 string NymphListener::loggerName = "NymphListener";
+NymphReactor* NymphListener::reactor = 0;
+atomic<bool> NymphListener::ordered = { true };
+
+
+// --- REGISTRY ---
+shared_ptr<NymphCallbackMap>& NymphListener::registry() {
+	static shared_ptr<NymphCallbackMap>* registryStatic = 
+								new shared_ptr<NymphCallbackMap>(new NymphCallbackMap);
+	return *registryStatic;
+}
 
 
 // --- CALLBACKS ---
-map<string, NymphCallback>& NymphListener::callbacks() {
-	static map<string, NymphCallback>* callbacksStatic = new map<string, NymphCallback>();
-	return *callbacksStatic;
+// Returns the current snapshot of the registered callbacks.
+shared_ptr<NymphCallbackMap> NymphListener::callbacks() {
+	return atomic_load(&registry());
 }
 
 
 // --- CALLBACKS MUTEX ---
+// Serialises changes to the callbacks. Not used for lookups.
 Mutex& NymphListener::callbacksMutex() {
 	static Mutex* callbacksMutexStatic = new Mutex;
 	return *callbacksMutexStatic;
 }
 
 
+// --- START ---
+// Use a reactor with 'ioThreads' I/O threads for all connections, instead of a 
+// listener thread per connection. Only available on Linux.
+bool NymphListener::start(int ioThreads) {
+	if (reactor) { return true; }
+	
+	reactor = new NymphReactor;
+	reactor->setTimer(&NymphListener::expireMessages, 100);
+	if (!reactor->start(ioThreads)) {
+		NYMPH_LOG_ERROR("Failed to start listener reactor.");
+		delete reactor;
+		reactor = 0;
+		return false;
+	}
+	
+	return true;
+}
+
+
 // --- STOP ---
 void NymphListener::stop() {
 	// Shut down all listening threads.
@@ -63,12 +93,33 @@ void NymphListener::stop() {
 	std::map<int, NymphSocketListener*>::iterator it;
 	for (it = listeners.begin(); it != listeners.end(); ++it) {
 		it->second->stop();
-		delete it->second;
+		
+		// Reactor listeners clean themselves up once removed from the reactor.
+		if (!reactor) { delete it->second; }
 	}
 	
 	listeners.clear(); 
 	
 	listenersMutex.unlock();
+	
+	if (reactor) {
+		reactor->stop();
+		delete reactor;
+		reactor = 0;
+	}
+}
+
+
+// --- EXPIRE MESSAGES ---
+// Periodically called by the reactor to expire asynchronous requests.
+void NymphListener::expireMessages() {
+	listenersMutex.lock();
+	std::map<int, NymphSocketListener*>::iterator it;
+	for (it = listeners.begin(); it != listeners.end(); ++it) {
+		it->second->expire();
+	}
+	
+	listenersMutex.unlock();
 }
 
 
@@ -76,6 +127,26 @@ void NymphListener::stop() {
 bool NymphListener::addConnection(int handle, NymphSocket socket) {
 	NYMPH_LOG_INFORMATION("Adding connection. Handle: " + NumberFormatter::format(handle) + ".");
 	
+	if (reactor && !socket.channel) {
+		// The reactor's I/O threads handle the socket. No thread is needed.
+		// Shared memory channels always use a listener thread.
+		NymphSocketListener* esl = new NymphSocketListener(socket, 0, 0);
+		listenersMutex.lock();
+		listeners.insert(std::pair<int, NymphSocketListener*>(handle, esl));
+		if (!esl->attach(reactor)) {
+			NYMPH_LOG_ERROR("Failed to add socket to listener reactor.");
+			listeners.erase(handle);
+			listenersMutex.unlock();
+			delete esl;
+			return false;
+		}
+		
+		listenersMutex.unlock();
+		
+		NYMPH_LOG_INFORMATION("Listening socket has been added.");
+		return true;
+	}
+	
 	// Create new thread for NymphSocketListener instance which handles
 	// the new socket. Save reference to this listener.
 	Poco::Condition* cnd = new Poco::Condition;
@@ -128,56 +199,19 @@ bool NymphListener::removeConnection(int handle) {
 }
 
 
-// --- ADD MESSAGE ---
-bool NymphListener::addMessage(NymphRequest* &request) {
-	NYMPH_LOG_INFORMATION("Adding request for message ID: " + NumberFormatter::format(request->messageId) + ".");
-	
-	listenersMutex.lock();
-	map<int, NymphSocketListener*>::iterator it;
-	it = listeners.find(request->handle);
-	if (it == listeners.end()) {
-		NYMPH_LOG_ERROR("Handle " + NumberFormatter::format(request->handle) + " not found. Dropping message ID " + NumberFormatter::format(request->messageId));
-		listenersMutex.unlock();
-		return false;
-	}
-	
-	it->second->addMessage(request);
-	
-	listenersMutex.unlock();
-	return true;
-}
-
-
-// --- REMOVE MESSAGE ---
-bool NymphListener::removeMessage(int handle, Int64 messageId) {
-	NYMPH_LOG_INFORMATION("Removing request for message ID: " + NumberFormatter::format(messageId) + ".");
-	
-	listenersMutex.lock();
-	map<int, NymphSocketListener*>::iterator it;
-	it = listeners.find(handle);
-	if (it == listeners.end()) {
-		NYMPH_LOG_ERROR("Handle " + NumberFormatter::format(handle) + " not found. Dropping message ID " + NumberFormatter::format(messageId));
-		listenersMutex.unlock();
-		return false;
-	}
-	
-	it->second->removeMessage(messageId);
-	
-	listenersMutex.unlock();
-	return true;
-}
-
-
 // --- ADD CALLBACK ---
+// Adding a callback copies the current snapshot, so it is best done before 
+// connecting.
 bool NymphListener::addCallback(NymphCallback callback) {
-	static map<string, NymphCallback> &callbacksStatic = NymphListener::callbacks();
 	static Mutex& callbacksMutexStatic = NymphListener::callbacksMutex();
 	callbacksMutexStatic.lock();
 	
 	// FIXME: ensure Poco logging is initialised before calling logging.
 	//NYMPH_LOG_INFORMATION("Adding callback for method: " + callback.name + ".");
 	
-	callbacksStatic.insert(pair<string, NymphCallback>(callback.name, callback));
+	shared_ptr<NymphCallbackMap> updated(new NymphCallbackMap(*callbacks()));
+	updated->insert(pair<string, NymphCallback>(callback.name, callback));
+	atomic_store(&registry(), updated);
 	callbacksMutexStatic.unlock();
 	
 	return true;
@@ -185,17 +219,15 @@ bool NymphListener::addCallback(NymphCallback callback) {
 
 
 // --- CALL CALLBACK ---
+// Looks up the callback in the current snapshot, which keeps it alive while it
+// runs. No lock is held, so callbacks run concurrently.
 bool NymphListener::callCallback(uint32_t session, NymphMessage* msg, void* data) {
-	static map<string, NymphCallback> &callbacksStatic = NymphListener::callbacks();
-	static Mutex& callbacksMutexStatic = NymphListener::callbacksMutex();
-	map<string, NymphCallback>::iterator cit;
-	callbacksMutexStatic.lock();
-	cit = callbacksStatic.find(msg->getCallbackName());
-	if (cit == callbacksStatic.end()) {
+	shared_ptr<NymphCallbackMap> snapshot = callbacks();
+	NymphCallbackMap::iterator cit = snapshot->find(msg->getCallbackName());
+	if (cit == snapshot->end()) {
 		NYMPH_LOG_WARNING("Callback not found for method: "  
 				+ msg->getCallbackName() + ".");
 		
-		callbacksMutexStatic.unlock();
 		return false;				
 	}
 	
@@ -205,7 +237,6 @@ bool NymphListener::callCallback(uint32_t session, NymphMessage* msg, void* data
 	// Use the provided data, else the default data.
 	if (data) { (cit->second.method)(session, msg, data); }
 	else { (cit->second.method)(session, msg, cit->second.data); }
-	callbacksMutexStatic.unlock();
 	
 	return true;
 }
@@ -213,15 +244,24 @@ bool NymphListener::callCallback(uint32_t session, NymphMessage* msg, void* data
 
 // --- REMOVE CALLBACK ---
 bool NymphListener::removeCallback(string name) {
-	static map<string, NymphCallback> &callbacksStatic = NymphListener::callbacks();
 	static Mutex& callbacksMutexStatic = NymphListener::callbacksMutex();
-	map<string, NymphCallback>::iterator it;
 	callbacksMutexStatic.lock();
 	
 	NYMPH_LOG_INFORMATION("Removing callback for method: " + name + ".");
 	
-	it = callbacksStatic.find(name);
-	if (it != callbacksStatic.end()) { callbacksStatic.erase(it); }
+	shared_ptr<NymphCallbackMap> updated(new NymphCallbackMap(*callbacks()));
+	updated->erase(name);
+	atomic_store(&registry(), updated);
 	callbacksMutexStatic.unlock();
 	return true;
 }
+
+
+// --- SET CALLBACK ORDERING ---
+// If enabled (default), callbacks received on one connection are called one 
+// after the other, in the order in which they were received. Callbacks from 
+// different connections still run concurrently. If disabled, all callbacks are
+// called concurrently on the worker pool.
+void NymphListener::setCallbackOrdering(bool ordered) {
+	NymphListener::ordered = ordered;
+}
@@ -20,6 +20,9 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <memory>
+#include <atomic>
 #include <functional>
 
 #ifdef NPOCO
@@ -44,6 +47,11 @@ struct NymphCallback {
 };
 
 
+// Snapshot of the registered callbacks. It is never modified once published, 
+// but replaced as a whole when callbacks are added or removed.
+typedef std::map<std::string, NymphCallback> NymphCallbackMap;
+
+
 // ---
 
 
@@ -51,20 +59,27 @@ class NymphListener {
 	static std::map<int, NymphSocketListener*> listeners;
 	static Poco::Mutex listenersMutex;
 	static std::string loggerName;
+	static NymphReactor* reactor;
+	
+	static std::atomic<bool> ordered;
 	
-	static std::map<std::string, NymphCallback>& callbacks();
+	static std::shared_ptr<NymphCallbackMap>& registry();
+	static std::shared_ptr<NymphCallbackMap> callbacks();
 	static Poco::Mutex& callbacksMutex();
+	static void expireMessages();
 	
 public:
+	static bool start(int ioThreads);
 	static void stop();
+	static bool usingReactor() { return reactor != 0; }
 	
 	static bool addConnection(int handle, NymphSocket socket);
 	static bool removeConnection(int handle);
-	static bool addMessage(NymphRequest* &request);
-	static bool removeMessage(int handle, int64_t messageId);
 	static bool addCallback(NymphCallback callback);
 	static bool callCallback(uint32_t session, NymphMessage* msg, void* data);
 	static bool removeCallback(std::string name);
+	static void setCallbackOrdering(bool ordered);
+	static bool orderedCallbacks() { return ordered; }
 };
 
 #endif
@@ -15,6 +15,7 @@
 #include "nymph_message.h"
 #include "nymph_utilities.h"
 #include "nymph_logger.h"
+#include "nymph_buffer_pool.h"
 
 #include <sstream>
 #include <algorithm>
@@ -34,10 +35,16 @@ using namespace std;
 using namespace Poco;
 
 
+// Static initialisations.
+atomic<uint32_t> NymphMessage::frameLimit = { UINT32_MAX };
+
+
 // --- CONSTRUCTOR ---
 NymphMessage::NymphMessage() {
 	flags = 0;
 	state = 0;
+	methodId = 0;
+	messageId = 0;
 	responseId = 0;
 	hasResult = false;
 	loggerName = "NymphMessage";
@@ -51,6 +58,7 @@ NymphMessage::NymphMessage() {
 NymphMessage::NymphMessage(uint32_t methodId) {
 	flags = 0;
 	state = 0; // no error
+	messageId = 0;
 	responseId = 0;
 	hasResult = false;
 	this->methodId = methodId;
@@ -62,8 +70,9 @@ NymphMessage::NymphMessage(uint32_t methodId) {
 }
 
 
-// Deserialises a binary Nymph message.
-NymphMessage::NymphMessage(uint8_t* binmsg, uint64_t bytes) {
+// Deserialises a binary Nymph message. If 'pooled' is set, the buffer was 
+// obtained from the NymphBufferPool and is returned to it.
+NymphMessage::NymphMessage(uint8_t* binmsg, uint64_t bytes, bool pooled) {
 	flags = 0;
 	state = 0; // no error
 	responseId = 0;
@@ -73,6 +82,7 @@ NymphMessage::NymphMessage(uint8_t* binmsg, uint64_t bytes) {
 	loggerName = "NymphMessage";
 	data_buffer = binmsg;
 	buffer_length = bytes;
+	pooledBuffer = pooled;
 	
 	// The string we receive here is stripped of the Nymph header (0x4452474e, 'DRGN')
 	// as well as the length of the message.
@@ -81,7 +91,7 @@ NymphMessage::NymphMessage(uint8_t* binmsg, uint64_t bytes) {
 	uint8_t version = 0;
 	methodId = 0;
 	
-	int index = 0;
+	uint64_t index = 0;
 	version = *binmsg;
 	index++;
 	memcpy(&methodId, (binmsg + index), 4);
@@ -109,15 +119,84 @@ NymphMessage::NymphMessage(uint8_t* binmsg, uint64_t bytes) {
 	memcpy(&messageId, (binmsg + index), 8);
 	index += 8;
 	
+	// The deadline is sent as the number of milliseconds left, as the clocks of
+	// both sides are not synchronised.
+	if (flags & NYMPH_MESSAGE_DEADLINE) {
+		uint32_t remaining = 0;
+		if (index + 4 > bytes) {
+			NYMPH_LOG_ERROR("Message is missing its deadline.");
+			corrupt = true;
+			return;
+		}
+		
+		memcpy(&remaining, (binmsg + index), 4);
+		index += 4;
+		deadline = chrono::steady_clock::now() + chrono::milliseconds(remaining);
+	}
+	
 	uint8_t typecode;
-	if (flags & NYMPH_MESSAGE_REPLY) {
+	if (flags & NYMPH_MESSAGE_BATCH) {
+		// Read in the messages contained in the batch. Each is a complete 
+		// message, including its signature and length.
+		uint32_t count = 0;
+		if (index + 4 > bytes) {
+			NYMPH_LOG_ERROR("Batch message is missing its message count.");
+			corrupt = true;
+			return;
+		}
+		
+		memcpy(&count, (binmsg + index), 4);
+		index += 4;
+		
+		for (uint32_t i = 0; i < count; ++i) {
+			uint32_t signature = 0;
+			uint32_t length = 0;
+			if (bytes - index < 8) {
+				NYMPH_LOG_ERROR("Batched message header out of bounds. Abort.");
+				corrupt = true;
+				return;
+			}
+			
+			memcpy(&signature, (binmsg + index), 4);
+			memcpy(&length, (binmsg + index + 4), 4);
+			index += 8;
+			if (signature != 0x4452474e || length > bytes - index) {
+				NYMPH_LOG_ERROR("Invalid batched message at index " + NumberFormatter::format(i) + ".");
+				corrupt = true;
+				return;
+			}
+			
+			// Each message gets its own buffer, so it can be released on its own.
+			uint8_t* buff = NymphBufferPool::acquire(length);
+			memcpy(buff, (binmsg + index), length);
+			index += length;
+			
+			NymphMessage* msg = new NymphMessage(buff, length, true);
+			batch.push_back(msg);
+			if (msg->isCorrupt() || msg->getState() != 0 || msg->isBatch()) {
+				NYMPH_LOG_ERROR("Batched message " + NumberFormatter::format(i) + " is invalid.");
+				corrupt = true;
+				return;
+			}
+		}
+		
+		if (index >= bytes || *(binmsg + index) != NYMPH_TYPE_NONE) {
+			NYMPH_LOG_ERROR("Reached end of batch message without terminator found.");
+			corrupt = true;
+		}
+	}
+	else if (flags & NYMPH_MESSAGE_REPLY) {
 		memcpy(&responseId, (binmsg + index), 8);
 		index += 8;
 		
 		// Read in the response
 		typecode = *(binmsg + index++);
 		response = new NymphType;
-		response->parseValue(typecode, binmsg, index);
+		if (!response->parseValue(typecode, binmsg, index, bytes, &arena)) {
+			NYMPH_LOG_ERROR("Failed to parse the response value. Abort.");
+			corrupt = true;
+			return;
+		}
 		
 		if (index >= bytes) {
 			// Out of bounds, abort.
@@ -135,19 +214,55 @@ NymphMessage::NymphMessage(uint8_t* binmsg, uint64_t bytes) {
 		
 		response->linkWithMessage(this);
 	}
+	else if (flags & NYMPH_MESSAGE_CHUNK) {
+		// Upload part: the message ID of the call, followed by the value. A part
+		// without a value ends the upload.
+		if (index + 9 > bytes) {
+			NYMPH_LOG_ERROR("Upload part out of bounds. Abort.");
+			corrupt = true;
+			return;
+		}
+		
+		memcpy(&responseId, (binmsg + index), 8);
+		index += 8;
+		if (*(binmsg + index) != NYMPH_TYPE_NONE) {
+			typecode = *(binmsg + index++);
+			response = new NymphType;
+			if (!response->parseValue(typecode, binmsg, index, bytes, &arena) || 
+					index >= bytes || *(binmsg + index) != NYMPH_TYPE_NONE) {
+				NYMPH_LOG_ERROR("Reached end of upload part without terminator found.");
+				corrupt = true;
+				return;
+			}
+			
+			response->linkWithMessage(this);
+		}
+	}
+	else if (flags & NYMPH_MESSAGE_CANCEL) {
+		// Read the message ID of the call to cancel.
+		if (index + 9 > bytes) {
+			NYMPH_LOG_ERROR("Cancel message out of bounds. Abort.");
+			corrupt = true;
+			return;
+		}
+		
+		memcpy(&responseId, (binmsg + index), 8);
+		index += 8;
+		if (*(binmsg + index) != NYMPH_TYPE_NONE) { corrupt = true; }
+	}
 	else if (flags & NYMPH_MESSAGE_EXCEPTION) {
 		memcpy(&responseId, (binmsg + index), 8);
 		
 		// Read in the exception (integer, string).
 		typecode = *(binmsg + index++);
 		NymphType value;
-		value.parseValue(typecode, binmsg, index);
+		value.parseValue(typecode, binmsg, index, bytes);
 		if (value.valuetype() == NYMPH_UINT32) {
 			exception.id = value.getUint32();
 		}
 		
 		typecode = *(binmsg + index++);
-		value.parseValue(typecode, binmsg, index);
+		value.parseValue(typecode, binmsg, index, bytes);
 		if (value.valuetype() == NYMPH_STRING) {
 			exception.value = std::string(value.getChar(), value.string_length());
 		}
@@ -156,7 +271,7 @@ NymphMessage::NymphMessage(uint8_t* binmsg, uint64_t bytes) {
 		// Read in the name of the callback method.
 		typecode = *(binmsg + index++);
 		NymphType value;
-		value.parseValue(typecode, binmsg, index);
+		value.parseValue(typecode, binmsg, index, bytes);
 		if (value.valuetype() == NYMPH_STRING) {
 			callbackName = std::string(value.getChar(), value.string_length());
 		}
@@ -165,7 +280,13 @@ NymphMessage::NymphMessage(uint8_t* binmsg, uint64_t bytes) {
 		while (index < bytes && *(binmsg + index) != NYMPH_TYPE_NONE) {		
 			typecode = *(binmsg + index++);
 			NymphType* val = new NymphType;
-			val->parseValue(typecode, binmsg, index);
+			if (!val->parseValue(typecode, binmsg, index, bytes, &arena)) {
+				NYMPH_LOG_ERROR("Failed to parse parameter value. Message is likely corrupt.");
+				delete val;
+				corrupt = true;
+				break;
+			}
+			
 			val->linkWithMessage(this);
 			values.push_back(val);
 			
@@ -190,7 +311,13 @@ NymphMessage::NymphMessage(uint8_t* binmsg, uint64_t bytes) {
 		while (index < bytes && *(binmsg + index) != NYMPH_TYPE_NONE) {
 			typecode = *(binmsg + index++);
 			NymphType* val = new NymphType;
-			val->parseValue(typecode, binmsg, index);
+			if (!val->parseValue(typecode, binmsg, index, bytes, &arena)) {
+				NYMPH_LOG_ERROR("Failed to parse parameter value. Message is likely corrupt.");
+				delete val;
+				corrupt = true;
+				break;
+			}
+			
 			val->linkWithMessage(this);
 			values.push_back(val);
 			
@@ -210,9 +337,10 @@ NymphMessage::NymphMessage(uint8_t* binmsg, uint64_t bytes) {
 // --- DECONSTRUCTOR ---
 // Delete all values stored in this message since we have taken ownership.
 NymphMessage::~NymphMessage() {
-	if (data_buffer && buffer_length > 0) {
-		delete[] data_buffer;
-	}
+	// A pooled buffer is returned with the size it was acquired with, which is 
+	// the length of the received message, even if that is 0.
+	if (pooledBuffer) { NymphBufferPool::release(data_buffer, buffer_length); }
+	else if (data_buffer && buffer_length > 0) { delete[] data_buffer; }
 	
 	for (int i = 0; i < values.size(); i++) {
 		delete values[i];
@@ -222,6 +350,11 @@ NymphMessage::~NymphMessage() {
 		delete response;
 	}
 	
+	// Batched messages may have linked values, which would delete them again.
+	for (uint32_t i = 0; i < batch.size(); ++i) {
+		batch[i]->discard();
+	}
+	
 	values.clear();
 }
 
@@ -253,9 +386,140 @@ bool NymphMessage::addValues(std::vector<NymphType*> &values) {
 }
 
 
+// --- SET FRAME LIMIT ---
+// Sets the largest message body sent in a single frame. Larger messages are
+// sent as a series of continuation frames.
+void NymphMessage::setFrameLimit(uint32_t bytes) {
+	if (bytes > 0) { frameLimit = bytes; }
+}
+
+
 // --- SERIALIZE ---
 // Serialise the message's data and update the internal message data buffer.
 void NymphMessage::serialize() {
+	serializeMessage(0);
+	splitFrames();
+}
+
+
+// --- SERIALIZE VECTORED ---
+// Serialise the message into a list of segments. Strings of at least 
+// 'threshold' bytes are referenced in place, with the other data copied into
+// the internal message data buffer. The referenced values must remain valid 
+// until the message has been sent, or ownData() has been called. 
+void NymphMessage::serializeVectored(uint32_t threshold) {
+	NymphSegments segs;
+	segs.threshold = threshold;
+	serializeMessage(&segs);
+	splitFrames();
+}
+
+
+// --- OWN DATA ---
+// Copies the serialised message into its own buffer if any of its segments
+// references memory which the message does not own, such as a string passed by
+// the caller without ownership. Afterwards the message no longer depends on the
+// caller keeping that memory valid.
+void NymphMessage::ownData() {
+	if (!externalData) { return; }
+	
+	uint8_t* buf = new uint8_t[buffer_length];
+	uint8_t* index = buf;
+	for (uint32_t i = 0; i < bufferSegments.size(); ++i) {
+		memcpy(index, bufferSegments[i].data, bufferSegments[i].length);
+		index += bufferSegments[i].length;
+	}
+	
+	delete[] data_buffer;
+	data_buffer = buf;
+	bufferSegments.clear();
+	frameHeaders.clear();
+	externalData = false;
+	
+	NYMPH_LOG_DEBUG("Copied " + NumberFormatter::format(buffer_length) + " bytes of referenced data into message.");
+}
+
+
+// --- SPLIT FRAMES ---
+// Turns a serialised message whose body exceeds the frame limit into a list of
+// continuation frames: a 'DRGC' frame holding the uint64 length of the body, 
+// 'DRGC' frames with the parts of the body and a final 'DRGN' frame with the 
+// last part. The data itself is referenced, not copied.
+void NymphMessage::splitFrames() {
+	uint64_t body = buffer_length - 8;
+	uint64_t limit = frameLimit;
+	if (body <= limit) { return; }
+	
+	// The data of the message, without its header.
+	vector<NymphBufferSegment> data;
+	if (bufferSegments.empty()) {
+		NymphBufferSegment seg;
+		seg.data = data_buffer;
+		seg.length = buffer_length;
+		data.push_back(seg);
+	}
+	else { data.swap(bufferSegments); }
+	
+	data[0].data += 8;
+	data[0].length -= 8;
+	
+	uint64_t count = (body + limit - 1) / limit;
+	frameHeaders.resize(16 + 8 * count);
+	uint8_t* header = frameHeaders.data();
+	uint32_t signature = 0x4347524e; // 'DRGC' ASCII in LE format.
+	uint32_t length = 8;
+	memcpy(header, &signature, 4);
+	memcpy(header + 4, &length, 4);
+	memcpy(header + 8, &body, 8);
+	
+	vector<NymphBufferSegment> frames;
+	NymphBufferSegment seg;
+	seg.data = header;
+	seg.length = 16;
+	frames.push_back(seg);
+	header += 16;
+	
+	uint32_t idx = 0;
+	uint64_t offset = 0;	// Offset into the current data segment.
+	uint64_t left = body;
+	for (uint64_t i = 0; i < count; ++i) {
+		length = (uint32_t) min(left, limit);
+		left -= length;
+		if (left == 0) { signature = 0x4452474e; } // 'DRGN' ASCII in LE format.
+		memcpy(header, &signature, 4);
+		memcpy(header + 4, &length, 4);
+		seg.data = header;
+		seg.length = 8;
+		frames.push_back(seg);
+		header += 8;
+		
+		// Add the data of this frame, which may span several segments.
+		uint64_t remaining = length;
+		while (remaining > 0) {
+			uint64_t part = min(remaining, data[idx].length - offset);
+			seg.data = data[idx].data + offset;
+			seg.length = part;
+			frames.push_back(seg);
+			remaining -= part;
+			offset += part;
+			if (offset == data[idx].length) {
+				idx++;
+				offset = 0;
+			}
+		}
+	}
+	
+	bufferSegments.swap(frames);
+	buffer_length = body + frameHeaders.size();
+	
+	NYMPH_LOG_DEBUG("Split message into " + NumberFormatter::format(count) + " frames.");
+}
+
+
+// --- SERIALIZE MESSAGE ---
+// Serialises the message. If 'segments' is provided, large values are not 
+// copied, but referenced in the resulting segment list.
+void NymphMessage::serializeMessage(NymphSegments* segments) {
 	uint8_t nymphNone = NYMPH_TYPE_NONE;
 	
 	NYMPH_LOG_DEBUG("Serialising message with flags: 0x" + NumberFormatter::formatHex(flags));
@@ -293,6 +557,12 @@ void NymphMessage::serialize() {
 	// * <header>
 	// * ?			Serialised values.
 	// * uint8		None
+	//
+	// Batch message:
+	// * <header>
+	// * uint32		Message count
+	// * ?			Serialised messages, each including signature & length.
+	// * uint8		None
 	uint32_t signature = 0x4452474e; // 'DRGN'
 	
 	// Message length is always:
@@ -306,8 +576,31 @@ void NymphMessage::serialize() {
 	// 
 	// For a response message, add another 8 bytes to the length. (incl. exceptions).
 	// For a callback message, add 1 byte + callback name length.
-	uint32_t message_length = 18 + buffer_length;
+	// For a batch message, add 4 bytes + the size of the contained messages.
+	// With a deadline, add 4 bytes.
+	// For a cancel message or upload part, add 8 bytes.
+	uint64_t batched = 0;
+	if (flags & NYMPH_MESSAGE_BATCH) {
+		for (unsigned int i = 0; i < batch.size(); ++i) {
+			if (segments) {
+				NymphSegments segs;
+				segs.threshold = segments->threshold;
+				batch[i]->serializeMessage(&segs);
+				if (segs.external) { segments->external = true; }
+			}
+			else { batch[i]->serializeMessage(0); }
+			
+			batched += batch[i]->buffer_size();
+		}
+		
+		buffer_length = 4 + batched;
+	}
+	
+	uint64_t message_length = 18 + buffer_length;
 	if (flags & NYMPH_MESSAGE_REPLY) { message_length += 8; }
+	if (flags & NYMPH_MESSAGE_CANCEL) { message_length += 8; }
+	else if ((flags & NYMPH_MESSAGE_CHUNK) && !(flags & NYMPH_MESSAGE_REPLY)) { message_length += 8; }
+	if (flags & NYMPH_MESSAGE_DEADLINE) { message_length += 4; }
 	if (flags & NYMPH_MESSAGE_EXCEPTION) { message_length += 8; }
 	else if (flags & NYMPH_MESSAGE_CALLBACK) {
 		NymphType cbn(&callbackName);
@@ -317,20 +610,53 @@ void NymphMessage::serialize() {
 	NYMPH_LOG_DEBUG("Message with length: " + Poco::NumberFormatter::format(message_length));
 	
 	buffer_length = message_length + 8; // Add the size of the signature & version fields.
-	data_buffer = new uint8_t[buffer_length];
+	
+	// Values referenced by the segment list do not need space in the buffer.
+	uint64_t referenced = 0;
+	if (segments) {
+		uint32_t threshold = segments->threshold;
+		if (flags & NYMPH_MESSAGE_REPLY) { referenced = response->referencedBytes(threshold); }
+		else if (flags & NYMPH_MESSAGE_CHUNK) {
+			if (response) { referenced = response->referencedBytes(threshold); }
+		}
+		else if (flags & NYMPH_MESSAGE_EXCEPTION) {
+			NymphType exstr(&exception.value);
+			referenced = exstr.referencedBytes(threshold);
+		}
+		else if (flags & NYMPH_MESSAGE_BATCH) {
+			// The contained messages are referenced, not copied.
+			referenced = batched;
+		}
+		else {
+			if (flags & NYMPH_MESSAGE_CALLBACK) {
+				NymphType cbn(&callbackName);
+				referenced = cbn.referencedBytes(threshold);
+			}
+			
+			for (unsigned int i = 0; i < values.size(); ++i) {
+				referenced += values[i]->referencedBytes(threshold);
+			}
+		}
+	}
+	
+	data_buffer = new uint8_t[buffer_length - referenced];
 	uint8_t* buf = data_buffer; // pointer to beginning.
+	if (segments) { segments->start = data_buffer; }
 	
 	uint8_t version = 0x00;
 	
-	// If the first message in a series, add a new messageId.
-	if (!(flags & NYMPH_MESSAGE_REPLY)) { messageId = NymphUtilities::getMessageId(); }
+	// If the first message in a series, add a new messageId, unless one was set.
+	if (!(flags & NYMPH_MESSAGE_REPLY) && messageId == 0) { messageId = NymphUtilities::getMessageId(); }
 	
 	// Write header into buffer.
 	// FIXME: On a big-endian system all integers will be in the wrong byte order.
 	// TODO: add endianness-check. Currently assume LE.
+	// A message body over 4 GB is sent as continuation frames, see splitFrames(),
+	// which replaces this header.
+	uint32_t frame_length = (uint32_t) message_length;
 	memcpy(buf, &signature, 4);
 	buf += 4;
-	memcpy(buf, &message_length, 4);
+	memcpy(buf, &frame_length, 4);
 	buf += 4;
 	*buf = version;
 	buf++;
@@ -341,12 +667,54 @@ void NymphMessage::serialize() {
 	memcpy(buf, &messageId, 8);
 	buf += 8;
 	
+	if (flags & NYMPH_MESSAGE_DEADLINE) {
+		int64_t left = chrono::duration_cast<chrono::milliseconds>(deadline - 
+													chrono::steady_clock::now()).count();
+		uint32_t remaining = (uint32_t) max<int64_t>(0, min<int64_t>(left, UINT32_MAX));
+		memcpy(buf, &remaining, 4);
+		buf += 4;
+	}
+	
 	
 	// Message types.
-	if (flags & NYMPH_MESSAGE_REPLY) {
+	if (flags & NYMPH_MESSAGE_BATCH) {
+		uint32_t count = batch.size();
+		memcpy(buf, &count, 4);
+		buf += 4;
+		
+		for (unsigned int i = 0; i < count; ++i) {
+			if (segments) {
+				// Add the local data so far, followed by the message's segments.
+				if (buf > segments->start) {
+					NymphBufferSegment seg;
+					seg.data = segments->start;
+					seg.length = buf - segments->start;
+					segments->list.push_back(seg);
+				}
+				
+				vector<NymphBufferSegment> &segs = batch[i]->segments();
+				segments->list.insert(segments->list.end(), segs.begin(), segs.end());
+				segments->start = buf;
+			}
+			else {
+				memcpy(buf, batch[i]->buffer(), batch[i]->buffer_size());
+				buf += batch[i]->buffer_size();
+			}
+		}
+	}
+	else if (flags & NYMPH_MESSAGE_REPLY) {
+		memcpy(buf, &responseId, 8);
+		buf += 8;
+		response->serialize(buf, segments);
+	}
+	else if (flags & NYMPH_MESSAGE_CHUNK) {
+		memcpy(buf, &responseId, 8);
+		buf += 8;
+		if (response) { response->serialize(buf, segments); }
+	}
+	else if (flags & NYMPH_MESSAGE_CANCEL) {
 		memcpy(buf, &responseId, 8);
 		buf += 8;
-		response->serialize(buf);
 	}
 	else if (flags & NYMPH_MESSAGE_EXCEPTION) {
 		memcpy(buf, &responseId, 8);
@@ -355,26 +723,44 @@ void NymphMessage::serialize() {
 		memcpy(buf, &exception.id, 4);
 		buf += 4;
 		
+		// The exception string is held by the message itself.
+		bool external = segments && segments->external;
 		NymphType exstr(&exception.value);
-		exstr.serialize(buf);
+		exstr.serialize(buf, segments);
+		if (segments) { segments->external = external; }
 	}
 	else if (flags & NYMPH_MESSAGE_CALLBACK) {
+		// The callback name is held by the message itself.
+		bool external = segments && segments->external;
 		NymphType cbn(&callbackName);
-		cbn.serialize(buf);
+		cbn.serialize(buf, segments);
+		if (segments) { segments->external = external; }
 		
 		unsigned int valueLen = values.size();
 		for (unsigned int i = 0; i < valueLen; ++i) {
-			values[i]->serialize(buf);
+			values[i]->serialize(buf, segments);
 		}
 	}
 	else {
 		unsigned int valueLen = values.size();
 		for (unsigned int i = 0; i < valueLen; ++i) {
-			values[i]->serialize(buf);
+			values[i]->serialize(buf, segments);
 		}
 	}
 	
 	*buf = nymphNone;
+	
+	if (segments) {
+		// Add the remaining local data.
+		buf++;
+		NymphBufferSegment seg;
+		seg.data = segments->start;
+		seg.length = buf - segments->start;
+		segments->list.push_back(seg);
+		bufferSegments.swap(segments->list);
+	}
+	
+	externalData = segments && segments->external;
 }
 
 
@@ -431,6 +817,59 @@ bool NymphMessage::setCallback(std::string name) {
 }
 
 
+// --- ADD MESSAGE ---
+// Adds a message to this batch message, which takes ownership of it. The 
+// messages are serialised along with the batch message.
+bool NymphMessage::addMessage(NymphMessage* msg) {
+	if (msg->isBatch()) { return false; }
+	
+	flags |= NYMPH_MESSAGE_BATCH;
+	batch.push_back(msg);
+	return true;
+}
+
+
+// --- SET DEADLINE ---
+// Sets the time by which the receiver has to process this message. The time left
+// until then is sent along with the message, and the receiver drops the message
+// once it has passed.
+void NymphMessage::setDeadline(chrono::steady_clock::time_point deadline) {
+	flags |= NYMPH_MESSAGE_DEADLINE;
+	this->deadline = deadline;
+}
+
+
+// --- IS EXPIRED ---
+// Returns true if the message has a deadline which has passed.
+bool NymphMessage::isExpired() {
+	return (flags & NYMPH_MESSAGE_DEADLINE) && chrono::steady_clock::now() >= deadline;
+}
+
+
+// --- SET CANCEL ---
+// Turns this message into a request to cancel the call with the message ID. The
+// receiver drops the call if it has not run yet, and otherwise signals its 
+// cancel token.
+bool NymphMessage::setCancel(uint64_t msgId) {
+	flags |= NYMPH_MESSAGE_CANCEL;
+	responseId = msgId;
+	return true;
+}
+
+
+// --- SET PART ---
+// Turns this message into a part of the upload for the call with the message 
+// ID. Takes ownership of the value. Without a value, the message ends the 
+// upload.
+bool NymphMessage::setPart(uint64_t callId, NymphType* value) {
+	flags |= NYMPH_MESSAGE_CHUNK;
+	responseId = callId;
+	response = value;
+	buffer_length = value ? value->bytes() : 0;
+	return true;
+}
+
+
 // --- ADD REFERENCE COUNT ---
 void NymphMessage::addReferenceCount() {
 	refCount++;
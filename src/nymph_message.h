@@ -16,20 +16,36 @@
 #define NYMPH_MESSAGE_H
 
 #include "nymph_types.h"
+#include "nymph_arena.h"
 
 //#include <Poco/Poco.h>
 
 #include <vector>
 #include <atomic>
+#include <chrono>
+#include <memory>
 
 
 enum {
 	NYMPH_MESSAGE_REPLY = 0x01,		// Message is a reply.
 	NYMPH_MESSAGE_EXCEPTION = 0x02,	// Message is an exception.
-	NYMPH_MESSAGE_CALLBACK = 0x04	// Message is a callback.
+	NYMPH_MESSAGE_CALLBACK = 0x04,	// Message is a callback.
+	NYMPH_MESSAGE_BATCH = 0x08,		// Message contains a batch of messages.
+	NYMPH_MESSAGE_DEADLINE = 0x10,	// Message carries the time left to process it.
+	NYMPH_MESSAGE_CANCEL = 0x20,		// Message cancels an earlier call.
+	NYMPH_MESSAGE_CHUNK = 0x40,		// Message is one part of a streamed reply or upload.
+	NYMPH_MESSAGE_UPLOAD = 0x80		// Call is followed by upload parts.
 };
 
 
+// Set once the call a message belongs to was cancelled by the remote. A method
+// can keep a copy to check while it runs.
+typedef std::shared_ptr<std::atomic<bool> > NymphCancelToken;
+
+
+class NymphUploadReader;
+
+
 struct NymphException {
 	uint32_t id;
 	std::string value;
@@ -51,22 +67,40 @@ class NymphMessage {
 	NymphType* response = 0;
 	std::string loggerName;
 	uint8_t* data_buffer;
-	uint32_t buffer_length;
+	uint64_t buffer_length;
 	bool responseOwned = true;
+	bool pooledBuffer = false;
 	std::atomic<uint32_t> refCount = { 0 };
 	std::atomic<bool> deleted = { false };
+	std::vector<NymphBufferSegment> bufferSegments;
+	NymphArena arena;	// Holds child values of the parsed values.
+	std::vector<NymphMessage*> batch;	// Messages contained in a batch message.
+	std::chrono::steady_clock::time_point deadline;	// Only valid with the deadline flag.
+	NymphCancelToken cancelToken;
+	std::shared_ptr<NymphUploadReader> uploadReader;
+	std::vector<uint8_t> frameHeaders;	// Headers of the continuation frames.
+	bool externalData = false;	// Segments reference memory of the caller.
+	
+	static std::atomic<uint32_t> frameLimit;
+	
+	void serializeMessage(NymphSegments* segments);
+	void splitFrames();
 	
 public:
 	NymphMessage();
 	NymphMessage(uint32_t methodId);
-	NymphMessage(uint8_t* binmsg, uint64_t bytes);
+	NymphMessage(uint8_t* binmsg, uint64_t bytes, bool pooled = false);
 	~NymphMessage();
 	bool addValue(NymphType* value);
 	bool addValues(std::vector<NymphType*> &values);
 	
 	void serialize();
+	void serializeVectored(uint32_t threshold = 4096);
 	uint8_t* buffer() { return data_buffer; }
-	uint32_t buffer_size() { return buffer_length; }
+	uint64_t buffer_size() { return buffer_length; }
+	std::vector<NymphBufferSegment>& segments() { return bufferSegments; }
+	bool hasExternalData() { return externalData; }
+	void ownData();
 	
 	int getState() { return state; }
 	bool isCorrupt() { return corrupt; }
@@ -75,6 +109,7 @@ public:
 	bool isCallback() { return flags & NYMPH_MESSAGE_CALLBACK; }
 	uint64_t getResponseId() { return responseId; }
 	uint64_t getMessageId() { return messageId; }
+	void setMessageId(uint64_t msgId) { messageId = msgId; }
 	void setResultValue(NymphType* value);
 	NymphType* getResponse(bool take = false) { responseOwned = take; return response; }
 	std::vector<NymphType*>& parameters() { return values; }
@@ -86,10 +121,32 @@ public:
 	bool isException() { return flags & NYMPH_MESSAGE_EXCEPTION; }
 	bool setException(int exceptionId, std::string value);
 	bool setCallback(std::string name);
+	bool isBatch() { return flags & NYMPH_MESSAGE_BATCH; }
+	bool addMessage(NymphMessage* msg);
+	std::vector<NymphMessage*>& messages() { return batch; }
+	void setDeadline(std::chrono::steady_clock::time_point deadline);
+	bool hasDeadline() { return flags & NYMPH_MESSAGE_DEADLINE; }
+	std::chrono::steady_clock::time_point getDeadline() { return deadline; }
+	bool isExpired();
+	bool setCancel(uint64_t msgId);
+	bool isCancel() { return flags & NYMPH_MESSAGE_CANCEL; }
+	bool setChunk() { flags |= NYMPH_MESSAGE_CHUNK; return true; }
+	bool isChunk() { return flags & NYMPH_MESSAGE_CHUNK; }
+	bool setPart(uint64_t callId, NymphType* value);
+	bool setUpload() { flags |= NYMPH_MESSAGE_UPLOAD; return true; }
+	bool isUpload() { return flags & NYMPH_MESSAGE_UPLOAD; }
+	void setUploadReader(std::shared_ptr<NymphUploadReader> reader) { uploadReader = reader; }
+	std::shared_ptr<NymphUploadReader> getUploadReader() { return uploadReader; }
+	void setCancelToken(NymphCancelToken token) { cancelToken = token; }
+	NymphCancelToken getCancelToken() { return cancelToken; }
+	bool isCancelled() { return cancelToken && cancelToken->load(); }
 	
+	bool isReferenced() { return refCount > 0; }
 	void addReferenceCount();
 	void decrementReferenceCount();
 	void discard();
+	
+	static void setFrameLimit(uint32_t bytes);
 };
 
 #endif
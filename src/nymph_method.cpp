@@ -125,10 +125,10 @@ NymphMessage* NymphMethod::callCallback(int handle, NymphMessage* msg) {
 }
 
 
-// --- CALL ---
-// Call this method instance. Validates the input values, composes message,
-// serialises message and sends it using the provided socket.
-bool NymphMethod::call(Net::StreamSocket* socket, NymphRequest* &request, vector<NymphType*> &values, string &result) {
+// --- CREATE MESSAGE ---
+// Validates the input values against the method signature and composes a new 
+// message with them. Returns 0 and sets 'result' if the values are not valid.
+NymphMessage* NymphMethod::createMessage(vector<NymphType*> &values, string &result) {
 	// For each item in the values vector, match its type with the registered
 	// signature type (NymphTypes enum).
 	// If the types match, serialise the values NymphType instance and insert it
@@ -141,12 +141,12 @@ bool NymphMethod::call(Net::StreamSocket* socket, NymphRequest* &request, vector
 		// Delete the values in the values vector since we own them.
 		//vector<NymphType>::iterator it;
 		//for (it = values.begin(); it != values.end(); ++it) { delete (*it); }
-		return false;
+		return 0;
 	}
 	
-	NymphMessage msg(id);
+	NymphMessage* msg = new NymphMessage(id);
 	if (isCallback) {
-		msg.setCallback(name);
+		msg->setCallback(name);
 	}
 	
 	for (int i = 0; i < vl; ++i) {
@@ -155,45 +155,53 @@ bool NymphMethod::call(Net::StreamSocket* socket, NymphRequest* &request, vector
 			ss << "Type mismatch on parameter " << i << " for method " << name << ". "
 				<< "Expected: " << parameters[i] << ", got: " << values[i]->valuetype() << ".";
 			result = ss.str();
-			return false;
+			delete msg;
+			return 0;
 		}
 		
-		msg.addValue(values[i]);
+		msg->addValue(values[i]);
 	}
 	
-	// Obtain binary message.
-	msg.serialize();
-	
-	// Finish the NymphRequest instance and add it to the listener.
-	request->messageId = msg.getMessageId();
-	NymphListener::addMessage(request);
-	
-	// Send the message.
-#ifdef NPOCO
-	int ret = socket->sendBytes(((const void*) msg.buffer()), msg.buffer_size());
-	if (ret != msg.buffer_size()) {
-		// Handle error.
-		result = "Failed to send message: ";	
+	return msg;
+}
+
+
+// --- CALL ---
+// Call this method instance. Validates the input values, composes message,
+// serialises message and queues it for sending. No lock is held while 
+// serialising, so multiple threads can call methods on one connection at once.
+// The message ID of the call is returned in 'messageId'.
+bool NymphMethod::call(NymphSendQueue* queue, NymphRequestTable* requests, NymphRequest* &request, vector<NymphType*> &values, uint64_t &messageId, string &result) {
+	NymphMessage* msg = createMessage(values, result);
+	if (!msg) { return false; }
+	
+	// Add the request to the connection's table, which assigns its message ID.
+	// Only asynchronous requests expire, synchronous ones time out themselves.
+	int64_t deadline = 0;
+	if (request->callback) { deadline = request->deadline.time_since_epoch().count(); }
+	if (!requests->add(request, messageId, deadline)) {
+		result = "Too many requests awaiting a reply.";
+		delete msg;
 		return false;
 	}
 	
-	NYMPH_LOG_DEBUG("Sent " + NumberFormatter::format(ret) + " bytes.");
-#else
-	try {
-		int ret = socket->sendBytes(((const void*) msg.buffer()), msg.buffer_size());
-		if (ret != msg.buffer_size()) {
-			// Handle error.
-			result = "Failed to send message: ";	
-			return false;
-		}
-		
-		NYMPH_LOG_DEBUG("Sent " + NumberFormatter::format(ret) + " bytes.");
-	}
-	catch (Poco::Exception &e) {
-		result = "Failed to send message: " + e.message();
-		return false;
+	msg->setMessageId(messageId);
+	if (request->upload) { msg->setUpload(); }
+	
+	// Let the server drop the call once the caller stopped waiting for it. A 
+	// streamed call or upload only times out between parts, which the server 
+	// can not know.
+	if (request->deadline != chrono::steady_clock::time_point() && !request->stream && 
+			!request->upload) {
+		msg->setDeadline(request->deadline);
 	}
-#endif
+	
+	// Obtain binary message. Large values are sent from where they are stored.
+	msg->serializeVectored();
+	
+	// Queue the message. Once queued, the request belongs to the listener, or 
+	// is failed by the queue if the message can not be sent.
+	queue->send(msg, messageId);
 	
 	return true;
 }
@@ -201,40 +209,14 @@ bool NymphMethod::call(Net::StreamSocket* socket, NymphRequest* &request, vector
 
 // Call the method instance, using an NymphSession instance.
 bool NymphMethod::call(NymphSession* session, vector<NymphType*> &values, string &result) {
-	// For each item in the values vector, match its type with the registered
-	// signature type (NymphTypes enum).
-	// If the types match, serialise the values NymphType instance and insert it
-	// into a new NymphMessage.
-	int vl = values.size();
-	int pl = parameters.size();
-	if (vl != pl) {
-		result = "Provided value array length does not match method signature.";
-		
-		return false;
-	}
-	
-	NymphMessage msg(id);
-	if (isCallback) {
-		msg.setCallback(name);
-	}
-	
-	for (int i = 0; i < vl; ++i) {
-		if (values[i]->valuetype() != parameters[i] && parameters[i] != NYMPH_ANY) {
-			stringstream ss;
-			ss << "Type mismatch on parameter " << i << " for method " << name << ". "
-				<< "Expected: " << parameters[i] << ", got: " << values[i]->valuetype() << ".";
-			result = ss.str();
-			return false;
-		}
-		
-		msg.addValue(values[i]);
-	}
+	NymphMessage* msg = createMessage(values, result);
+	if (!msg) { return false; }
 	
 	// Obtain binary message.
-	msg.serialize();
+	msg->serializeVectored();
 	
-	// Send the message.
-	if (!session->send(msg.buffer(), msg.buffer_size(), result)) { return false; }
+	// Send the message. The session takes ownership of it.
+	session->send(msg);
 	
 	return true;
 }
@@ -21,6 +21,7 @@
 #include "nymph_listener.h"
 #include "nymph_message.h"
 #include "nymph_session.h"
+#include "nymph_send_queue.h"
 
 #ifdef NPOCO
 #include <npoco/Poco.h>
@@ -59,7 +60,8 @@ public:
 	NymphMethod(std::string name, std::vector<NymphTypes> parameters, NymphTypes retType, NymphMethodCallback cb);
 	void setCallback(NymphMethodCallback callback);
 	NymphMessage* callCallback(int handle, NymphMessage* msg);
-	bool call(Poco::Net::StreamSocket* socket, NymphRequest* &request, std::vector<NymphType*> &values, std::string &result);
+	NymphMessage* createMessage(std::vector<NymphType*> &values, std::string &result);
+	bool call(NymphSendQueue* queue, NymphRequestTable* requests, NymphRequest* &request, std::vector<NymphType*> &values, uint64_t &messageId, std::string &result);
 	bool call(NymphSession* session, std::vector<NymphType*> &values, std::string &result);
 	void setId(uint32_t id);
 	uint32_t getId() { return id; }
@@ -0,0 +1,335 @@
+/*
+	nymph_reactor.cpp - implementation of the NymphRPC Reactor class.
+	
+	Revision 0
+	
+	Notes:
+			- Sockets are registered in one-shot mode. After a handler has read 
+				the available data, the socket is re-armed. This way multiple I/O 
+				threads can wait on the same epoll instance without ever 
+				processing the same socket concurrently.
+			
+	(c) Nyanko.ws
+*/
+
+
+#include "nymph_reactor.h"
+#include "nymph_logger.h"
+
+#ifdef NPOCO
+#include <npoco/NumberFormatter.h>
+#else
+#include <Poco/NumberFormatter.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+using namespace Poco;
+using namespace std;
+
+
+// Event data marking the wake-up descriptor. Sockets use their descriptor.
+static const uint64_t wakeMarker = 0xFFFFFFFFFFFFFFFFull;
+
+
+// --- CONSTRUCTOR ---
+NymphReactor::NymphReactor() {
+	loggerName = "NymphReactor";
+	epollFd = -1;
+	wakeFd = -1;
+	running = false;
+	timerInterval = 0;
+}
+
+
+// --- DESTRUCTOR ---
+NymphReactor::~NymphReactor() {
+	stop();
+}
+
+
+// --- SET TIMER ---
+// Set a function which is called every 'interval' milliseconds from one of the
+// I/O threads. Must be set before starting the reactor.
+void NymphReactor::setTimer(std::function<void()> fnc, int interval) {
+	timer = fnc;
+	timerInterval = interval;
+}
+
+
+// --- START ---
+// Create the epoll instance and start the I/O threads.
+bool NymphReactor::start(int threadCount) {
+#ifdef __linux__
+	if (running) { return true; }
+	
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (epollFd < 0) {
+		NYMPH_LOG_ERROR("Failed to create epoll instance: " + NumberFormatter::format(errno));
+		return false;
+	}
+	
+	// The wake-up descriptor is used to interrupt the I/O threads when stopping.
+	// It is level-triggered and never read, so that it wakes up all threads.
+	wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.u64 = wakeMarker;
+	if (wakeFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) != 0) {
+		NYMPH_LOG_ERROR("Failed to create reactor wake-up descriptor.");
+		if (wakeFd >= 0) { close(wakeFd); }
+		close(epollFd);
+		epollFd = -1;
+		wakeFd = -1;
+		return false;
+	}
+	
+	if (threadCount < 1) { threadCount = 1; }
+	nextTimer = chrono::steady_clock::now() + chrono::milliseconds(timerInterval);
+	running = true;
+	for (int i = 0; i < threadCount; ++i) {
+		threads.push_back(new thread(&NymphReactor::run, this));
+	}
+	
+	NYMPH_LOG_INFORMATION("Started reactor with " + NumberFormatter::format(threadCount) + " I/O threads.");
+	
+	return true;
+#else
+	NYMPH_LOG_ERROR("The reactor is not supported on this platform.");
+	return false;
+#endif
+}
+
+
+// --- STOP ---
+// Stop the I/O threads, then close all remaining sockets.
+void NymphReactor::stop() {
+#ifdef __linux__
+	if (!running) { return; }
+	
+	running = false;
+	uint64_t one = 1;
+	if (write(wakeFd, &one, sizeof(one)) < 0) {
+		NYMPH_LOG_ERROR("Failed to wake up reactor threads.");
+	}
+	
+	for (uint32_t i = 0; i < threads.size(); ++i) {
+		threads[i]->join();
+		delete threads[i];
+	}
+	
+	threads.clear();
+	
+	// Notify the remaining handlers that their socket is closed.
+	handlersMutex.lock();
+	map<int, Entry> remaining;
+	remaining.swap(handlers);
+	handlersMutex.unlock();
+	
+	map<int, Entry>::iterator it;
+	for (it = remaining.begin(); it != remaining.end(); ++it) {
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, it->first, 0);
+		it->second.handler->onClosed();
+	}
+	
+	close(wakeFd);
+	close(epollFd);
+	wakeFd = -1;
+	epollFd = -1;
+	
+	NYMPH_LOG_INFORMATION("Stopped reactor.");
+#endif
+}
+
+
+// --- ADD ---
+// Start monitoring the socket. The handler is called from an I/O thread when
+// data is available.
+bool NymphReactor::add(int fd, NymphReactorHandler* handler) {
+#ifdef __linux__
+	if (!running) { return false; }
+	
+	Entry entry;
+	entry.handler = handler;
+	entry.busy = false;
+	entry.closing = false;
+	entry.paused = 0;
+	handlersMutex.lock();
+	handlers[fd] = entry;
+	handlersMutex.unlock();
+	
+	struct epoll_event ev;
+	ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+	ev.data.u64 = (uint64_t) fd;
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+		NYMPH_LOG_ERROR("Failed to add socket to reactor: " + NumberFormatter::format(errno));
+		handlersMutex.lock();
+		handlers.erase(fd);
+		handlersMutex.unlock();
+		return false;
+	}
+	
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+// --- REMOVE ---
+// Stop monitoring the socket. The handler's onClosed() method is called once it
+// is no longer in use by an I/O thread, which may be after returning.
+bool NymphReactor::remove(int fd) {
+#ifdef __linux__
+	handlersMutex.lock();
+	map<int, Entry>::iterator it = handlers.find(fd);
+	if (it == handlers.end()) {
+		handlersMutex.unlock();
+		return false;
+	}
+	
+	if (it->second.busy) {
+		// Let the I/O thread close it once the handler returns.
+		it->second.closing = true;
+		handlersMutex.unlock();
+		return true;
+	}
+	
+	NymphReactorHandler* handler = it->second.handler;
+	handlers.erase(it);
+	if (epollFd >= 0) { epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, 0); }
+	handlersMutex.unlock();
+	
+	handler->onClosed();
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+// --- PAUSE ---
+// Stops reading from the socket once the handler returns from onReadable(), 
+// until a matching call to resume(). Must be called from onReadable().
+void NymphReactor::pause(int fd) {
+	handlersMutex.lock();
+	map<int, Entry>::iterator it = handlers.find(fd);
+	if (it != handlers.end()) { it->second.paused++; }
+	handlersMutex.unlock();
+}
+
+
+// --- RESUME ---
+// Undoes a call to pause(), which may also follow it. The socket is re-armed 
+// once all pauses have been resumed. Does nothing if the socket was removed 
+// meanwhile, or its descriptor was reused for another handler.
+void NymphReactor::resume(int fd, NymphReactorHandler* handler) {
+#ifdef __linux__
+	handlersMutex.lock();
+	map<int, Entry>::iterator it = handlers.find(fd);
+	if (it == handlers.end() || it->second.handler != handler) {
+		handlersMutex.unlock();
+		return;
+	}
+	
+	// While busy, the I/O thread re-arms the socket once the handler returns.
+	if (--it->second.paused == 0 && !it->second.busy && !it->second.closing) {
+		struct epoll_event ev;
+		ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+		ev.data.u64 = (uint64_t) fd;
+		if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) != 0) {
+			NYMPH_LOG_ERROR("Failed to resume socket: " + NumberFormatter::format(errno));
+		}
+	}
+	
+	handlersMutex.unlock();
+#endif
+}
+
+
+// --- RUN ---
+// I/O thread main loop.
+void NymphReactor::run() {
+#ifdef __linux__
+	const int maxEvents = 64;
+	struct epoll_event events[maxEvents];
+	int waitTimeout = (timer && timerInterval > 0) ? timerInterval : 1000;
+	while (running) {
+		int n = epoll_wait(epollFd, events, maxEvents, waitTimeout);
+		if (n < 0) {
+			if (errno == EINTR) { continue; }
+			NYMPH_LOG_ERROR("epoll_wait failed: " + NumberFormatter::format(errno));
+			break;
+		}
+		
+		for (int i = 0; i < n && running; ++i) {
+			if (events[i].data.u64 == wakeMarker) { continue; }
+			
+			int fd = (int) events[i].data.u64;
+			handlersMutex.lock();
+			map<int, Entry>::iterator it = handlers.find(fd);
+			if (it == handlers.end()) {
+				handlersMutex.unlock();
+				continue;
+			}
+			
+			it->second.busy = true;
+			NymphReactorHandler* handler = it->second.handler;
+			handlersMutex.unlock();
+			
+			// Read whatever is available, even if the remote hung up, so that 
+			// the last messages are still processed.
+			bool open = handler->onReadable();
+			if (events[i].events & (EPOLLHUP | EPOLLERR)) { open = false; }
+			
+			handlersMutex.lock();
+			it = handlers.find(fd);
+			if (open && !it->second.closing) {
+				// Re-arm the socket for the next batch of data, unless paused.
+				it->second.busy = false;
+				if (it->second.paused > 0) {
+					handlersMutex.unlock();
+					continue;
+				}
+				
+				struct epoll_event ev;
+				ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+				ev.data.u64 = (uint64_t) fd;
+				if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) == 0) {
+					handlersMutex.unlock();
+					continue;
+				}
+			}
+			
+			handlers.erase(it);
+			epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, 0);
+			handlersMutex.unlock();
+			
+			handler->onClosed();
+		}
+		
+		runTimer();
+	}
+#endif
+}
+
+
+// --- RUN TIMER ---
+// Calls the timer function if it is due. Only one I/O thread runs it at a time.
+void NymphReactor::runTimer() {
+	if (!timer || timerInterval <= 0) { return; }
+	if (!timerMutex.try_lock()) { return; }
+	
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	if (now >= nextTimer) {
+		nextTimer = now + chrono::milliseconds(timerInterval);
+		timer();
+	}
+	
+	timerMutex.unlock();
+}
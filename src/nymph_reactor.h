@@ -0,0 +1,80 @@
+/*
+	nymph_reactor.h - header file for the NymphRPC Reactor class.
+	
+	Revision 0
+	
+	Notes:
+			- Multiplexes many sockets over a small number of I/O threads using
+				epoll. Only available on Linux.
+			- Each socket is handled by at most one I/O thread at a time.
+			- A handler can pause reading from its socket, e.g. while the data
+				it already received is being processed.
+			
+	(c) Nyanko.ws
+*/
+
+
+#pragma once
+#ifndef NYMPH_REACTOR_H
+#define NYMPH_REACTOR_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+
+// Implemented by the objects which own a socket handled by the reactor.
+class NymphReactorHandler {
+public:
+	virtual ~NymphReactorHandler() { }
+	
+	// Called when the socket has data available. Return false to close it.
+	virtual bool onReadable() = 0;
+	
+	// Called once the socket has been removed from the reactor. 
+	virtual void onClosed() = 0;
+};
+
+
+class NymphReactor {
+	struct Entry {
+		NymphReactorHandler* handler;
+		bool busy;		// An I/O thread is calling the handler.
+		bool closing;	// Removed while busy. Closed by the I/O thread.
+		int paused;		// Pending pauses. Negative if resumed before paused.
+	};
+	
+	int epollFd;
+	int wakeFd;
+	std::atomic<bool> running;
+	std::vector<std::thread*> threads;
+	std::map<int, Entry> handlers;
+	std::mutex handlersMutex;
+	std::function<void()> timer;
+	int timerInterval;
+	std::chrono::steady_clock::time_point nextTimer;
+	std::mutex timerMutex;
+	std::string loggerName;
+	
+	void run();
+	void runTimer();
+	
+public:
+	NymphReactor();
+	~NymphReactor();
+	
+	void setTimer(std::function<void()> fnc, int interval);
+	bool start(int threadCount);
+	void stop();
+	bool add(int fd, NymphReactorHandler* handler);
+	bool remove(int fd);
+	void pause(int fd);
+	void resume(int fd, NymphReactorHandler* handler);
+};
+
+#endif
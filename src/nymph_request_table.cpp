@@ -0,0 +1,135 @@
+/*
+	nymph_request_table.cpp - implementation file for the NymphRPC Request Table
+									class.
+	
+	Revision 0
+	
+	Notes:
+			- A slot is claimed by setting its ID to 'claimed', which allows the
+				request pointer to be written or read by the claiming thread 
+				before the slot is published or released again.
+			
+	(c) Nyanko.ws
+*/
+
+
+#include "nymph_request_table.h"
+#include "nymph_socket_listener.h"
+
+#include <thread>
+
+using namespace std;
+
+
+static const uint64_t claimed = UINT64_MAX;
+
+
+// --- CONSTRUCTOR ---
+// Creates a table with 2^bits slots.
+NymphRequestTable::NymphRequestTable(uint32_t bits) {
+	this->bits = bits;
+	mask = (1 << bits) - 1;
+	slots = new Slot[mask + 1];
+}
+
+
+// --- DECONSTRUCTOR ---
+NymphRequestTable::~NymphRequestTable() {
+	delete[] slots;
+}
+
+
+// --- ADD ---
+// Adds the request to a free slot and assigns it a message ID which refers to
+// this slot. Returns false if the table is full. A deadline of 0 means the 
+// request is not expired by expire(). As another thread may take the request
+// as soon as it has been added, the message ID is also returned separately.
+bool NymphRequestTable::add(NymphRequest* request, uint64_t &messageId, int64_t deadline) {
+	uint32_t start = hint.fetch_add(1, memory_order_relaxed);
+	for (uint32_t i = 0; i <= mask; ++i) {
+		uint32_t index = (start + i) & mask;
+		Slot& slot = slots[index];
+		uint64_t expected = 0;
+		if (slot.id.load(memory_order_relaxed) != 0) { continue; }
+		if (!slot.id.compare_exchange_strong(expected, claimed, memory_order_acquire)) {
+			continue;
+		}
+		
+		uint64_t id = (sequence.fetch_add(1, memory_order_relaxed) << bits) | index;
+		request->messageId = id;
+		messageId = id;
+		slot.request = request;
+		slot.deadline.store(deadline, memory_order_relaxed);
+		slot.id.store(id, memory_order_release);
+		return true;
+	}
+	
+	return false;
+}
+
+
+// --- TAKE ---
+// Removes the request with the message ID from the table and returns it, or 0
+// if it is not (or no longer) in the table. Waits while the slot is claimed,
+// e.g. by a borrowed request.
+NymphRequest* NymphRequestTable::take(uint64_t messageId) {
+	if (messageId == 0 || messageId == claimed) { return 0; }
+	
+	Slot& slot = slots[messageId & mask];
+	uint64_t expected = messageId;
+	while (!slot.id.compare_exchange_weak(expected, claimed, memory_order_acquire)) {
+		if (expected != messageId && expected != claimed) { return 0; }
+		expected = messageId;
+		this_thread::yield();
+	}
+	
+	NymphRequest* request = slot.request;
+	slot.request = 0;
+	slot.id.store(0, memory_order_release);
+	return request;
+}
+
+
+// --- BORROW ---
+// Returns the request with the message ID while keeping its slot, or 0 if it is
+// not (or no longer) in the table. Until the request is restored, nobody else 
+// can take or expire it, so it must be restored right away. Used to update the
+// deadline of a streamed call.
+NymphRequest* NymphRequestTable::borrow(uint64_t messageId) {
+	if (messageId == 0 || messageId == claimed) { return 0; }
+	
+	Slot& slot = slots[messageId & mask];
+	uint64_t expected = messageId;
+	if (!slot.id.compare_exchange_strong(expected, claimed, memory_order_acquire)) {
+		return 0;
+	}
+	
+	return slot.request;
+}
+
+
+// --- RESTORE ---
+// Returns a borrowed request to the table, with a new deadline.
+void NymphRequestTable::restore(uint64_t messageId, int64_t deadline) {
+	Slot& slot = slots[messageId & mask];
+	slot.deadline.store(deadline, memory_order_relaxed);
+	slot.id.store(messageId, memory_order_release);
+}
+
+
+// --- EXPIRE ---
+// Takes the requests with a deadline before 'now' out of the table. If 'all' is
+// set, all requests with a deadline are taken.
+void NymphRequestTable::expire(int64_t now, bool all, vector<NymphRequest*> &expired) {
+	for (uint32_t i = 0; i <= mask; ++i) {
+		uint64_t id = slots[i].id.load(memory_order_acquire);
+		if (id == 0 || id == claimed) { continue; }
+		
+		// If the slot was reused meanwhile, taking the old ID fails.
+		int64_t deadline = slots[i].deadline.load(memory_order_relaxed);
+		if (deadline == 0 || (!all && now < deadline)) { continue; }
+		
+		NymphRequest* request = take(id);
+		if (request) { expired.push_back(request); }
+	}
+}
@@ -0,0 +1,58 @@
+/*
+	nymph_request_table.h - header file for the NymphRPC Request Table class.
+	
+	Revision 0
+	
+	Notes:
+			- Open-addressed table of the requests waiting for a reply on a 
+				connection. The slot index is encoded in the low bits of the 
+				message ID, so matching a reply is a single lookup.
+			- Adding, taking & expiring requests uses atomic operations only.
+				Whoever takes a request out of the table owns it.
+			- A borrowed request stays in its slot. Taking it waits until it
+				has been restored.
+	
+	(c) Nyanko.ws
+*/
+
+
+#pragma once
+#ifndef NYMPH_REQUEST_TABLE_H
+#define NYMPH_REQUEST_TABLE_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+
+struct NymphRequest;
+
+
+class NymphRequestTable {
+	struct Slot {
+		std::atomic<uint64_t> id = { 0 };		// Message ID, 0 if free.
+		std::atomic<int64_t> deadline = { 0 };	// Expiry time, 0 if none.
+		NymphRequest* request = 0;
+	};
+	
+	Slot* slots;
+	uint32_t bits;
+	uint32_t mask;
+	std::atomic<uint32_t> hint = { 0 };
+	std::atomic<uint64_t> sequence = { 1 };
+	
+	NymphRequestTable(const NymphRequestTable&);
+	NymphRequestTable& operator=(const NymphRequestTable&);
+	
+public:
+	NymphRequestTable(uint32_t bits = 12);
+	~NymphRequestTable();
+	
+	bool add(NymphRequest* request, uint64_t &messageId, int64_t deadline = 0);
+	NymphRequest* take(uint64_t messageId);
+	NymphRequest* borrow(uint64_t messageId);
+	void restore(uint64_t messageId, int64_t deadline);
+	void expire(int64_t now, bool all, std::vector<NymphRequest*> &expired);
+};
+
+#endif
@@ -0,0 +1,456 @@
+/*
+	nymph_send_queue.cpp - implementation file for the NymphRPC Send Queue class.
+	
+	Revision 0
+	
+	Notes:
+			- If sending a message fails, its request is failed right away, 
+				instead of waiting for it to time out.
+			- Coalescing is disabled by default, as the flush delay adds latency
+				when only few messages are sent.
+			
+	(c) Nyanko.ws
+*/
+
+
+#include "nymph_send_queue.h"
+#include "nymph_socket_writer.h"
+#include "nymph_socket_listener.h"
+#include "nymph_logger.h"
+#include "response_request.h"
+#include "dispatcher.h"
+
+#ifdef NPOCO
+#include <npoco/NumberFormatter.h>
+#else
+#include <Poco/NumberFormatter.h>
+#endif
+
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+
+
+// Static initialisations.
+atomic<uint32_t> NymphSendQueue::maxBatchBytes = { 0 };
+atomic<uint32_t> NymphSendQueue::flushDelay = { 0 };
+atomic<uint64_t> NymphSendQueue::writeCount = { 0 };
+atomic<uint64_t> NymphSendQueue::frameCount = { 0 };
+atomic<uint64_t> NymphSendQueue::byteCount = { 0 };
+atomic<uint64_t> NymphSendQueue::batchCounts[8];
+
+// Number of times a waiting thread checks again before it parks.
+static const uint32_t spinLimit = 64;
+
+
+// --- CONSTRUCTOR ---
+// The request table is used to fail requests for messages which could not be
+// sent. It is not needed if no replies are expected.
+NymphSendQueue::NymphSendQueue(Poco::Net::StreamSocket* socket, NymphRequestTable* requests) {
+	this->socket = socket;
+	this->requests = requests;
+}
+
+
+// --- DECONSTRUCTOR ---
+NymphSendQueue::~NymphSendQueue() {
+	Node* node = head.exchange(0);
+	while (node) {
+		Node* next = node->next;
+		release(node);
+		node = next;
+	}
+}
+
+
+// --- SET COALESCING ---
+// Enables coalescing of messages into writes of up to 'maxBytes' bytes, waiting
+// up to 'delay' microseconds for further messages. A 'maxBytes' of 0 disables 
+// coalescing, writing each message separately. Applies to all connections.
+void NymphSendQueue::setCoalescing(uint32_t maxBytes, uint32_t delay) {
+	maxBatchBytes = maxBytes;
+	flushDelay = delay;
+}
+
+
+// --- STATS ---
+NymphSendStats NymphSendQueue::stats() {
+	NymphSendStats s;
+	s.writes = writeCount;
+	s.frames = frameCount;
+	s.bytes = byteCount;
+	for (int i = 0; i < 8; ++i) { s.framesPerWrite[i] = batchCounts[i]; }
+	
+	return s;
+}
+
+
+// --- SEND ---
+// Queues the serialised message and takes ownership of it. If no other thread
+// is writing, the calling thread writes out the queue, including messages
+// queued by other threads meanwhile. A message which references memory of the
+// caller is either written before returning, or copied when another thread is
+// writing, so the caller may release that memory once this returns.
+void NymphSendQueue::send(NymphMessage* msg, uint64_t messageId) {
+	Node* node = new Node;
+	node->msg = msg;
+	node->messageId = messageId;
+	if (msg->hasExternalData()) {
+		bool expected = false;
+		if (writing.compare_exchange_strong(expected, true)) {
+			enqueue(node);
+			drain();
+			releaseWriter();
+			return;
+		}
+		
+		msg->ownData();
+	}
+	
+	push(node);
+}
+
+
+// Queues a serialised message which is shared with other queues. No reply is
+// expected for it, as it is sent to multiple remotes. The message must own its
+// data, see NymphMessage::ownData().
+void NymphSendQueue::send(shared_ptr<NymphMessage> msg) {
+	Node* node = new Node;
+	node->msg = msg.get();
+	node->messageId = 0;
+	node->shared = msg;
+	push(node);
+}
+
+
+// --- ENQUEUE ---
+// Adds the node to the queue, without writing it. Wakes up a writer waiting for
+// more messages.
+void NymphSendQueue::enqueue(Node* node) {
+	node->next = head.load();
+	while (!head.compare_exchange_weak(node->next, node)) { }
+	notify();
+}
+
+
+// --- PUSH ---
+// Pushes the node onto the queue, then writes out the queue if no other thread
+// is doing so.
+void NymphSendQueue::push(Node* node) {
+	enqueue(node);
+	
+	// The writer checks for new messages after it stops writing, so a message
+	// pushed while it was still writing is never left behind.
+	while (head.load() != 0) {
+		bool expected = false;
+		if (!writing.compare_exchange_strong(expected, true)) { return; }
+		drain();
+		stopWriting();
+	}
+}
+
+
+// --- SEND NOW ---
+// Writes the serialised message after any queued messages, and takes ownership
+// of it. Waits for another writer to finish first, and returns once the message
+// has been written. A caller sending a long series of messages this way never
+// has more than one of them in memory.
+bool NymphSendQueue::sendNow(NymphMessage* msg, string &result) {
+	Node* node = new Node;
+	node->msg = msg;
+	node->messageId = 0;
+	vector<Node*> nodes(1, node);
+	
+	acquireWriter();
+	drain();
+	bool ret = writeBatch(nodes, 0, 1);
+	releaseWriter();
+	
+	if (!ret) { result = "Failed to send message."; }
+	return ret;
+}
+
+
+// --- WRITE ---
+// Writes the data directly, after any queued messages. Waits for another 
+// writer to finish first.
+bool NymphSendQueue::write(const uint8_t* data, uint32_t length, string &result) {
+	acquireWriter();
+	drain();
+	
+	bool ret = true;
+	if (closed.load()) {
+		result = "Connection was closed.";
+		ret = false;
+	}
+	else {
+#ifndef NPOCO
+		try {
+#endif
+			if (ring) {
+				if (!ring->write(data, length)) {
+					result = "Connection was closed.";
+					ret = false;
+				}
+			}
+			else if (socket->sendBytes((const void*) data, (int) length) != (int) length) {
+				result = "Failed to send message.";
+				ret = false;
+			}
+#ifndef NPOCO
+		}
+		catch (Poco::Exception &e) {
+			result = "Failed to send message: " + e.message();
+			ret = false;
+		}
+#endif
+	}
+	
+	releaseWriter();
+	
+	return ret;
+}
+
+
+// --- ACQUIRE WRITER ---
+// Waits until no other thread is writing, then becomes the writer. Spins for a
+// while, as most writes are short, before parking until the writer stops.
+void NymphSendQueue::acquireWriter() {
+	bool expected = false;
+	for (uint32_t i = 0; i < spinLimit; ++i) {
+		if (writing.compare_exchange_weak(expected, true)) { return; }
+		expected = false;
+		this_thread::yield();
+	}
+	
+	unique_lock<mutex> ulock(waitMutex);
+	waiters++;
+	waitCondition.wait(ulock, [this] {
+		bool expected = false;
+		return writing.compare_exchange_strong(expected, true);
+	});
+	
+	waiters--;
+}
+
+
+// --- RELEASE WRITER ---
+// Stops being the writer, after which messages queued meanwhile are written 
+// out, unless another thread took over.
+void NymphSendQueue::releaseWriter() {
+	stopWriting();
+	while (head.load() != 0) {
+		bool expected = false;
+		if (!writing.compare_exchange_strong(expected, true)) { break; }
+		drain();
+		stopWriting();
+	}
+}
+
+
+// --- STOP WRITING ---
+// Clears the writer flag, and wakes up the threads waiting for it.
+void NymphSendQueue::stopWriting() {
+	writing.store(false);
+	notify();
+}
+
+
+// --- NOTIFY ---
+// Wakes up the parked threads, if any. A thread increments the number of 
+// waiters before checking its condition with the mutex held, so either it sees
+// the change, or it is counted here and woken up once it waits.
+void NymphSendQueue::notify() {
+	if (waiters.load() == 0) { return; }
+	
+	waitMutex.lock();
+	waitMutex.unlock();
+	waitCondition.notify_all();
+}
+
+
+// --- CLOSE ---
+// Stops writing to the socket. Waits for a writer to finish, after which the
+// socket is no longer used. Requests for messages queued afterwards fail.
+void NymphSendQueue::close() {
+	closed.store(true);
+	notify();
+	for (uint32_t i = 0; i < spinLimit && writing.load(); ++i) { this_thread::yield(); }
+	if (!writing.load()) { return; }
+	
+	unique_lock<mutex> ulock(waitMutex);
+	waiters++;
+	waitCondition.wait(ulock, [this] { return !writing.load(); });
+	waiters--;
+}
+
+
+// --- TAKE ---
+// Appends all queued messages to 'nodes', in the order they were queued.
+void NymphSendQueue::take(vector<Node*> &nodes) {
+	Node* node = head.exchange(0);
+	size_t start = nodes.size();
+	while (node) {
+		nodes.push_back(node);
+		node = node->next;
+	}
+	
+	reverse(nodes.begin() + start, nodes.end());
+}
+
+
+// --- WAIT FOR MORE ---
+// Waits until a message is queued or the deadline (steady clock, in 
+// microseconds) has passed. Returns true if a message was queued. Spins for a
+// while before parking, as the flush delay is usually short.
+bool NymphSendQueue::waitForMore(int64_t deadline) {
+	for (uint32_t i = 0; i < spinLimit; ++i) {
+		if (head.load() != 0) { return true; }
+		this_thread::yield();
+	}
+	
+	chrono::steady_clock::time_point until = chrono::steady_clock::time_point(chrono::microseconds(deadline));
+	unique_lock<mutex> ulock(waitMutex);
+	waiters++;
+	waitCondition.wait_until(ulock, until, [this] { return head.load() != 0 || closed.load(); });
+	waiters--;
+	
+	return head.load() != 0;
+}
+
+
+// --- DRAIN ---
+// Takes all queued messages and writes them in the order they were queued.
+void NymphSendQueue::drain() {
+	vector<Node*> nodes;
+	take(nodes);
+	
+	uint32_t maxBytes = maxBatchBytes;
+	uint32_t delay = flushDelay;
+	if (maxBytes == 0) {
+		for (uint32_t i = 0; i < nodes.size(); ++i) { writeBatch(nodes, i, i + 1); }
+		return;
+	}
+	
+	// Fill each write up to the maximum size. A larger message is written on
+	// its own. If the queue runs out first, wait for more until the deadline.
+	uint32_t first = 0;
+	while (first < nodes.size()) {
+		uint32_t last = first;
+		uint64_t bytes = 0;
+		int64_t deadline = chrono::duration_cast<chrono::microseconds>(
+							chrono::steady_clock::now().time_since_epoch()).count() + delay;
+		while (last < nodes.size()) {
+			uint64_t size = nodes[last]->msg->buffer_size();
+			if (last > first && bytes + size > maxBytes) { break; }
+			bytes += size;
+			last++;
+			
+			if (last == nodes.size() && bytes < maxBytes && delay > 0 && !closed.load()) {
+				if (waitForMore(deadline)) { take(nodes); }
+			}
+		}
+		
+		writeBatch(nodes, first, last);
+		first = last;
+	}
+}
+
+
+// --- WRITE BATCH ---
+// Writes the messages from 'first' up to 'last' with a single write, then 
+// deletes them. Returns false if they could not be sent.
+bool NymphSendQueue::writeBatch(vector<Node*> &nodes, uint32_t first, uint32_t last) {
+	vector<NymphMessage*> msgs;
+	uint64_t bytes = 0;
+	for (uint32_t i = first; i < last; ++i) {
+		msgs.push_back(nodes[i]->msg);
+		bytes += nodes[i]->msg->buffer_size();
+	}
+	
+	string result;
+	bool ret = false;
+	if (closed.load()) {
+		for (uint32_t i = first; i < last; ++i) {
+			fail(nodes[i], "Connection was closed.");
+		}
+	}
+	else if (!(ring ? ring->write(msgs, result) : NymphSocketWriter::write(*socket, msgs, result))) {
+		NYMPH_LOG_ERROR("Failed to send message: " + result);
+		for (uint32_t i = first; i < last; ++i) {
+			fail(nodes[i], "Failed to send message: " + result);
+		}
+	}
+	else {
+		ret = true;
+		writeCount++;
+		frameCount += msgs.size();
+		byteCount += bytes;
+		
+		// Bucket by the number of messages: 1, 2, 3-4, 5-8, ..., over 64.
+		uint32_t bucket = 0;
+		for (size_t n = msgs.size() - 1; n > 0 && bucket < 7; n >>= 1) { bucket++; }
+		batchCounts[bucket]++;
+		
+		if (msgs.size() > 1) {
+			NYMPH_LOG_DEBUG("Coalesced " + Poco::NumberFormatter::format(msgs.size()) + 
+								" messages into one write.");
+		}
+	}
+	
+	for (uint32_t i = first; i < last; ++i) {
+		release(nodes[i]);
+	}
+	
+	return ret;
+}
+
+
+// --- RELEASE ---
+// Deletes the node, along with its message unless that is shared.
+void NymphSendQueue::release(Node* node) {
+	if (!node->shared) { delete node->msg; }
+	delete node;
+}
+
+
+// --- FAIL ---
+// Fails the requests for a message which could not be sent. For a batch 
+// message, these are the requests of the messages it contains.
+void NymphSendQueue::fail(Node* node, string error) {
+	if (!node->msg->isBatch()) {
+		fail(node->messageId, error);
+		return;
+	}
+	
+	vector<NymphMessage*> &msgs = node->msg->messages();
+	for (uint32_t i = 0; i < msgs.size(); ++i) {
+		fail(msgs[i]->getMessageId(), error);
+	}
+}
+
+
+// Fails the request for a message which could not be sent, if it is still
+// awaiting a reply.
+void NymphSendQueue::fail(uint64_t messageId, string error) {
+	if (!requests) { return; }
+	NymphRequest* request = requests->take(messageId);
+	if (!request) { return; }
+	
+	if (request->callback) {
+		ResponseRequest* rr = new ResponseRequest;
+		rr->setRequest(request, error);
+		Dispatcher::addRequest(rr);
+		return;
+	}
+	
+	// The calling thread waits on the condition, or finds the error set once 
+	// it is done sending, if it wrote the message itself.
+	request->mutex.lock();
+	request->error = error;
+	request->done = true;
+	request->condition.signal();
+	request->mutex.unlock();
+}
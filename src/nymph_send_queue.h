@@ -0,0 +1,119 @@
+/*
+	nymph_send_queue.h - header file for the NymphRPC Send Queue class.
+	
+	Revision 0
+	
+	Notes:
+			- Multiple-producer, single-consumer queue of messages to be sent on
+				a connection. Producers push without locking. The thread which
+				finds no other thread writing becomes the writer, and drains 
+				the queue until it is empty.
+			- Messages are owned by the queue once pushed. A shared message can 
+				be queued on multiple connections, and is deleted once the 
+				last queue is done with it.
+			- A queued message may outlive the call which queued it. Memory
+				referenced by a message (see serializeVectored()) but not 
+				owned by it is only used until send() returns: the message is
+				then either written, or was copied into its own buffer. A 
+				shared message must own all of its data before it is queued.
+			- With coalescing enabled, queued messages are sent together in a
+				single write of up to the configured number of bytes. The 
+				writer waits up to the flush delay for more messages to fill it.
+			- Threads waiting for the writer or for more messages spin briefly,
+				then park on a condition variable.
+			- If a shared memory ring is set, messages are written into it 
+				instead of the socket.
+			
+	(c) Nyanko.ws
+*/
+
+
+#pragma once
+#ifndef NYMPH_SEND_QUEUE_H
+#define NYMPH_SEND_QUEUE_H
+
+#include "nymph_message.h"
+#include "nymph_request_table.h"
+#include "nymph_shm_ring.h"
+
+#ifdef NPOCO
+#include <npoco/net/StreamSocket.h>
+#else
+#include <Poco/Net/StreamSocket.h>
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+struct NymphSendStats {
+	uint64_t writes;			// Number of writes.
+	uint64_t frames;			// Number of messages sent.
+	uint64_t bytes;				// Number of bytes sent.
+	uint64_t framesPerWrite[8];	// Writes carrying 1, 2, 3-4, 5-8, ... or over 64 messages.
+};
+
+
+class NymphSendQueue {
+	struct Node {
+		NymphMessage* msg;
+		uint64_t messageId;		// Request awaiting a reply, or 0.
+		std::shared_ptr<NymphMessage> shared;	// Set if other queues send it too.
+		Node* next;
+	};
+	
+	std::string loggerName = "NymphSendQueue";
+	Poco::Net::StreamSocket* socket;
+	NymphShmRing* ring = 0;
+	NymphRequestTable* requests;
+	std::atomic<Node*> head = { 0 };
+	std::atomic<bool> writing = { false };
+	std::atomic<bool> closed = { false };
+	std::mutex waitMutex;
+	std::condition_variable waitCondition;
+	std::atomic<uint32_t> waiters = { 0 };	// Threads parked on the condition.
+	
+	static std::atomic<uint32_t> maxBatchBytes;
+	static std::atomic<uint32_t> flushDelay;
+	static std::atomic<uint64_t> writeCount;
+	static std::atomic<uint64_t> frameCount;
+	static std::atomic<uint64_t> byteCount;
+	static std::atomic<uint64_t> batchCounts[8];
+	
+	void enqueue(Node* node);
+	void push(Node* node);
+	void release(Node* node);
+	void take(std::vector<Node*> &nodes);
+	bool waitForMore(int64_t deadline);
+	void acquireWriter();
+	void releaseWriter();
+	void stopWriting();
+	void notify();
+	void drain();
+	bool writeBatch(std::vector<Node*> &nodes, uint32_t first, uint32_t last);
+	void fail(Node* node, std::string error);
+	void fail(uint64_t messageId, std::string error);
+	
+	NymphSendQueue(const NymphSendQueue&);
+	NymphSendQueue& operator=(const NymphSendQueue&);
+	
+public:
+	NymphSendQueue(Poco::Net::StreamSocket* socket, NymphRequestTable* requests);
+	~NymphSendQueue();
+	
+	void setRing(NymphShmRing* ring) { this->ring = ring; }
+	void send(NymphMessage* msg, uint64_t messageId);
+	void send(std::shared_ptr<NymphMessage> msg);
+	bool sendNow(NymphMessage* msg, std::string &result);
+	bool write(const uint8_t* data, uint32_t length, std::string &result);
+	void close();
+	
+	static void setCoalescing(uint32_t maxBytes, uint32_t delay = 0);
+	static NymphSendStats stats();
+};
+
+#endif
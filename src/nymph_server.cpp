@@ -16,11 +16,17 @@
 #include "nymph_server.h"
 #include "nymph_logger.h"
 #include "nymph_session.h"
+#include "nymph_reactor.h"
 
 #ifndef NPOCO
 #include <Poco/Net/NetException.h>
 #endif
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 using namespace Poco;
 
 using namespace std;
@@ -29,12 +35,22 @@ using namespace std;
 // Static initialisations.
 string NymphServer::loggerName = "NymphServer";
 Poco::Net::ServerSocket NymphServer::ss;
-Net::TCPServer* NymphServer::server;
+Net::TCPServer* NymphServer::server = 0;
+NymphReactor* NymphServer::reactor = 0;
+std::thread* NymphServer::acceptor = 0;
+string NymphServer::socketPath;
 std::atomic<bool> NymphServer::running;
+uint32_t NymphServer::flags = 0;
+bool NymphServer::sharedMemory = false;
 
 
 // --- START ---
-bool NymphServer::start(int port) {
+// Start listening on the specified port. The flags select how sessions handle
+// incoming requests (see NymphServerFlags). In reactor mode, 'ioThreads' sets
+// the number of threads which handle the sockets of all sessions.
+bool NymphServer::start(int port, uint32_t flags, int ioThreads) {
+	NymphServer::flags = flags;
+	
 #ifndef NPOCO
 	try {
 #endif
@@ -79,7 +95,105 @@ bool NymphServer::start(int port) {
 		}
 #endif
 		
+		return startListening(ioThreads);
+#ifndef NPOCO
+	}
+	catch (Net::NetException& e) {
+		NYMPH_LOG_ERROR("Error starting TCP server: " + e.message());
+		return false;
+	}
+#endif
+}
+
+
+// Start listening on the socket specified by the URL. This is either a Unix 
+// domain socket ('unix://<path>') for local clients, or a TCP socket 
+// ('tcp://<host>:<port>' or '<host>:<port>'). With 'shm://<path>', clients
+// connect to the Unix domain socket at the path, then exchange messages with 
+// the server through a shared memory channel.
+bool NymphServer::start(string url, uint32_t flags, int ioThreads) {
+	NymphServer::flags = flags;
+	sharedMemory = (url.compare(0, 6, "shm://") == 0);
+	if (sharedMemory) {
+		// Sessions wait on their channel, so each one needs its own thread.
+		if (flags & NYMPH_SERVER_REACTOR) {
+			NYMPH_LOG_WARNING("Shared memory channels can not be used with the reactor.");
+			NymphServer::flags &= ~NYMPH_SERVER_REACTOR;
+		}
+		
+		url = "unix://" + url.substr(6);
+	}
+	
+	if (url.compare(0, 7, "unix://") == 0) {
+#if defined NPOCO || !defined POCO_HAS_UNIX_SOCKET
+		NYMPH_LOG_ERROR("Unix domain sockets are not supported.");
+		return false;
+#else
+		string path = url.substr(7);
+		
+#ifndef _WIN32
+		// Remove the socket file left behind by a previous server, if any.
+		struct stat st;
+		if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+			unlink(path.c_str());
+		}
+#endif
+		
+		try {
+			ss.bind(Net::SocketAddress(Net::SocketAddress::UNIX_LOCAL, path), false);
+		}
+		catch (Poco::Exception &e) {
+			NYMPH_LOG_ERROR("Error binding to " + path + ": " + e.message());
+			return false;
+		}
+		
+		socketPath = path;
+#endif
+	}
+	else {
+		if (url.compare(0, 6, "tcp://") == 0) { url = url.substr(6); }
+#ifndef NPOCO
+		try {
+#endif
+			ss.bind(Net::SocketAddress(url), true, true);
+#ifndef NPOCO
+		}
+		catch (Poco::Exception &e) {
+			NYMPH_LOG_ERROR("Error binding to " + url + ": " + e.message());
+			return false;
+		}
+#endif
+	}
+	
+	return startListening(ioThreads);
+}
+
+
+// --- START LISTENING ---
+// Starts accepting connections on the bound server socket.
+bool NymphServer::startListening(int ioThreads) {
+#ifndef NPOCO
+	try {
+#endif
 		ss.listen();
+		if (flags & NYMPH_SERVER_REACTOR) {
+			// Sessions are multiplexed over the reactor's I/O threads instead
+			// of each getting their own thread. New connections are accepted
+			// on a separate thread.
+			reactor = new NymphReactor;
+			if (!reactor->start(ioThreads)) {
+				NYMPH_LOG_ERROR("Error starting reactor.");
+				delete reactor;
+				reactor = 0;
+				ss.close();
+				return false;
+			}
+			
+			running = true;
+			acceptor = new std::thread(&NymphServer::acceptConnections);
+			return true;
+		}
+		
 		server = new Net::TCPServer(new Net::TCPServerConnectionFactoryImpl<NymphSession>(),
 									ss);
 		server->start();
@@ -98,12 +212,59 @@ bool NymphServer::start(int port) {
 
 // --- STOP ---
 bool NymphServer::stop() {
-	server->stop();
-	ss.close();
 	running = false;
-	delete server;
+	if (reactor) {
+		acceptor->join();
+		delete acceptor;
+		acceptor = 0;
+		
+		// Closes all remaining sessions.
+		reactor->stop();
+		delete reactor;
+		reactor = 0;
+		ss.close();
+	}
+	else {
+		server->stop();
+		ss.close();
+		delete server;
+		server = 0;
+	}
+	
+#ifndef _WIN32
+	// Remove the file of a Unix domain socket.
+	if (!socketPath.empty()) {
+		unlink(socketPath.c_str());
+		socketPath.clear();
+	}
+#endif
 	
 	NYMPH_LOG_INFORMATION("Stopped NymphServer.");
 	
 	return true;
 }
+
+
+// --- ACCEPT CONNECTIONS ---
+// Accepts new connections in reactor mode and hands them to the reactor.
+void NymphServer::acceptConnections() {
+	Timespan timeout(1, 0); // 1 second timeout
+	while (running) {
+#ifndef NPOCO
+		try {
+#endif
+			if (!ss.poll(timeout, Net::Socket::SELECT_READ)) { continue; }
+			
+			NymphSession* session = new NymphSession(ss.acceptConnection());
+			if (!session->attach(reactor)) {
+				NYMPH_LOG_ERROR("Failed to add new session to reactor.");
+				delete session;
+			}
+#ifndef NPOCO
+		}
+		catch (Poco::Exception &e) {
+			NYMPH_LOG_ERROR("Error accepting connection: " + e.message());
+		}
+#endif
+	}
+}
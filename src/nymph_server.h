@@ -19,6 +19,7 @@
 
 #include <string>
 #include <atomic>
+#include <thread>
 
 #ifdef NPOCO
 #include <npoco/net/TCPServer.h>
@@ -27,15 +28,33 @@
 #endif
 
 
+enum NymphServerFlags {
+	NYMPH_SERVER_CONCURRENT = 0x01,	// Execute requests on the worker pool.
+	NYMPH_SERVER_REACTOR = 0x02		// Handle all sessions using the reactor.
+};
+
+
+class NymphReactor;
+
+
 class NymphServer {
 	static std::string loggerName;
 	static Poco::Net::ServerSocket ss;
 	static Poco::Net::TCPServer* server;
+	static NymphReactor* reactor;
+	static std::thread* acceptor;
+	static std::string socketPath;	// Path of the Unix domain socket, if used.
+	
+	static bool startListening(int ioThreads);
+	static void acceptConnections();
 	
 public:
 	static std::atomic<bool> running;
+	static uint32_t flags;
+	static bool sharedMemory;	// Sessions use shared memory channels.
 	
-	static bool start(int port = 4004);
+	static bool start(int port = 4004, uint32_t flags = 0, int ioThreads = 2);
+	static bool start(std::string url, uint32_t flags = 0, int ioThreads = 2);
 	static bool stop();
 };
 
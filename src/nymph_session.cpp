@@ -17,6 +17,9 @@
 #include "nymph_server.h"
 #include "nymph_message.h"
 #include "remote_client.h"
+#include "method_request.h"
+#include "dispatcher.h"
+#include "nymph_buffer_pool.h"
 
 #ifdef NPOCO
 #include <npoco/NumberFormatter.h>
@@ -38,32 +41,74 @@ Mutex NymphSession::handleMutex;
 NymphSession::NymphSession(const Net::StreamSocket& socket) 
 							: Net::TCPServerConnection(socket) {
 	loggerName = "NymphSession";
+	pending = 0;
+	reactorClosed = false;
+	reactor = 0;
+	channel = 0;
+	sendQueue = new NymphSendQueue(&(this->socket()), 0);
 	
 	// TODO: send a list of the method signatures to the new client.
 	// Get the serialised list from the RemoteClient class and send it.
 }
 
 
+// --- DECONSTRUCTOR ---
+NymphSession::~NymphSession() {
+	delete sendQueue;
+	delete channel;
+}
+
+
 // --- RUN ---
 // Reads in and validates incoming Nymph requests, then tries to call the 
 // registered callback for any known method.
 void NymphSession::run() {
-	Net::StreamSocket& socket = this->socket();
-	
-	// Set a handle for this session instance.
-	handleMutex.lock();
-	handle = lastSessionHandle++;
-	handleMutex.unlock();
+	if (NymphServer::sharedMemory) {
+		// The client first hands over the shared memory channel to use.
+		string result;
+		channel = NymphShmChannel::accept(socket(), result);
+		if (!channel) {
+			NYMPH_LOG_ERROR("Failed to accept shared memory channel: " + result);
+			return;
+		}
+		
+		sendQueue->setRing(channel->output());
+	}
 	
-	// Add this client to the list of sessions.
-	NymphRemoteClient::addSession(handle, this);
+	addSession();
 	
 #ifdef __FREERTOS__
 	#include <freertos/task.h>
 	UBaseType_t uxHighWaterMark = uxTaskGetStackHighWaterMark(0);
 	NYMPH_LOG_DEBUG("Stack free: " + NumberFormatter::format((uint32_t) uxHighWaterMark) + " words.");
 #endif
+
+	if (channel) { readChannel(); }
+	else { readSocket(); }
 	
+	// Remove this session from the list.
+	NymphRemoteClient::removeSession(handle);
+	
+	// Close the channel, so that responses still being sent do not wait for
+	// space which the client will not free up any more.
+	if (channel) { channel->close(); }
+	
+	// Wake up methods still waiting for upload parts.
+	closeUploads();
+	
+	// Wait for requests still being processed by the worker pool, as these
+	// will use this session to send their response.
+	pendingMutex.lock();
+	while (pending > 0) { pendingCond.wait(pendingMutex); }
+	pendingMutex.unlock();
+}
+
+
+// --- READ SOCKET ---
+// Reads in messages from the socket until the remote disconnects or the server
+// stops.
+void NymphSession::readSocket() {
+	Net::StreamSocket& socket = this->socket();
 	Timespan timeout(1, 0); // 1 second timeout
 	char headerBuff[8];
 	while (NymphServer::running) {
@@ -86,6 +131,20 @@ void NymphSession::run() {
 			
 			uint32_t signature;
 			memcpy(&signature, &headerBuff, 4);
+			if (signature == nymphContinuationSignature || continuation.active()) {
+				// Part of a message which is too large for a single frame.
+				uint32_t frameLength = 0;
+				memcpy(&frameLength, (headerBuff + 4), 4);
+				NymphMessage* msg = 0;
+				if (!continuation.read(socket, signature, frameLength, msg)) {
+					NYMPH_LOG_ERROR("Failed to read continuation frame. Terminating listener thread.");
+					break;
+				}
+				
+				if (msg) { handleMessage(msg, NymphServer::flags & NYMPH_SERVER_CONCURRENT); }
+				continue;
+			}
+			
 			if (signature != 0x4452474e) { // 'DRGN' ASCII in LE format.
 				// TODO: handle invalid header.
 				NYMPH_LOG_ERROR("Invalid header: 0x" + NumberFormatter::formatHex(signature));
@@ -99,11 +158,11 @@ void NymphSession::run() {
 			NYMPH_LOG_DEBUG("Message length: " + NumberFormatter::format(length) + " bytes.");
 	
 #ifdef __FREERTOS__
-	uxHighWaterMark = uxTaskGetStackHighWaterMark(0);
+	UBaseType_t uxHighWaterMark = uxTaskGetStackHighWaterMark(0);
 	NYMPH_LOG_DEBUG("Stack free: " + NumberFormatter::format((uint32_t) uxHighWaterMark) + " words.");
 #endif
 			
-			uint8_t* buff = new uint8_t[length];
+			uint8_t* buff = NymphBufferPool::acquire(length);
 			
 			// Read the entire message into a string. This is then used to
 			// construct an NymphMessage instance.
@@ -123,7 +182,8 @@ void NymphSession::run() {
 						if (received == 0) {
 							// Remote disconnnected. Socket should be discarded.
 							NYMPH_LOG_INFORMATION("Received remote disconnected notice. Terminating listener thread.");
-							delete[] buff;
+							NymphBufferPool::release(buff, length);
+							buff = 0;
 							break;
 						}
 						else if (received != unread) {
@@ -142,103 +202,459 @@ void NymphSession::run() {
 				NYMPH_LOG_DEBUG("Read " + NumberFormatter::format(received) + " bytes.");
 			}
 			
+			if (!buff) { break; } // Remote disconnected.
+			
 			// Parse the string into an NymphMessage instance.
 			// Buffer ownership is transferred to the message.
-			NymphMessage* msg = new NymphMessage(buff, length);
+			NymphMessage* msg = new NymphMessage(buff, length, true);
 			
-			// Check for good state on message.
-			if (msg->isCorrupt()) {
-				// Handle corrupted message.
-				NYMPH_LOG_WARNING("Corrupted message. Discarding it.");
-				delete msg;
-				continue;
-			}
-			
-			if (msg->getState() != 0) {
-				// Error during the parsing of the message. Abort.
-				NYMPH_LOG_ERROR("Failed to parse the binary message. Skipping...");
-				delete msg;
-				continue;
-			}
-			
-			// The message ID is now used to find the appropriate callback to call.
-			uint64_t msgId = msg->getMessageId();
-			NYMPH_LOG_DEBUG("Calling method callback for message ID: " + NumberFormatter::format(msgId));
-			UInt32 id = msg->getMethodId();
-			NymphMessage* response = 0;
-			if (!NymphRemoteClient::callMethodCallback(handle, id, msg, response)) {
-				NYMPH_LOG_ERROR("Calling callback for message " + NumberFormatter::format(msgId) + " failed. Skipping message.");
-				//delete msg;
-				continue;
-			}
-			
-			if (!response) {
-				NYMPH_LOG_ERROR("Calling callback failed: no response returned.");
-				delete msg;
-				continue;
+			// In concurrent mode the request is executed on the worker pool,
+			// allowing this thread to continue reading requests.
+			handleMessage(msg, NymphServer::flags & NYMPH_SERVER_CONCURRENT);
+		} // if
+	} // while
+}
+
+
+// --- READ CHANNEL ---
+// Reads in messages from the shared memory channel until the client closes it,
+// disconnects or the server stops.
+void NymphSession::readChannel() {
+	NymphShmRing* ring = channel->input();
+	NymphMessage* msg = 0;
+	while (NymphServer::running) {
+		int res = ring->readFrame(msg, 1000);
+		if (res < 0) {
+			NYMPH_LOG_INFORMATION("Shared memory channel closed. Terminating listener thread.");
+			break;
+		}
+		else if (res == 0) {
+			if (NymphShmChannel::socketClosed(socket())) {
+				NYMPH_LOG_INFORMATION("Received remote disconnected notice. Terminating listener thread.");
+				break;
 			}
 			
-			NYMPH_LOG_INFORMATION("Calling method callback succeeded. Sending response.");
-			
-			// Prepare the response.
-			response->serialize();
-			
-			// Send the message.
+			continue;
+		}
+		
+		handleMessage(msg, NymphServer::flags & NYMPH_SERVER_CONCURRENT);
+	}
+}
+
+
+// --- ATTACH ---
+// Registers the session with the reactor instead of running it on its own
+// thread. The reactor takes ownership of the session, which deletes itself once
+// the connection is closed and no more requests are pending.
+bool NymphSession::attach(NymphReactor* reactor) {
+	addSession();
+	
+	this->reactor = reactor;
+	if (!reactor->add(socket().impl()->sockfd(), this)) {
+		NymphRemoteClient::removeSession(handle);
+		return false;
+	}
+	
+	return true;
+}
+
+
+// --- ON READABLE ---
+// Called by a reactor I/O thread when data is available on the socket. Every
+// completed request is executed on the worker pool.
+bool NymphSession::onReadable() {
+	vector<NymphMessage*> messages;
+	bool open = reader.read(socket().impl()->sockfd(), messages);
+	for (uint32_t i = 0; i < messages.size(); ++i) {
+		handleMessage(messages[i], true);
+	}
+	
+	return open;
+}
+
+
+// --- ON CLOSED ---
+// Called once the reactor has stopped monitoring the socket.
+void NymphSession::onClosed() {
+	NYMPH_LOG_INFORMATION("Session closed. Handle: " + NumberFormatter::format(handle) + ".");
+	
+	NymphRemoteClient::removeSession(handle);
 #ifndef NPOCO
-			try {
+	try {
 #endif
-				int ret = socket.sendBytes(((const void*) response->buffer()), 
-														response->buffer_size());
-				if (ret != response->buffer_size()) {
-					// Handle error.
-					NYMPH_LOG_ERROR("Failed to send message.");
-					delete response;
-					continue;
-				}
-				
-				NYMPH_LOG_DEBUG("Sent " + NumberFormatter::format(ret) + " bytes.");
+		socket().close();
 #ifndef NPOCO
-			}
-			catch (Poco::Exception &e) {
-				NYMPH_LOG_ERROR("Failed to send message: " + e.message());
-				delete response;
-				continue;
-			}
+	}
+	catch (...) { }
 #endif
-			
-			delete response;
-		} // if
-	} // while
+
+	closeUploads();
 	
-	// Remove this session from the list.
-	NymphRemoteClient::removeSession(handle);
+	pendingMutex.lock();
+	reactorClosed = true;
+	bool done = (pending == 0);
+	pendingMutex.unlock();
+	
+	if (done) { delete this; }
 }
 
 
-// --- SEND ---
-// Send data on the socket instance.
-bool NymphSession::send(uint8_t* msg, uint32_t length, std::string &result) {
-	Net::StreamSocket& socket = this->socket();
+// --- ADD SESSION ---
+// Assigns a handle to this session and adds it to the list of sessions.
+void NymphSession::addSession() {
+	handleMutex.lock();
+	handle = lastSessionHandle++;
+	handleMutex.unlock();
 	
-	// Send the message.
-#ifndef NPOCO
-	try {
-#endif
-		int ret = socket.sendBytes((const void*) msg, length);
-		if (ret != length) {
-			// Handle error.
-			result = "Failed to send message.";		
-			return false;
+	NymphRemoteClient::addSession(handle, this);
+}
+
+
+// --- HANDLE MESSAGE ---
+// Validates a received message, then either processes it on the current thread
+// or hands it to the worker pool.
+void NymphSession::handleMessage(NymphMessage* msg, bool pooled) {
+	// Check for good state on message.
+	if (msg->isCorrupt()) {
+		// Handle corrupted message.
+		NYMPH_LOG_WARNING("Corrupted message. Discarding it.");
+		delete msg;
+		return;
+	}
+	
+	if (msg->getState() != 0) {
+		// Error during the parsing of the message. Abort.
+		NYMPH_LOG_ERROR("Failed to parse the binary message. Skipping...");
+		delete msg;
+		return;
+	}
+	
+	if (msg->isBatch()) {
+		handleBatch(msg, pooled);
+		return;
+	}
+	
+	if (msg->isCancel()) {
+		cancelCall(msg->getResponseId());
+		delete msg;
+		return;
+	}
+	
+	if (msg->isChunk()) {
+		handlePart(msg);
+		return;
+	}
+	
+	// The method of an upload waits for the parts received on this thread, so
+	// it always runs on the worker pool.
+	if (msg->isUpload()) {
+		startUpload(msg);
+		pooled = true;
+	}
+	
+	if (pooled) {
+		pendingMutex.lock();
+		pending++;
+		pendingMutex.unlock();
+		
+		// The call can be cancelled while it waits on the worker pool.
+		trackCall(msg);
+		MethodRequest* req = new MethodRequest;
+		req->setMessage(this, msg);
+		Dispatcher::addRequest(req);
+		return;
+	}
+	
+	processMessage(msg);
+}
+
+
+// --- HANDLE BATCH ---
+// Executes the calls in a batch message. With the worker pool, the calls are
+// executed in parallel. The responses are collected and sent back together.
+void NymphSession::handleBatch(NymphMessage* msg, bool pooled) {
+	vector<NymphMessage*> calls;
+	calls.swap(msg->messages());
+	delete msg;
+	
+	if (calls.empty()) { return; }
+	
+	NYMPH_LOG_DEBUG("Received batch of " + NumberFormatter::format(calls.size()) + " calls.");
+	
+	NymphSessionBatch* batch = new NymphSessionBatch;
+	batch->reply = new NymphMessage;
+	batch->remaining = calls.size();
+	
+	if (pooled) {
+		pendingMutex.lock();
+		pending += calls.size();
+		pendingMutex.unlock();
+	}
+	
+	for (uint32_t i = 0; i < calls.size(); ++i) {
+		if (pooled) {
+			trackCall(calls[i]);
+			MethodRequest* req = new MethodRequest;
+			req->setMessage(this, calls[i], batch);
+			Dispatcher::addRequest(req);
+		}
+		else {
+			processMessage(calls[i], batch);
 		}
+	}
+}
+
+
+// --- COMPLETE BATCH ---
+// Adds the response to a call in the batch, if any. Sends the batch reply once
+// all calls in the batch have completed.
+void NymphSession::completeBatch(NymphSessionBatch* batch, NymphMessage* response) {
+	batch->mutex.lock();
+	if (response) { batch->reply->addMessage(response); }
+	bool done = (--batch->remaining == 0);
+	batch->mutex.unlock();
+	
+	if (!done) { return; }
+	
+	NymphMessage* reply = batch->reply;
+	delete batch;
+	
+	if (reply->messages().empty()) {
+		NYMPH_LOG_ERROR("No call in batch returned a response.");
+		delete reply;
+		return;
+	}
+	
+	reply->serializeVectored();
+	send(reply);
+}
+
+
+// --- PROCESS MESSAGE ---
+// Calls the method callback for the message and sends the response. Called on
+// the session's thread, or on a worker thread in concurrent mode. The response 
+// is tagged with the message ID of the request, so it can be sent in any order.
+// For a call in a batch, the response is added to the batch instead.
+void NymphSession::processMessage(NymphMessage* msg, NymphSessionBatch* batch) {
+	// The message ID is now used to find the appropriate callback to call.
+	uint64_t msgId = msg->getMessageId();
+	NYMPH_LOG_DEBUG("Calling method callback for message ID: " + NumberFormatter::format(msgId));
+	UInt32 id = msg->getMethodId();
+	
+	// Drop calls whose caller is no longer waiting for the response.
+	if (msg->isExpired() || msg->isCancelled()) {
+		NYMPH_LOG_DEBUG("Message " + NumberFormatter::format(msgId) + " was cancelled or passed its deadline. Dropping it.");
+		msg->discard();
+		if (batch) { completeBatch(batch, 0); }
+		return;
+	}
+	
+	// The method may delete the message, so keep its deadline and token.
+	bool hasDeadline = msg->hasDeadline();
+	chrono::steady_clock::time_point deadline = msg->getDeadline();
+	NymphCancelToken token = msg->getCancelToken();
+	NymphMessage* response = 0;
+	if (!NymphRemoteClient::callMethodCallback(handle, id, msg, response)) {
+		NYMPH_LOG_ERROR("Calling callback for message " + NumberFormatter::format(msgId) + " failed. Skipping message.");
+		//delete msg;
+		if (batch) { completeBatch(batch, 0); }
+		return;
+	}
+	
+	if (!response) {
+		NYMPH_LOG_ERROR("Calling callback failed: no response returned.");
+		delete msg;
+		if (batch) { completeBatch(batch, 0); }
+		return;
+	}
+	
+	if ((hasDeadline && chrono::steady_clock::now() >= deadline) || (token && token->load())) {
+		NYMPH_LOG_DEBUG("Message " + NumberFormatter::format(msgId) + " was cancelled or passed its deadline. Dropping response.");
+		delete response;
+		if (batch) { completeBatch(batch, 0); }
+		return;
+	}
+	
+	if (batch) {
+		completeBatch(batch, response);
+		return;
+	}
+	
+	NYMPH_LOG_INFORMATION("Calling method callback succeeded. Sending response.");
+	
+	// Prepare the response.
+	response->serializeVectored();
+	
+	// Queue the message, which takes ownership of it.
+	send(response);
+}
+
+
+// --- TRACK CALL ---
+// Registers a call handed to the worker pool, so that the client can cancel it.
+void NymphSession::trackCall(NymphMessage* msg) {
+	NymphCancelToken token = make_shared<atomic<bool> >(false);
+	msg->setCancelToken(token);
+	activeCallsMutex.lock();
+	activeCalls[msg->getMessageId()] = token;
+	activeCallsMutex.unlock();
+}
+
+
+// --- UNTRACK CALL ---
+// Called once a tracked call has been processed. Parts of its upload which are
+// still to arrive are discarded.
+void NymphSession::untrackCall(uint64_t msgId) {
+	activeCallsMutex.lock();
+	activeCalls.erase(msgId);
+	activeCallsMutex.unlock();
+	
+	uploadsMutex.lock();
+	map<uint64_t, shared_ptr<NymphUploadReader> >::iterator it = uploads.find(msgId);
+	if (it != uploads.end()) {
+		it->second->close();
+		uploads.erase(it);
+	}
+	
+	uploadsMutex.unlock();
+}
+
+
+// --- CANCEL CALL ---
+// Signals the cancel token of the call, if it is still queued or running. A 
+// queued call is dropped, a running method can check the token.
+void NymphSession::cancelCall(uint64_t msgId) {
+	activeCallsMutex.lock();
+	map<uint64_t, NymphCancelToken>::iterator it = activeCalls.find(msgId);
+	bool found = (it != activeCalls.end());
+	if (found) { it->second->store(true); }
+	activeCallsMutex.unlock();
+	
+	NYMPH_LOG_DEBUG("Cancel request for message " + NumberFormatter::format(msgId) + 
+						(found ? "." : ", which is not pending."));
+	
+	// A method waiting for upload parts stops waiting.
+	uploadsMutex.lock();
+	map<uint64_t, shared_ptr<NymphUploadReader> >::iterator uit = uploads.find(msgId);
+	if (uit != uploads.end()) { uit->second->close(); }
+	uploadsMutex.unlock();
+}
+
+
+// --- START UPLOAD ---
+// Provides the call with the reader for the parts of its upload.
+void NymphSession::startUpload(NymphMessage* msg) {
+	shared_ptr<NymphUploadReader> reader = make_shared<NymphUploadReader>();
+	msg->setUploadReader(reader);
+	uploadsMutex.lock();
+	uploads[msg->getMessageId()] = reader;
+	uploadsMutex.unlock();
+}
+
+
+// --- HANDLE PART ---
+// Passes a received upload part to the reader of its call. Waits while the 
+// reader holds the maximum number of parts, so no further data is read until
+// the method has caught up. With the reactor, the socket is paused instead.
+void NymphSession::handlePart(NymphMessage* msg) {
+	uint64_t callId = msg->getResponseId();
+	bool last = (msg->getResponse(true) == 0); // The final part carries no value.
+	uploadsMutex.lock();
+	map<uint64_t, shared_ptr<NymphUploadReader> >::iterator it = uploads.find(callId);
+	shared_ptr<NymphUploadReader> reader;
+	if (it != uploads.end()) {
+		reader = it->second;
+		if (last) { uploads.erase(it); }
+	}
+	
+	uploadsMutex.unlock();
+	
+	if (!reader) {
+		NYMPH_LOG_DEBUG("Discarding upload part for message " + NumberFormatter::format(callId) + ".");
+		msg->discard();
+		return;
+	}
+	
+	if (last) {
+		reader->end();
+		msg->discard();
+		return;
+	}
+	
+	if (reactor) {
+		// A reactor thread is shared with other sessions and must not wait. The
+		// session is kept while paused, like for a pending request.
+		NymphReactor* r = reactor;
+		int fd = socket().impl()->sockfd();
+		acquire();
+		if (reader->add(msg, [this, r, fd] { r->resume(fd, this); requestDone(); })) {
+			requestDone();
+		}
+		else { reactor->pause(fd); }
 		
-		NYMPH_LOG_DEBUG("Sent " + NumberFormatter::format(ret) + " bytes.");
-#ifndef NPOCO
+		return;
 	}
-	catch (Poco::Exception &e) {
-		result = "Failed to send message: " + e.message();
-		return false;
+	
+	reader->push(msg);
+}
+
+
+// --- CLOSE UPLOADS ---
+// Aborts all uploads in progress once the connection has been closed.
+void NymphSession::closeUploads() {
+	uploadsMutex.lock();
+	map<uint64_t, shared_ptr<NymphUploadReader> >::iterator it;
+	for (it = uploads.begin(); it != uploads.end(); ++it) {
+		it->second->close();
 	}
-#endif
 	
-	return true;
+	uploads.clear();
+	uploadsMutex.unlock();
+}
+
+
+// --- ACQUIRE ---
+// Keeps the session from being deleted until a matching call to requestDone(),
+// like a pending request does. Must be called while the session is listed with
+// NymphRemoteClient, with its sessions mutex held, or from the thread reading 
+// from the session.
+void NymphSession::acquire() {
+	pendingMutex.lock();
+	pending++;
+	pendingMutex.unlock();
+}
+
+
+// --- REQUEST DONE ---
+// Called when a request handed to the worker pool has been processed. A session
+// owned by the reactor is deleted here if it was closed in the meantime.
+void NymphSession::requestDone() {
+	pendingMutex.lock();
+	bool done = (--pending == 0);
+	if (done) { pendingCond.broadcast(); }
+	done = done && reactorClosed;
+	pendingMutex.unlock();
+	
+	if (done) { delete this; }
+}
+
+
+// --- SEND ---
+// Send data on the socket instance. Serialised with the queued messages, as 
+// responses and callbacks can be sent from multiple threads.
+bool NymphSession::send(uint8_t* msg, uint32_t length, std::string &result) {
+	return sendQueue->write(msg, length, result);
+}
+
+
+// Queue a serialised message for sending and take ownership of it. Queued
+// messages may be coalesced into a single write, see NymphSendQueue.
+void NymphSession::send(NymphMessage* msg) {
+	sendQueue->send(msg, 0);
+}
+
+
+// Queue a serialised message which is also sent to other sessions.
+void NymphSession::send(std::shared_ptr<NymphMessage> msg) {
+	sendQueue->send(msg);
 }
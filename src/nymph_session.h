@@ -18,26 +18,85 @@
 #define NYMPH_SESSION_H
 
 #include <string>
+#include <memory>
+#include <map>
+
+#include "nymph_reactor.h"
+#include "nymph_frame_reader.h"
+#include "nymph_continuation.h"
+#include "nymph_send_queue.h"
+#include "nymph_shm_channel.h"
+#include "nymph_message.h"
+#include "nymph_upload.h"
 
 #ifdef NPOCO
 #include <npoco/net/TCPServerConnection.h>
 #include <npoco/Mutex.h>
+#include <npoco/Condition.h>
 #else
 #include <Poco/Net/TCPServerConnection.h>
 #include <Poco/Mutex.h>
+#include <Poco/Condition.h>
 #endif
 
 
-class NymphSession : public Poco::Net::TCPServerConnection {
+class NymphMessage;
+
+
+// Collects the responses to the calls in a received batch message. They are
+// sent back together in a single batch message once the last call completed.
+struct NymphSessionBatch {
+	NymphMessage* reply;
+	uint32_t remaining;
+	Poco::Mutex mutex;
+};
+
+
+class NymphSession : public Poco::Net::TCPServerConnection, public NymphReactorHandler {
 	std::string loggerName;
 	int handle;
 	static int lastSessionHandle;
 	static Poco::Mutex handleMutex;
+	NymphSendQueue* sendQueue;
+	uint32_t pending;
+	Poco::Mutex pendingMutex;
+	Poco::Condition pendingCond;
+	bool reactorClosed;
+	NymphReactor* reactor;	// Set if attached to a reactor.
+	NymphFrameReader reader;
+	NymphContinuation continuation;	// Message received as continuation frames.
+	NymphShmChannel* channel;
+	std::map<uint64_t, NymphCancelToken> activeCalls;	// Calls on the worker pool.
+	Poco::Mutex activeCallsMutex;
+	std::map<uint64_t, std::shared_ptr<NymphUploadReader> > uploads;	// Uploads in progress.
+	Poco::Mutex uploadsMutex;
+	
+	void addSession();
+	void readSocket();
+	void readChannel();
+	void handleMessage(NymphMessage* msg, bool pooled);
+	void handleBatch(NymphMessage* msg, bool pooled);
+	void completeBatch(NymphSessionBatch* batch, NymphMessage* response);
+	void trackCall(NymphMessage* msg);
+	void cancelCall(uint64_t msgId);
+	void startUpload(NymphMessage* msg);
+	void handlePart(NymphMessage* msg);
+	void closeUploads();
 	
 public:
 	NymphSession(const Poco::Net::StreamSocket& socket);
+	~NymphSession();
 	void run();
+	bool attach(NymphReactor* reactor);
+	bool onReadable();
+	void onClosed();
+	void processMessage(NymphMessage* msg, NymphSessionBatch* batch = 0);
+	void untrackCall(uint64_t msgId);
+	void acquire();
+	void requestDone();
 	bool send(uint8_t* msg, uint32_t length, std::string &result);
+	void send(NymphMessage* msg);
+	void send(std::shared_ptr<NymphMessage> msg);
 };
 
 #endif
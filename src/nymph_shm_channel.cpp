@@ -0,0 +1,280 @@
+/*
+	nymph_shm_channel.cpp - implementation file for the NymphRPC Shared Memory
+								Channel class.
+	
+	Revision 0
+	
+	Notes:
+			- Segment layout: a 64 byte header (signature 'NYSH', version, ring
+				capacity), followed by the client-to-server ring and the
+				server-to-client ring.
+			- Handshake: the client sends 'NYSH', the uint32 length of the
+				segment name and the name. The server replies with a single
+				byte, 1 if it mapped the segment, else 0. The segment's name is
+				removed after the handshake, so it disappears along with the
+				last process using it.
+	
+	(c) Nyanko.ws
+*/
+
+
+#include "nymph_shm_channel.h"
+#include "nymph_logger.h"
+
+#ifdef NPOCO
+#include <npoco/NumberFormatter.h>
+#else
+#include <Poco/NumberFormatter.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#include <cstring>
+
+using namespace std;
+
+
+// Static initialisations.
+atomic<uint32_t> NymphShmChannel::ringSize = { 8 * 1024 * 1024 };
+atomic<uint32_t> NymphShmChannel::lastId = { 0 };
+
+
+static const uint32_t shmSignature = 0x4853594e; // 'NYSH' ASCII in LE format.
+static const uint32_t shmVersion = 0;
+static const uint64_t segmentHeaderSize = 64;
+
+
+// --- RECEIVE FULL ---
+// Receives exactly 'length' bytes on the socket, waiting up to five seconds for
+// each part of it.
+static bool receiveFull(Poco::Net::StreamSocket &socket, void* buffer, int length) {
+	Poco::Timespan timeout(5, 0);
+	int received = 0;
+	while (received < length) {
+		if (!socket.poll(timeout, Poco::Net::Socket::SELECT_READ)) { return false; }
+		int res = socket.receiveBytes(((char*) buffer) + received, length - received);
+		if (res <= 0) { return false; }
+		received += res;
+	}
+	
+	return true;
+}
+
+
+// --- CONSTRUCTOR ---
+// Uses the segment at the memory. The client writes into the first ring, the
+// server into the second one. If 'init' is set, the rings are set up.
+NymphShmChannel::NymphShmChannel(void* memory, uint64_t size, bool client, bool init,
+															uint64_t capacity) {
+	this->memory = memory;
+	this->size = size;
+	uint8_t* first = ((uint8_t*) memory) + segmentHeaderSize;
+	uint8_t* second = first + NymphShmRing::size(capacity);
+	if (client) {
+		out = new NymphShmRing(first, init, capacity);
+		in = new NymphShmRing(second, init, capacity);
+	}
+	else {
+		in = new NymphShmRing(first, init, capacity);
+		out = new NymphShmRing(second, init, capacity);
+	}
+}
+
+
+// --- DECONSTRUCTOR ---
+NymphShmChannel::~NymphShmChannel() {
+	delete in;
+	delete out;
+#ifndef _WIN32
+	munmap(memory, size);
+#endif
+}
+
+
+// --- SET RING SIZE ---
+// Sets the capacity in bytes of each of the two rings of new channels. Larger
+// messages are streamed through the ring.
+void NymphShmChannel::setRingSize(uint32_t bytes) {
+	if (bytes > 0) { ringSize = bytes; }
+}
+
+
+// --- CONNECT ---
+// Creates a new channel for the client and hands it to the server on the other
+// end of the connected socket. Returns 0 and sets 'result' on failure.
+NymphShmChannel* NymphShmChannel::connect(Poco::Net::StreamSocket &socket, string &result) {
+#ifdef _WIN32
+	result = "Shared memory transport is not supported.";
+	return 0;
+#else
+	static string loggerName = "NymphShmChannel";
+	uint64_t capacity = ringSize;
+	uint64_t size = segmentHeaderSize + 2 * NymphShmRing::size(capacity);
+	string name = "/nymph-" + Poco::NumberFormatter::format((int) getpid()) + "-" +
+									Poco::NumberFormatter::format(lastId++);
+	
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0) {
+		result = "Failed to create shared memory: " + string(strerror(errno));
+		return 0;
+	}
+	
+	void* memory = MAP_FAILED;
+	if (ftruncate(fd, size) == 0) {
+		memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	
+	::close(fd);
+	if (memory == MAP_FAILED) {
+		result = "Failed to map shared memory: " + string(strerror(errno));
+		shm_unlink(name.c_str());
+		return 0;
+	}
+	
+	uint8_t* header = (uint8_t*) memory;
+	memcpy(header, &shmSignature, 4);
+	memcpy(header + 4, &shmVersion, 4);
+	memcpy(header + 8, &capacity, 8);
+	NymphShmChannel* channel = new NymphShmChannel(memory, size, true, true, capacity);
+	
+	// Hand the segment's name to the server and wait for it to map it.
+	string handshake = string((const char*) &shmSignature, 4);
+	uint32_t length = name.length();
+	handshake += string((const char*) &length, 4);
+	handshake += name;
+	uint8_t ack = 0;
+	bool ok = false;
+#ifndef NPOCO
+	try {
+#endif
+		if (socket.sendBytes(handshake.data(), handshake.length()) == (int) handshake.length()) {
+			ok = receiveFull(socket, &ack, 1) && ack == 1;
+		}
+#ifndef NPOCO
+	}
+	catch (...) { ok = false; }
+#endif
+
+	shm_unlink(name.c_str());
+	if (!ok) {
+		result = "Server did not accept the shared memory channel.";
+		delete channel;
+		return 0;
+	}
+	
+	NYMPH_LOG_DEBUG("Created shared memory channel " + name + ".");
+	
+	return channel;
+#endif
+}
+
+
+// --- ACCEPT ---
+// Receives the channel from a connecting client and maps it. Returns 0 and sets
+// 'result' on failure.
+NymphShmChannel* NymphShmChannel::accept(Poco::Net::StreamSocket &socket, string &result) {
+#ifdef _WIN32
+	result = "Shared memory transport is not supported.";
+	return 0;
+#else
+	uint8_t handshake[8];
+	uint32_t signature = 0;
+	uint32_t length = 0;
+	string name;
+	NymphShmChannel* channel = 0;
+#ifndef NPOCO
+	try {
+#endif
+		if (!receiveFull(socket, handshake, 8)) {
+			result = "Failed to receive shared memory handshake.";
+			return 0;
+		}
+		
+		memcpy(&signature, handshake, 4);
+		memcpy(&length, handshake + 4, 4);
+		if (signature != shmSignature || length == 0 || length > 255) {
+			result = "Invalid shared memory handshake.";
+			return 0;
+		}
+		
+		name.resize(length);
+		if (!receiveFull(socket, &name[0], length)) {
+			result = "Failed to receive shared memory handshake.";
+			return 0;
+		}
+		
+		// Map the segment and validate its layout.
+		void* memory = MAP_FAILED;
+		struct stat st;
+		int fd = shm_open(name.c_str(), O_RDWR, 0);
+		if (fd >= 0 && fstat(fd, &st) == 0 && (uint64_t) st.st_size > segmentHeaderSize) {
+			memory = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		}
+		
+		if (fd >= 0) { ::close(fd); }
+		if (memory == MAP_FAILED) {
+			result = "Failed to map shared memory " + name + ".";
+		}
+		else {
+			uint64_t capacity = 0;
+			memcpy(&signature, memory, 4);
+			memcpy(&capacity, ((uint8_t*) memory) + 8, 8);
+			uint64_t size = segmentHeaderSize + 2 * NymphShmRing::size(capacity);
+			if (signature != shmSignature || capacity == 0 || capacity > (uint64_t) st.st_size || 
+													size != (uint64_t) st.st_size) {
+				result = "Invalid shared memory segment " + name + ".";
+				munmap(memory, st.st_size);
+			}
+			else {
+				channel = new NymphShmChannel(memory, size, false, false, capacity);
+			}
+		}
+		
+		uint8_t ack = channel ? 1 : 0;
+		socket.sendBytes(&ack, 1);
+#ifndef NPOCO
+	}
+	catch (...) {
+		result = "Shared memory handshake failed.";
+		delete channel;
+		return 0;
+	}
+#endif
+
+	return channel;
+#endif
+}
+
+
+// --- SOCKET CLOSED ---
+// Checks whether the remote closed the socket. No data is sent on the socket
+// once the channel is used, so it only becomes readable once closed.
+bool NymphShmChannel::socketClosed(Poco::Net::StreamSocket &socket) {
+#ifndef NPOCO
+	try {
+#endif
+		if (!socket.poll(Poco::Timespan(0, 0), Poco::Net::Socket::SELECT_READ)) { return false; }
+		
+		char c;
+		return socket.receiveBytes(&c, 1) <= 0;
+#ifndef NPOCO
+	}
+	catch (...) {
+		return true;
+	}
+#endif
+}
+
+
+// --- CLOSE ---
+// Closes both rings, waking up the local and remote reader and writer.
+void NymphShmChannel::close() {
+	in->close();
+	out->close();
+}
@@ -0,0 +1,62 @@
+/*
+	nymph_shm_channel.h - header file for the NymphRPC Shared Memory Channel class.
+	
+	Revision 0
+	
+	Notes:
+			- A pair of rings in a shared memory segment, through which a client
+				and a server on the same host exchange messages. The client
+				creates the segment and passes its name to the server over the
+				Unix domain socket it connected with.
+			- The socket is kept open, so either side notices when the other
+				side disconnects.
+	
+	(c) Nyanko.ws
+*/
+
+
+#pragma once
+#ifndef NYMPH_SHM_CHANNEL_H
+#define NYMPH_SHM_CHANNEL_H
+
+#include "nymph_shm_ring.h"
+
+#ifdef NPOCO
+#include <npoco/net/StreamSocket.h>
+#else
+#include <Poco/Net/StreamSocket.h>
+#endif
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+
+class NymphShmChannel {
+	std::string loggerName = "NymphShmChannel";
+	void* memory;
+	uint64_t size;
+	NymphShmRing* in;
+	NymphShmRing* out;
+	
+	static std::atomic<uint32_t> ringSize;
+	static std::atomic<uint32_t> lastId;
+	
+	NymphShmChannel(void* memory, uint64_t size, bool client, bool init, uint64_t capacity);
+	NymphShmChannel(const NymphShmChannel&);
+	NymphShmChannel& operator=(const NymphShmChannel&);
+	
+public:
+	~NymphShmChannel();
+	
+	static void setRingSize(uint32_t bytes);
+	static NymphShmChannel* connect(Poco::Net::StreamSocket &socket, std::string &result);
+	static NymphShmChannel* accept(Poco::Net::StreamSocket &socket, std::string &result);
+	static bool socketClosed(Poco::Net::StreamSocket &socket);
+	
+	NymphShmRing* input() { return in; }
+	NymphShmRing* output() { return out; }
+	void close();
+};
+
+#endif
@@ -0,0 +1,328 @@
+/*
+	nymph_shm_ring.cpp - implementation file for the NymphRPC Shared Memory Ring
+								class.
+	
+	Revision 0
+	
+	Notes:
+			- A waiting side sets its 'waiting' flag before checking the ring
+				once more, while the other side checks the flag after updating
+				its position. With sequentially consistent operations, either
+				the waiting side sees the update, or the other side sees the
+				flag and changes the futex value before waking it.
+			- Without futexes, waiting is done by sleeping briefly.
+	
+	(c) Nyanko.ws
+*/
+
+
+#include "nymph_shm_ring.h"
+#include "nymph_message.h"
+#include "nymph_buffer_pool.h"
+#include "nymph_continuation.h"
+#include "nymph_logger.h"
+
+#ifdef NPOCO
+#include <npoco/NumberFormatter.h>
+#else
+#include <Poco/NumberFormatter.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#endif
+
+#include <new>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+
+// Static initialisations.
+atomic<uint32_t> NymphShmRing::spinCount = { 0 };
+
+
+// Size of the ring header in the shared memory, keeping the data aligned.
+static const uint64_t headerSize = (sizeof(NymphShmRingHeader) + 63) & ~((uint64_t) 63);
+
+
+// --- FUTEX WAIT ---
+// Waits until the value at the address no longer equals 'expected', it is woken
+// up, or the timeout (in milliseconds) expires.
+static void futexWait(atomic<uint32_t>* address, uint32_t expected, uint32_t timeout) {
+#ifdef __linux__
+	struct timespec ts;
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (timeout % 1000) * 1000000;
+	syscall(SYS_futex, (uint32_t*) address, FUTEX_WAIT, expected, &ts, 0, 0);
+#else
+	if (address->load() == expected) { this_thread::sleep_for(chrono::microseconds(100)); }
+#endif
+}
+
+
+// --- FUTEX WAKE ---
+static void futexWake(atomic<uint32_t>* address) {
+#ifdef __linux__
+	syscall(SYS_futex, (uint32_t*) address, FUTEX_WAKE, 1, 0, 0, 0);
+#endif
+}
+
+
+// --- CONSTRUCTOR ---
+// Uses the ring at the provided memory, which is size(capacity) bytes large. If
+// 'init' is set, a new, empty ring is set up. The capacity stored in the ring's
+// header is not used, as the other process can change it.
+NymphShmRing::NymphShmRing(void* memory, bool init, uint64_t capacity) {
+	header = (NymphShmRingHeader*) memory;
+	data = ((uint8_t*) memory) + headerSize;
+	cap = capacity;
+	
+	if (init) {
+		header = new (memory) NymphShmRingHeader;
+		header->head.store(0);
+		header->spaceSeq.store(0);
+		header->writerWaiting.store(0);
+		header->tail.store(0);
+		header->dataSeq.store(0);
+		header->readerWaiting.store(0);
+		header->capacity = capacity;
+		header->closed.store(0);
+	}
+}
+
+
+// --- SIZE ---
+// Returns the number of bytes of memory needed for a ring with the capacity.
+uint64_t NymphShmRing::size(uint64_t capacity) {
+	return headerSize + ((capacity + 63) & ~((uint64_t) 63));
+}
+
+
+// --- SET SPIN ---
+// Sets the number of times a waiting reader or writer checks the ring before
+// going to sleep. Spinning avoids the wake-up latency when the other side
+// responds quickly, at the cost of CPU time. Applies to all rings.
+void NymphShmRing::setSpin(uint32_t iterations) {
+	spinCount = iterations;
+}
+
+
+// --- WAIT FOR SPACE ---
+// Waits for the reader to free up space in the ring, until the timeout (in
+// milliseconds) expires or the ring is closed. Returns true if there is space.
+bool NymphShmRing::waitForSpace(uint64_t head, uint32_t timeout) {
+	uint32_t spins = spinCount;
+	for (uint32_t i = 0; i < spins; ++i) {
+		if (head - header->tail.load(memory_order_acquire) < cap) { return true; }
+	}
+	
+	uint32_t seq = header->spaceSeq.load();
+	header->writerWaiting.store(1);
+	if (head - header->tail.load() >= cap && !header->closed.load()) {
+		futexWait(&header->spaceSeq, seq, timeout);
+	}
+	
+	header->writerWaiting.store(0);
+	return head - header->tail.load() < cap;
+}
+
+
+// --- WAIT FOR DATA ---
+// Waits for the writer to add data to the ring, until the timeout (in
+// milliseconds) expires or the ring is closed. Returns true if there is data.
+bool NymphShmRing::waitForData(uint64_t tail, uint32_t timeout) {
+	uint32_t spins = spinCount;
+	for (uint32_t i = 0; i < spins; ++i) {
+		if (header->head.load(memory_order_acquire) != tail) { return true; }
+	}
+	
+	uint32_t seq = header->dataSeq.load();
+	header->readerWaiting.store(1);
+	if (header->head.load() == tail && !header->closed.load()) {
+		futexWait(&header->dataSeq, seq, timeout);
+	}
+	
+	header->readerWaiting.store(0);
+	return header->head.load() != tail;
+}
+
+
+// --- WRITE ---
+// Writes the data into the ring, waiting for space as needed. Data larger than
+// the ring is written as the reader makes room for it. Returns false if the ring
+// was closed.
+bool NymphShmRing::write(const uint8_t* buffer, uint64_t length) {
+	uint64_t head = header->head.load(memory_order_relaxed);
+	while (length > 0) {
+		if (header->closed.load()) { return false; }
+		
+		// An invalid tail from the other process counts as a full ring.
+		uint64_t used = head - header->tail.load(memory_order_acquire);
+		if (used >= cap) {
+			waitForSpace(head, 100);
+			continue;
+		}
+		
+		// Copy up to the end of the data area, then wrap around.
+		uint64_t chunk = min(length, cap - used);
+		uint64_t pos = head % cap;
+		uint64_t first = min(chunk, cap - pos);
+		memcpy(data + pos, buffer, first);
+		if (chunk > first) { memcpy(data, buffer + first, chunk - first); }
+		
+		head += chunk;
+		buffer += chunk;
+		length -= chunk;
+		header->head.store(head);
+		
+		if (header->readerWaiting.load()) {
+			header->dataSeq.fetch_add(1);
+			futexWake(&header->dataSeq);
+		}
+	}
+	
+	return true;
+}
+
+
+// Writes the serialised messages into the ring. Large values referenced by a
+// message are copied straight from where they are stored.
+bool NymphShmRing::write(vector<NymphMessage*> &msgs, string &result) {
+	for (uint32_t i = 0; i < msgs.size(); ++i) {
+		vector<NymphBufferSegment> &segs = msgs[i]->segments();
+		bool ret = true;
+		if (segs.empty()) { ret = write(msgs[i]->buffer(), msgs[i]->buffer_size()); }
+		
+		for (uint32_t j = 0; ret && j < segs.size(); ++j) {
+			ret = write(segs[j].data, segs[j].length);
+		}
+		
+		if (!ret) {
+			result = "Connection was closed.";
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+
+// --- READ ---
+// Reads up to 'length' bytes from the ring, waiting up to the timeout (in
+// milliseconds) if it is empty. Returns the number of bytes read, 0 on timeout,
+// or -1 if the ring was closed and no data remains.
+int64_t NymphShmRing::read(uint8_t* buffer, uint64_t length, uint32_t timeout) {
+	uint64_t tail = header->tail.load(memory_order_relaxed);
+	uint64_t available = header->head.load(memory_order_acquire) - tail;
+	if (available == 0) {
+		if (header->closed.load()) { return -1; }
+		if (!waitForData(tail, timeout)) { return header->closed.load() ? -1 : 0; }
+		available = header->head.load(memory_order_acquire) - tail;
+	}
+	
+	// More than the capacity is only available if the other process corrupted
+	// the positions.
+	uint64_t chunk = min(min(length, available), cap);
+	uint64_t pos = tail % cap;
+	uint64_t first = min(chunk, cap - pos);
+	memcpy(buffer, data + pos, first);
+	if (chunk > first) { memcpy(buffer + first, data, chunk - first); }
+	
+	header->tail.store(tail + chunk);
+	
+	if (header->writerWaiting.load()) {
+		header->spaceSeq.fetch_add(1);
+		futexWake(&header->spaceSeq);
+	}
+	
+	return chunk;
+}
+
+
+// --- READ FULL ---
+// Reads exactly 'length' bytes. As the writer writes a message at once, it gives
+// up if no data arrives for ten seconds. Returns false if the data could not be
+// read.
+bool NymphShmRing::readFull(uint8_t* buffer, uint64_t length) {
+	uint32_t idle = 0;
+	while (length > 0) {
+		int64_t res = read(buffer, length, 100);
+		if (res < 0) { return false; }
+		if (res == 0) {
+			if (++idle == 100) { return false; }
+			continue;
+		}
+		
+		idle = 0;
+		buffer += res;
+		length -= res;
+	}
+	
+	return true;
+}
+
+
+// --- READ FRAME ---
+// Reads the next message from the ring, waiting up to the timeout (in 
+// milliseconds) for it to start. The message body is read into a buffer from
+// the NymphBufferPool, or for a message sent as continuation frames, into a 
+// buffer for the whole message. Returns 1 if a message was read, 0 on timeout,
+// or -1 if the ring was closed or contains invalid data.
+int NymphShmRing::readFrame(NymphMessage* &msg, uint32_t timeout) {
+	uint8_t headerBuff[8];
+	int64_t res = read(headerBuff, 8, timeout);
+	if (res <= 0) { return (int) res; }
+	if (res < 8 && !readFull(headerBuff + res, 8 - res)) { return -1; }
+	
+	uint32_t signature;
+	uint32_t length = 0;
+	memcpy(&signature, headerBuff, 4);
+	memcpy(&length, (headerBuff + 4), 4);
+	if (signature == nymphContinuationSignature) {
+		// The writer writes all frames of the message at once.
+		NymphContinuation continuation;
+		while (1) {
+			uint8_t* dest = continuation.frame(signature, length);
+			if (!dest || !readFull(dest, length)) { return -1; }
+			msg = continuation.frameDone();
+			if (msg) { return 1; }
+			if (!continuation.active() || !readFull(headerBuff, 8)) { return -1; }
+			
+			memcpy(&signature, headerBuff, 4);
+			memcpy(&length, (headerBuff + 4), 4);
+		}
+	}
+	
+	if (signature != nymphFrameSignature) {
+		NYMPH_LOG_ERROR("Invalid header: 0x" + Poco::NumberFormatter::formatHex(signature));
+		return -1;
+	}
+	
+	uint8_t* buffer = NymphBufferPool::acquire(length);
+	if (!readFull(buffer, length)) {
+		NymphBufferPool::release(buffer, length);
+		return -1;
+	}
+	
+	// Buffer ownership is transferred to the message.
+	msg = new NymphMessage(buffer, length, true);
+	return 1;
+}
+
+
+// --- CLOSE ---
+// Closes the ring, waking up a waiting reader or writer.
+void NymphShmRing::close() {
+	header->closed.store(1);
+	header->dataSeq.fetch_add(1);
+	futexWake(&header->dataSeq);
+	header->spaceSeq.fetch_add(1);
+	futexWake(&header->spaceSeq);
+}
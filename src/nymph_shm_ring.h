@@ -0,0 +1,73 @@
+/*
+	nymph_shm_ring.h - header file for the NymphRPC Shared Memory Ring class.
+	
+	Revision 0
+	
+	Notes:
+			- Single-producer, single-consumer byte ring in shared memory, used
+				to send Nymph messages between processes on the same host.
+				Messages are written into the ring as a stream of frames, in
+				the same format as on a socket.
+			- Reader and writer wait on a futex in the ring header when the
+				ring is empty or full, optionally after spinning for a while.
+			- Either side can close the ring, which wakes up the other side.
+	
+	(c) Nyanko.ws
+*/
+
+
+#pragma once
+#ifndef NYMPH_SHM_RING_H
+#define NYMPH_SHM_RING_H
+
+#include <atomic>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+
+class NymphMessage;
+
+
+// Ring state shared between the processes. The writer and reader positions are
+// kept on separate cache lines.
+struct NymphShmRingHeader {
+	alignas(64) std::atomic<uint64_t> head;		// Total bytes written.
+	std::atomic<uint32_t> spaceSeq;				// Futex, changed when space was freed.
+	std::atomic<uint32_t> writerWaiting;
+	alignas(64) std::atomic<uint64_t> tail;		// Total bytes read.
+	std::atomic<uint32_t> dataSeq;				// Futex, changed when data was written.
+	std::atomic<uint32_t> readerWaiting;
+	alignas(64) uint64_t capacity;				// Size of the data area in bytes.
+	std::atomic<uint32_t> closed;
+};
+
+
+class NymphShmRing {
+	NymphShmRingHeader* header;
+	uint8_t* data;
+	uint64_t cap;	// Capacity, as the one in the shared header can be changed.
+	std::string loggerName = "NymphShmRing";
+	
+	static std::atomic<uint32_t> spinCount;
+	
+	bool waitForSpace(uint64_t head, uint32_t timeout);
+	bool waitForData(uint64_t tail, uint32_t timeout);
+	bool readFull(uint8_t* buffer, uint64_t length);
+	
+public:
+	NymphShmRing(void* memory, bool init, uint64_t capacity);
+	
+	static uint64_t size(uint64_t capacity);
+	static void setSpin(uint32_t iterations);
+	
+	bool write(const uint8_t* buffer, uint64_t length);
+	bool write(std::vector<NymphMessage*> &msgs, std::string &result);
+	int64_t read(uint8_t* buffer, uint64_t length, uint32_t timeout);
+	int readFrame(NymphMessage* &msg, uint32_t timeout);
+	uint64_t capacity() { return cap; }
+	bool isClosed() { return header->closed.load() != 0; }
+	void close();
+};
+
+#endif
@@ -0,0 +1,429 @@
+/*
+	nymph_simd.cpp - implementation file for the NymphRPC SIMD conversion kernels.
+
+	Revision 0
+
+	Notes:
+			- Kernels use unaligned loads and stores, as packed array data in a
+				message buffer has no particular alignment.
+			- Elements are assumed to be in the host's (little-endian) byte
+				order, as with all other NymphRPC types.
+
+	(c) Nyanko.ws
+*/
+
+
+#include "nymph_simd.h"
+
+#include <atomic>
+#include <limits>
+#include <type_traits>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define NYMPH_SIMD_X86
+#include <immintrin.h>
+#define NYMPH_TARGET_SSE2 __attribute__((target("sse2")))
+#define NYMPH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+using namespace std;
+
+
+typedef void (*ConvertFnc)(const void* src, void* dst, uint64_t count);
+
+
+// --- SATURATE ---
+// Converts a value to the destination type. Integers saturate at the limits of
+// the destination type, with NaN becoming zero.
+template<class D, class S>
+static inline D saturate(S v, true_type /* integral destination */) {
+	if (is_floating_point<S>::value) {
+		if (v != v) { return 0; }
+		if (v <= (S) numeric_limits<D>::min()) { return numeric_limits<D>::min(); }
+		if (v >= (S) numeric_limits<D>::max()) { return numeric_limits<D>::max(); }
+		return (D) v;
+	}
+
+	if (is_signed<S>::value && v < 0) {
+		if (!is_signed<D>::value) { return 0; }
+		if ((intmax_t) v < (intmax_t) numeric_limits<D>::min()) { return numeric_limits<D>::min(); }
+		return (D) v;
+	}
+
+	if ((uintmax_t) v > (uintmax_t) numeric_limits<D>::max()) { return numeric_limits<D>::max(); }
+	return (D) v;
+}
+
+
+template<class D, class S>
+static inline D saturate(S v, false_type /* floating point destination */) {
+	return (D) v;
+}
+
+
+// --- CONVERT SCALAR ---
+// Converts one element at a time. Used for the tail of the SIMD kernels, and
+// for all conversions without a kernel.
+template<class S, class D>
+static void convertScalar(const void* src, void* dst, uint64_t count) {
+	const uint8_t* s = (const uint8_t*) src;
+	uint8_t* d = (uint8_t*) dst;
+	for (uint64_t i = 0; i < count; ++i) {
+		S v;
+		memcpy(&v, s + (i * sizeof(S)), sizeof(S));
+		D r = saturate<D>(v, typename is_integral<D>::type());
+		memcpy(d + (i * sizeof(D)), &r, sizeof(D));
+	}
+}
+
+
+#ifdef NYMPH_SIMD_X86
+// --- SSE2 KERNELS ---
+NYMPH_TARGET_SSE2
+static void floatToDoubleSse2(const void* src, void* dst, uint64_t count) {
+	const float* s = (const float*) src;
+	double* d = (double*) dst;
+	uint64_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 a = _mm_loadu_ps(s + i);
+		_mm_storeu_pd(d + i, _mm_cvtps_pd(a));
+		_mm_storeu_pd(d + i + 2, _mm_cvtps_pd(_mm_movehl_ps(a, a)));
+	}
+
+	convertScalar<float, double>(s + i, d + i, count - i);
+}
+
+
+NYMPH_TARGET_SSE2
+static void doubleToFloatSse2(const void* src, void* dst, uint64_t count) {
+	const double* s = (const double*) src;
+	float* d = (float*) dst;
+	uint64_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(s + i));
+		__m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(s + i + 2));
+		_mm_storeu_ps(d + i, _mm_movelh_ps(lo, hi));
+	}
+
+	convertScalar<double, float>(s + i, d + i, count - i);
+}
+
+
+NYMPH_TARGET_SSE2
+static void int32ToFloatSse2(const void* src, void* dst, uint64_t count) {
+	const int32_t* s = (const int32_t*) src;
+	float* d = (float*) dst;
+	uint64_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i*) (s + i));
+		_mm_storeu_ps(d + i, _mm_cvtepi32_ps(a));
+	}
+
+	convertScalar<int32_t, float>(s + i, d + i, count - i);
+}
+
+
+NYMPH_TARGET_SSE2
+static void int32ToDoubleSse2(const void* src, void* dst, uint64_t count) {
+	const int32_t* s = (const int32_t*) src;
+	double* d = (double*) dst;
+	uint64_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i*) (s + i));
+		_mm_storeu_pd(d + i, _mm_cvtepi32_pd(a));
+		_mm_storeu_pd(d + i + 2, _mm_cvtepi32_pd(_mm_unpackhi_epi64(a, a)));
+	}
+
+	convertScalar<int32_t, double>(s + i, d + i, count - i);
+}
+
+
+NYMPH_TARGET_SSE2
+static void int16ToFloatSse2(const void* src, void* dst, uint64_t count) {
+	const int16_t* s = (const int16_t*) src;
+	float* d = (float*) dst;
+	uint64_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i*) (s + i));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16);
+		_mm_storeu_ps(d + i, _mm_cvtepi32_ps(lo));
+		_mm_storeu_ps(d + i + 4, _mm_cvtepi32_ps(hi));
+	}
+
+	convertScalar<int16_t, float>(s + i, d + i, count - i);
+}
+
+
+NYMPH_TARGET_SSE2
+static void uint8ToFloatSse2(const void* src, void* dst, uint64_t count) {
+	const uint8_t* s = (const uint8_t*) src;
+	float* d = (float*) dst;
+	const __m128i zero = _mm_setzero_si128();
+	uint64_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*) (s + i));
+		__m128i lo = _mm_unpacklo_epi8(a, zero);
+		__m128i hi = _mm_unpackhi_epi8(a, zero);
+		_mm_storeu_ps(d + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)));
+		_mm_storeu_ps(d + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)));
+		_mm_storeu_ps(d + i + 8, _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)));
+		_mm_storeu_ps(d + i + 12, _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)));
+	}
+
+	convertScalar<uint8_t, float>(s + i, d + i, count - i);
+}
+
+
+NYMPH_TARGET_SSE2
+static void int32ToInt16Sse2(const void* src, void* dst, uint64_t count) {
+	const int32_t* s = (const int32_t*) src;
+	int16_t* d = (int16_t*) dst;
+	uint64_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i*) (s + i));
+		__m128i b = _mm_loadu_si128((const __m128i*) (s + i + 4));
+		_mm_storeu_si128((__m128i*) (d + i), _mm_packs_epi32(a, b));
+	}
+
+	convertScalar<int32_t, int16_t>(s + i, d + i, count - i);
+}
+
+
+// --- AVX2 KERNELS ---
+NYMPH_TARGET_AVX2
+static void floatToDoubleAvx2(const void* src, void* dst, uint64_t count) {
+	const float* s = (const float*) src;
+	double* d = (double*) dst;
+	uint64_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 a = _mm256_loadu_ps(s + i);
+		_mm256_storeu_pd(d + i, _mm256_cvtps_pd(_mm256_castps256_ps128(a)));
+		_mm256_storeu_pd(d + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(a, 1)));
+	}
+
+	convertScalar<float, double>(s + i, d + i, count - i);
+}
+
+
+NYMPH_TARGET_AVX2
+static void doubleToFloatAvx2(const void* src, void* dst, uint64_t count) {
+	const double* s = (const double*) src;
+	float* d = (float*) dst;
+	uint64_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(s + i));
+		__m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(s + i + 4));
+		_mm256_storeu_ps(d + i, _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1));
+	}
+
+	convertScalar<double, float>(s + i, d + i, count - i);
+}
+
+
+NYMPH_TARGET_AVX2
+static void int32ToFloatAvx2(const void* src, void* dst, uint64_t count) {
+	const int32_t* s = (const int32_t*) src;
+	float* d = (float*) dst;
+	uint64_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i a = _mm256_loadu_si256((const __m256i*) (s + i));
+		_mm256_storeu_ps(d + i, _mm256_cvtepi32_ps(a));
+	}
+
+	convertScalar<int32_t, float>(s + i, d + i, count - i);
+}
+
+
+NYMPH_TARGET_AVX2
+static void int32ToDoubleAvx2(const void* src, void* dst, uint64_t count) {
+	const int32_t* s = (const int32_t*) src;
+	double* d = (double*) dst;
+	uint64_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i*) (s + i));
+		_mm256_storeu_pd(d + i, _mm256_cvtepi32_pd(a));
+	}
+
+	convertScalar<int32_t, double>(s + i, d + i, count - i);
+}
+
+
+NYMPH_TARGET_AVX2
+static void int16ToFloatAvx2(const void* src, void* dst, uint64_t count) {
+	const int16_t* s = (const int16_t*) src;
+	float* d = (float*) dst;
+	uint64_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i*) (s + i));
+		_mm256_storeu_ps(d + i, _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(a)));
+	}
+
+	convertScalar<int16_t, float>(s + i, d + i, count - i);
+}
+
+
+NYMPH_TARGET_AVX2
+static void uint8ToFloatAvx2(const void* src, void* dst, uint64_t count) {
+	const uint8_t* s = (const uint8_t*) src;
+	float* d = (float*) dst;
+	uint64_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_loadl_epi64((const __m128i*) (s + i));
+		_mm256_storeu_ps(d + i, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(a)));
+	}
+
+	convertScalar<uint8_t, float>(s + i, d + i, count - i);
+}
+
+
+NYMPH_TARGET_AVX2
+static void int32ToInt16Avx2(const void* src, void* dst, uint64_t count) {
+	const int32_t* s = (const int32_t*) src;
+	int16_t* d = (int16_t*) dst;
+	uint64_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i*) (s + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*) (s + i + 8));
+
+		// Packing works per 128-bit lane. Restore the element order after.
+		__m256i p = _mm256_packs_epi32(a, b);
+		_mm256_storeu_si256((__m256i*) (d + i), _mm256_permute4x64_epi64(p, 0xD8));
+	}
+
+	convertScalar<int32_t, int16_t>(s + i, d + i, count - i);
+}
+#endif
+
+
+// --- DETECT LEVEL ---
+static NymphSimdLevel detectLevel() {
+#ifdef NYMPH_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) { return NYMPH_SIMD_AVX2; }
+	if (__builtin_cpu_supports("sse2")) { return NYMPH_SIMD_SSE2; }
+#endif
+	return NYMPH_SIMD_SCALAR;
+}
+
+
+static atomic<int> simdLevel = { -1 };
+
+
+// --- LEVEL ---
+// Returns the instruction set used by the conversion kernels. It is detected on
+// first use.
+NymphSimdLevel NymphSimd::level() {
+	int l = simdLevel;
+	if (l < 0) {
+		l = detectLevel();
+		simdLevel = l;
+	}
+
+	return (NymphSimdLevel) l;
+}
+
+
+// --- SET LEVEL ---
+// Limits the instruction set used by the kernels, e.g. for benchmarking. A level
+// higher than what the CPU supports is ignored.
+void NymphSimd::setLevel(NymphSimdLevel level) {
+	NymphSimdLevel supported = detectLevel();
+	simdLevel = (level > supported) ? supported : level;
+}
+
+
+// --- SCALAR FOR ---
+// Returns the scalar conversion from S to the destination type.
+template<class S>
+static ConvertFnc scalarFor(NymphTypes to) {
+	switch (to) {
+		case NYMPH_UINT8:	return &convertScalar<S, uint8_t>;
+		case NYMPH_SINT8:	return &convertScalar<S, int8_t>;
+		case NYMPH_UINT16:	return &convertScalar<S, uint16_t>;
+		case NYMPH_SINT16:	return &convertScalar<S, int16_t>;
+		case NYMPH_UINT32:	return &convertScalar<S, uint32_t>;
+		case NYMPH_SINT32:	return &convertScalar<S, int32_t>;
+		case NYMPH_UINT64:	return &convertScalar<S, uint64_t>;
+		case NYMPH_SINT64:	return &convertScalar<S, int64_t>;
+		case NYMPH_FLOAT:	return &convertScalar<S, float>;
+		case NYMPH_DOUBLE:	return &convertScalar<S, double>;
+		default:			return 0;
+	}
+}
+
+
+// --- KERNEL FOR ---
+// Returns the SIMD kernel for the conversion at the current level, if any.
+static ConvertFnc kernelFor(NymphTypes from, NymphTypes to, NymphSimdLevel level) {
+#ifdef NYMPH_SIMD_X86
+	bool avx2 = (level >= NYMPH_SIMD_AVX2);
+	if (level < NYMPH_SIMD_SSE2) { return 0; }
+	if (from == NYMPH_FLOAT && to == NYMPH_DOUBLE) {
+		return avx2 ? &floatToDoubleAvx2 : &floatToDoubleSse2;
+	}
+
+	if (from == NYMPH_DOUBLE && to == NYMPH_FLOAT) {
+		return avx2 ? &doubleToFloatAvx2 : &doubleToFloatSse2;
+	}
+
+	if (from == NYMPH_SINT32 && to == NYMPH_FLOAT) {
+		return avx2 ? &int32ToFloatAvx2 : &int32ToFloatSse2;
+	}
+
+	if (from == NYMPH_SINT32 && to == NYMPH_DOUBLE) {
+		return avx2 ? &int32ToDoubleAvx2 : &int32ToDoubleSse2;
+	}
+
+	if (from == NYMPH_SINT16 && to == NYMPH_FLOAT) {
+		return avx2 ? &int16ToFloatAvx2 : &int16ToFloatSse2;
+	}
+
+	if (from == NYMPH_UINT8 && to == NYMPH_FLOAT) {
+		return avx2 ? &uint8ToFloatAvx2 : &uint8ToFloatSse2;
+	}
+
+	if (from == NYMPH_SINT32 && to == NYMPH_SINT16) {
+		return avx2 ? &int32ToInt16Avx2 : &int32ToInt16Sse2;
+	}
+#endif
+
+	return 0;
+}
+
+
+// --- CONVERT ---
+// Converts 'count' packed elements of type 'from' into elements of type 'to'.
+// Returns false if either type is not a packed array element type.
+bool NymphSimd::convert(NymphTypes from, const void* src, NymphTypes to, void* dst, uint64_t count) {
+	uint32_t size = NymphType::packedElementSize(from);
+	if (size == 0 || NymphType::packedElementSize(to) == 0) { return false; }
+	if (count == 0) { return true; }
+
+	// Same type: a plain copy.
+	if (from == to) {
+		memcpy(dst, src, count * size);
+		return true;
+	}
+
+	ConvertFnc fnc = kernelFor(from, to, level());
+	if (!fnc) {
+		switch (from) {
+			case NYMPH_UINT8:	fnc = scalarFor<uint8_t>(to);	break;
+			case NYMPH_SINT8:	fnc = scalarFor<int8_t>(to);	break;
+			case NYMPH_UINT16:	fnc = scalarFor<uint16_t>(to);	break;
+			case NYMPH_SINT16:	fnc = scalarFor<int16_t>(to);	break;
+			case NYMPH_UINT32:	fnc = scalarFor<uint32_t>(to);	break;
+			case NYMPH_SINT32:	fnc = scalarFor<int32_t>(to);	break;
+			case NYMPH_UINT64:	fnc = scalarFor<uint64_t>(to);	break;
+			case NYMPH_SINT64:	fnc = scalarFor<int64_t>(to);	break;
+			case NYMPH_FLOAT:	fnc = scalarFor<float>(to);		break;
+			case NYMPH_DOUBLE:	fnc = scalarFor<double>(to);	break;
+			default:			return false;
+		}
+	}
+
+	fnc(src, dst, count);
+	return true;
+}
@@ -0,0 +1,37 @@
+/*
+	nymph_simd.h - header file for the NymphRPC SIMD conversion kernels.
+	
+	Revision 0
+	
+	Notes:
+			- Converts packed array elements between numeric types. Common 
+				conversions use SSE2 or AVX2 kernels on x86, selected at runtime,
+				with a scalar fallback for all others.
+			- Conversions to a narrower integer type saturate.
+			
+	(c) Nyanko.ws
+*/
+
+
+#pragma once
+#ifndef NYMPH_SIMD_H
+#define NYMPH_SIMD_H
+
+#include "nymph_types.h"
+
+
+enum NymphSimdLevel {
+	NYMPH_SIMD_SCALAR = 0,
+	NYMPH_SIMD_SSE2,
+	NYMPH_SIMD_AVX2
+};
+
+
+class NymphSimd {
+public:
+	static NymphSimdLevel level();
+	static void setLevel(NymphSimdLevel level);
+	static bool convert(NymphTypes from, const void* src, NymphTypes to, void* dst, uint64_t count);
+};
+
+#endif
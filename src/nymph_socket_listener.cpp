@@ -17,7 +17,9 @@
 #include "nymph_logger.h"
 #include "nymph_listener.h"
 #include "dispatcher.h"
+#include "nymph_buffer_pool.h"
 #include "callback_request.h"
+#include "response_request.h"
 #include "remote_server.h"
 
 using namespace std;
@@ -38,8 +40,14 @@ NymphSocketListener::NymphSocketListener(NymphSocket socket, Condition* cnd, Mut
 	init = true;
 	this->nymphSocket = socket;
 	this->socket = socket.socket;
+	requests = socket.requests;
 	this->readyCond = cnd;
 	this->readyMutex = mtx;
+	reactor = 0;
+	fd = -1;
+	callbacks = make_shared<NymphCallbackQueue>();
+	callbacks->session = socket.handle;
+	callbacks->data = socket.data;
 }
 
 
@@ -51,11 +59,17 @@ NymphSocketListener::~NymphSocketListener() {
 
 // --- RUN ---
 void NymphSocketListener::run() {
+	if (nymphSocket.channel) {
+		runChannel();
+		return;
+	}
+	
 	Poco::Timespan timeout(0, 100); // 100 microsecond timeout
 	
 	NYMPH_LOG_INFORMATION("Start listening...");
 	
 	uint8_t headerBuff[8];
+	chrono::steady_clock::time_point lastExpiry = chrono::steady_clock::now();
 	while (listen) {
 		if (socket->poll(timeout, Net::Socket::SELECT_READ)) {
 			// Attempt to receive the entire message.
@@ -76,6 +90,20 @@ void NymphSocketListener::run() {
 			
 			uint32_t signature;
 			memcpy(&signature, &headerBuff, 4);
+			if (signature == nymphContinuationSignature || continuation.active()) {
+				// Part of a message which is too large for a single frame.
+				uint32_t frameLength = 0;
+				memcpy(&frameLength, (headerBuff + 4), 4);
+				NymphMessage* msg = 0;
+				if (!continuation.read(*socket, signature, frameLength, msg)) {
+					NYMPH_LOG_ERROR("Failed to read continuation frame. Terminating listener thread.");
+					break;
+				}
+				
+				if (msg) { handleMessage(msg); }
+				continue;
+			}
+			
 			if (signature != 0x4452474e) { // 'DRGN' ASCII in LE format.
 				// TODO: handle invalid header.
 				NYMPH_LOG_ERROR("Invalid header: 0x" + NumberFormatter::formatHex(signature));
@@ -88,7 +116,7 @@ void NymphSocketListener::run() {
 			
 			NYMPH_LOG_DEBUG("Message length: " + NumberFormatter::format(length) + " bytes.");
 			
-			uint8_t* buff = new uint8_t[length];
+			uint8_t* buff = NymphBufferPool::acquire(length);
 			
 			// Read the entire message into a string which is then used to
 			// construct an NymphMessage instance.
@@ -108,7 +136,8 @@ void NymphSocketListener::run() {
 						if (received == 0) {
 							// Remote disconnnected. Socket should be discarded.
 							NYMPH_LOG_INFORMATION("Received remote disconnected notice. Terminating listener thread.");
-							delete[] buff;
+							NymphBufferPool::release(buff, length);
+							buff = 0;
 							break;
 						}
 						else if (received != unread) {
@@ -127,61 +156,18 @@ void NymphSocketListener::run() {
 				NYMPH_LOG_DEBUG("Read " + NumberFormatter::format(received) + " bytes.");
 			}
 			
+			if (!buff) { break; } // Remote disconnected.
+			
 			// Parse the string into an NymphMessage instance.
 			// Buffer ownership is transferred to the message.
-			NymphMessage* msg = new NymphMessage(buff, length);
-			
-			// Check for good state on message.
-			if (msg->isCorrupt()) {
-				// Handle corrupted message.
-				NYMPH_LOG_WARNING("Corrupted message. Discarding it.");
-				delete msg;
-				continue;
-			}
-			
-			// The 'In Reply To' message ID in this message is now used to notify
-			// the waiting thread that a response has arrived, along with the
-			// received message.
-			uint64_t msgId = msg->getResponseId();
-			if (msg->isCallback()) {
-				NYMPH_LOG_INFORMATION("Callback received. Trying to find registered method.");
-				
-				// Dispatch a request to handle this callback.
-				CallbackRequest* req = new CallbackRequest;
-				req->setMessage(nymphSocket.handle, msg, nymphSocket.data);
-				Dispatcher::addRequest(req);
-				continue; // We're done with this request.
-			}
-			
-			NYMPH_LOG_DEBUG("Found message ID: " + NumberFormatter::format(msgId) + ".");
-			
-			messagesMutex.lock();
-			map<uint64_t, NymphRequest*>::iterator it;
-			it = messages.find(msgId);
-			if (it == messages.end()) {
-				// Message ID not found.
-				NYMPH_LOG_ERROR("Message ID " + NumberFormatter::format(msgId) + " not found.");
-				messagesMutex.unlock();
-				delete msg;
-				continue;
-			}
-			
-			NymphRequest* req = it->second;
-			req->mutex.lock();
-			if (msg->isReply()) { req->response = msg->getResponse(); }
-			else if (msg->isException())  {
-				req->exception = true;
-				req->response = 0;
-				req->exceptionData = msg->getException();
-			}				
-			else { req->response = 0; }
-			
-			req->condition.signal();
-			req->mutex.unlock();
-			
-			NYMPH_LOG_INFORMATION("Signalled condition for message ID " + NumberFormatter::format(msgId) + ".");
-			
-			messagesMutex.unlock();
+			handleMessage(new NymphMessage(buff, length, true));
+		}
+		
+		// Fail asynchronous requests which have passed their deadline.
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (now - lastExpiry >= chrono::milliseconds(100)) {
+			expireMessages();
+			lastExpiry = now;
 		}
 		
 		// Check whether we're still initialising.
@@ -198,50 +184,290 @@ void NymphSocketListener::run() {
 	
 	NYMPH_LOG_INFORMATION("Stopping thread...");
 	
+	finish(true);
+}
+
+
+// --- RUN CHANNEL ---
+// Receives messages through the shared memory channel. The socket is only 
+// checked to detect the remote disconnecting.
+void NymphSocketListener::runChannel() {
+	NYMPH_LOG_INFORMATION("Start listening on shared memory channel...");
+	
+	// Signal that this listener thread is ready.
+	readyMutex->lock();
+	readyCond->signal();
+	readyMutex->unlock();
+	init = false;
+	
+	NymphShmRing* ring = nymphSocket.channel->input();
+	chrono::steady_clock::time_point lastExpiry = chrono::steady_clock::now();
+	while (listen) {
+		NymphMessage* msg = 0;
+		int res = ring->readFrame(msg, 100);
+		if (res < 0) {
+			NYMPH_LOG_INFORMATION("Shared memory channel was closed. Terminating listener thread.");
+			break;
+		}
+		else if (res > 0) {
+			handleMessage(msg);
+		}
+		else if (NymphShmChannel::socketClosed(*socket)) {
+			NYMPH_LOG_INFORMATION("Received remote disconnected notice. Terminating listener thread.");
+			break;
+		}
+		
+		// Fail asynchronous requests which have passed their deadline.
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (now - lastExpiry >= chrono::milliseconds(100)) {
+			expireMessages();
+			lastExpiry = now;
+		}
+	}
+	
+	NYMPH_LOG_INFORMATION("Stopping thread...");
+	
+	finish(listen);
+}
+
+
+// --- HANDLE MESSAGE ---
+// Matches a received message with its request, or dispatches it as callback.
+void NymphSocketListener::handleMessage(NymphMessage* msg) {
+	// Check for good state on message.
+	if (msg->isCorrupt()) {
+		// Handle corrupted message.
+		NYMPH_LOG_WARNING("Corrupted message. Discarding it.");
+		delete msg;
+		return;
+	}
+	
+	// The replies in a batch message are handled like separately received ones.
+	if (msg->isBatch()) {
+		vector<NymphMessage*> msgs;
+		msgs.swap(msg->messages());
+		delete msg;
+		for (uint32_t i = 0; i < msgs.size(); ++i) {
+			handleMessage(msgs[i]);
+		}
+		
+		return;
+	}
+	
+	// The 'In Reply To' message ID in this message is now used to notify
+	// the waiting thread that a response has arrived, along with the
+	// received message.
+	uint64_t msgId = msg->getResponseId();
+	if (msg->isCallback()) {
+		NYMPH_LOG_INFORMATION("Callback received. Trying to find registered method.");
+		
+		// Dispatch a request to handle this callback. Ordered callbacks are
+		// queued for this connection, and called one after the other.
+		if (NymphListener::orderedCallbacks()) {
+			CallbackRequest::enqueue(callbacks, msg);
+			return;
+		}
+		
+		CallbackRequest* req = new CallbackRequest;
+		req->setMessage(nymphSocket.handle, msg, nymphSocket.data);
+		Dispatcher::addRequest(req);
+		return; // We're done with this request.
+	}
+	
+	if (msg->isChunk()) {
+		handleChunk(msg);
+		return;
+	}
+	
+	NYMPH_LOG_DEBUG("Found message ID: " + NumberFormatter::format(msgId) + ".");
+	
+	// Whoever takes the request out of the table owns it. If it is not found, 
+	// it has already timed out.
+	NymphRequest* req = requests->take(msgId);
+	if (!req) {
+		NYMPH_LOG_ERROR("Message ID " + NumberFormatter::format(msgId) + " not found.");
+		delete msg;
+		return;
+	}
+	
+	if (req->callback) {
+		// Asynchronous request. Nobody is waiting on its condition, so hand it
+		// to a worker thread to complete it.
+		completeAsync(req, msg, string());
+		return;
+	}
+	
+	req->mutex.lock();
+	if (msg->isReply()) { req->response = msg->getResponse(); }
+	else if (msg->isException())  {
+		req->exception = true;
+		req->response = 0;
+		req->exceptionData = msg->getException();
+	}				
+	else { req->response = 0; }
+	
+	// The waiting thread deletes the request once it has been signalled.
+	req->done = true;
+	req->condition.signal();
+	req->mutex.unlock();
+	
+	NYMPH_LOG_INFORMATION("Signalled condition for message ID " + NumberFormatter::format(msgId) + ".");
+}
+
+
+// --- FINISH ---
+// Cleans up once the socket is no longer being listened on. If 'disconnect' is
+// set, the connection is also removed from the RemoteServer.
+void NymphSocketListener::finish(bool disconnect) {
+	// No more replies will arrive. Fail any remaining asynchronous requests.
+	expireMessages(true);
+	
 	// Clean-up.
 	delete readyCond;
 	delete readyMutex;
 	
 	// Let the RemoteServer clean up the socket resources.
-	std::string result;
-	if (!NymphRemoteServer::disconnect(nymphSocket.handle, result)) {
-		NYMPH_LOG_ERROR("Failed to cleanly disconnect socket: " + result);
+	if (disconnect) {
+		std::string result;
+		if (!NymphRemoteServer::disconnect(nymphSocket.handle, result)) {
+			NYMPH_LOG_ERROR("Failed to cleanly disconnect socket: " + result);
+		}
 	}
 	
 	//nymphSocket.semaphore->wait();	// Wait for the connection to be closed.
 	delete socket;
+	delete nymphSocket.channel;
 	delete nymphSocket.semaphore;
 	nymphSocket.semaphore = 0;
 	delete this; // Call the destructor ourselves.
 }
 
 
+// --- ATTACH ---
+// Hand the socket to the reactor instead of running a listener thread for it.
+bool NymphSocketListener::attach(NymphReactor* reactor) {
+	this->reactor = reactor;
+	fd = socket->impl()->sockfd();
+	
+	NYMPH_LOG_INFORMATION("Start listening using reactor...");
+	
+	return reactor->add(fd, this);
+}
+
+
+// --- ON READABLE ---
+// Called by a reactor I/O thread when the socket has data available.
+bool NymphSocketListener::onReadable() {
+	vector<NymphMessage*> msgs;
+	bool open = reader.read(fd, msgs);
+	for (uint32_t i = 0; i < msgs.size(); ++i) {
+		handleMessage(msgs[i]);
+	}
+	
+	if (!open) {
+		NYMPH_LOG_INFORMATION("Received remote disconnected notice. Removing listener.");
+	}
+	
+	return open;
+}
+
+
+// --- ON CLOSED ---
+// Called once the reactor no longer monitors the socket. If the remote closed
+// the connection, it still has to be removed from the RemoteServer.
+void NymphSocketListener::onClosed() {
+	finish(listen);
+}
+
+
 // --- STOP ---
+// In reactor mode, the socket is removed from the reactor, which may clean up
+// this instance before returning.
 void NymphSocketListener::stop() {
 	listen = false;
+	if (reactor) { reactor->remove(fd); }
 }
 
 
-// --- ADD MESSAGE ---
-// Add a message this listener instance will be waiting for.
-bool NymphSocketListener::addMessage(NymphRequest* &request) {
-	messagesMutex.lock();
-	messages.insert(std::pair<UInt64, NymphRequest*>(request->messageId, request));
-	messagesMutex.unlock();
+// --- EXPIRE ---
+// Fails asynchronous requests which have passed their deadline. Called 
+// periodically in reactor mode.
+void NymphSocketListener::expire() {
+	expireMessages();
+}
+
+
+// --- HANDLE CHUNK ---
+// Passes a part of a streamed reply to the request's stream callback, on this
+// thread so that the parts are received in order. While the callback runs, no
+// further messages are read from this connection. With the reactor, this also
+// holds up the other connections handled by the same I/O thread. Each part 
+// extends the request's deadline.
+void NymphSocketListener::handleChunk(NymphMessage* msg) {
+	uint64_t msgId = msg->getResponseId();
+	NymphRequest* req = requests->borrow(msgId);
+	if (!req) {
+		NYMPH_LOG_ERROR("Message ID " + NumberFormatter::format(msgId) + " not found.");
+		msg->discard();
+		return;
+	}
+	
+	// The request is restored before running the callback, which may cancel 
+	// the call, so only a copy of the callback is used.
+	NymphStreamCallback stream = req->stream;
+	void* data = req->data;
+	int64_t deadline = 0;
+	if (stream) { req->deadline = chrono::steady_clock::now() + req->idleTimeout; }
+	if (req->callback) { deadline = req->deadline.time_since_epoch().count(); }
+	requests->restore(msgId, deadline);
 	
-	return true;
+	if (!stream) {
+		NYMPH_LOG_WARNING("Discarding reply part for message ID " + NumberFormatter::format(msgId) + ".");
+		msg->discard();
+		return;
+	}
+	
+	// A value which uses the message's memory keeps it alive until the receiver
+	// deletes it. Otherwise the message is no longer needed.
+	NymphType* value = msg->getResponse();
+	if (!msg->isReferenced()) { delete msg; }
+	stream(nymphSocket.handle, value, data);
 }
 
 
-// --- REMOVE MESSAGE ---
-bool NymphSocketListener::removeMessage(UInt64 messageId) {
-	messagesMutex.lock();
-	map<UInt64, NymphRequest*>::iterator it;
-	it = messages.find(messageId);
-	if (it == messages.end()) { messagesMutex.unlock(); return true; }
+// --- COMPLETE ASYNC ---
+// Completes an asynchronous request with either the received message, or the
+// provided error if no message is available. The completion callback is run on
+// a worker thread, which also takes ownership of the request.
+void NymphSocketListener::completeAsync(NymphRequest* request, NymphMessage* msg, string error) {
+	if (msg) {
+		if (msg->isReply()) { request->response = msg->getResponse(); }
+		else if (msg->isException()) {
+			request->exception = true;
+			request->exceptionData = msg->getException();
+			delete msg;
+		}
+		else { delete msg; }
+	}
 	
-	messages.erase(it);
-	messagesMutex.unlock();
+	ResponseRequest* rr = new ResponseRequest;
+	rr->setRequest(request, error);
+	Dispatcher::addRequest(rr);
+}
+
+
+// --- EXPIRE MESSAGES ---
+// Removes asynchronous requests whose deadline has passed and fails them. If 
+// 'all' is set, all asynchronous requests are failed, regardless of deadline.
+void NymphSocketListener::expireMessages(bool all) {
+	vector<NymphRequest*> expired;
+	int64_t now = chrono::steady_clock::now().time_since_epoch().count();
+	requests->expire(now, all, expired);
 	
-	return true;
+	for (uint32_t i = 0; i < expired.size(); ++i) {
+		NYMPH_LOG_WARNING("Asynchronous request for message ID " + 
+					NumberFormatter::format(expired[i]->messageId) + " failed.");
+		if (all) { completeAsync(expired[i], 0, "Connection was closed."); }
+		else { completeAsync(expired[i], 0, "Method call timed out while waiting for response."); }
+	}
 }
@@ -18,6 +18,11 @@
 #define NYMPH_SOCKET_LISTENER_H
 
 #include "nymph_message.h"
+#include "nymph_reactor.h"
+#include "nymph_frame_reader.h"
+#include "nymph_continuation.h"
+#include "nymph_request_table.h"
+#include "nymph_shm_channel.h"
 
 #ifdef NPOCO
 #include <npoco/Runnable.h>
@@ -34,6 +39,9 @@
 #include <map>
 #include <string>
 #include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
 
 // TYPES
 
@@ -42,40 +50,82 @@ struct NymphSocket {
 	Poco::Semaphore* semaphore;		// Signals when it's safe to delete the socket.
 	void* data;						// User data.
 	uint32_t handle;				// The Nymph internal socket handle.
+	std::shared_ptr<NymphRequestTable> requests;	// Requests awaiting a reply.
+	NymphShmChannel* channel = 0;	// Shared memory channel, if used.
 };
 
 
+// Result of an asynchronous method call, as passed to its completion callback.
+struct NymphAsyncResult {
+	bool success;			// True if a reply (not an exception) was received.
+	NymphType* value;		// The returned value. The receiver takes ownership.
+	std::string result;		// Error or exception description if not successful.
+};
+
+
+typedef std::function<void(uint32_t, NymphAsyncResult&, void*)> NymphAsyncCallback;
+
+
+// Receives each part of a streamed reply, along with the user data. The receiver
+// takes ownership of the value.
+typedef std::function<void(uint32_t, NymphType*, void*)> NymphStreamCallback;
+
+
 struct NymphRequest {
 	int handle;
-	uint64_t messageId;
+	uint64_t messageId = 0;
 	Poco::Mutex mutex;
 	Poco::Condition condition;
-	NymphType* response;
-	bool exception;
+	NymphType* response = 0;
+	bool exception = false;
 	NymphException exceptionData;
+	std::string error;				// Set if the request could not be sent.
+	NymphAsyncCallback callback;	// Completion callback. Only set for async requests.
+	void* data = 0;					// User data for the completion callback.
+	std::chrono::steady_clock::time_point deadline;	// Expiry time for async requests.
+	NymphStreamCallback stream;		// Receives streamed reply parts, if set.
+	std::chrono::milliseconds idleTimeout { 0 };	// Deadline extension per part.
+	bool upload = false;			// Set if the call is followed by upload parts.
+	bool done = false;				// Set under the mutex once completed.
 };
 
 // ---
 
 
-class NymphSocketListener : public Poco::Runnable {
+struct NymphCallbackQueue;
+
+
+class NymphSocketListener : public Poco::Runnable, public NymphReactorHandler {
 	std::string loggerName;
 	std::atomic<bool> listen;
 	NymphSocket nymphSocket;
 	Poco::Net::StreamSocket* socket;
-	std::map<uint64_t, NymphRequest*> messages;
-	Poco::Mutex messagesMutex;
+	std::shared_ptr<NymphRequestTable> requests;
 	bool init;
 	Poco::Condition* readyCond;
 	Poco::Mutex* readyMutex;
+	NymphReactor* reactor;
+	int fd;
+	NymphFrameReader reader;
+	NymphContinuation continuation;	// Message received as continuation frames.
+	std::shared_ptr<NymphCallbackQueue> callbacks;	// Ordered callbacks.
+	
+	void handleMessage(NymphMessage* msg);
+	void handleChunk(NymphMessage* msg);
+	void runChannel();
+	void finish(bool disconnect);
+	void completeAsync(NymphRequest* request, NymphMessage* msg, std::string error);
+	void expireMessages(bool all = false);
 	
 public:
 	NymphSocketListener(NymphSocket socket, Poco::Condition* cond, Poco::Mutex* mtx);
 	~NymphSocketListener();
 	void run();
+	bool attach(NymphReactor* reactor);
+	bool onReadable();
+	void onClosed();
 	void stop();
-	bool addMessage(NymphRequest* &request);
-	bool removeMessage(uint64_t messageId);
+	void expire();
 };
 
 #endif
@@ -0,0 +1,143 @@
+/*
+	nymph_socket_writer.cpp - implementation file for the NymphRPC Socket Writer class.
+	
+	Revision 0
+	
+	Notes:
+			- 
+			
+	(c) Nyanko.ws
+*/
+
+
+#include "nymph_socket_writer.h"
+#include "nymph_logger.h"
+
+#ifdef NPOCO
+#include <npoco/NumberFormatter.h>
+#else
+#include <Poco/NumberFormatter.h>
+#endif
+
+#if defined(__linux__) && !defined(NPOCO)
+#define NYMPH_SENDMSG
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <climits>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include <algorithm>
+
+using namespace Poco;
+using namespace std;
+
+
+// Static initialisations.
+string NymphSocketWriter::loggerName = "NymphSocketWriter";
+
+
+// --- WRITE ---
+// Send the serialised message on the socket. The caller is responsible for
+// serialising writes to the same socket.
+bool NymphSocketWriter::write(Net::StreamSocket &socket, NymphMessage &msg, string &result) {
+	vector<NymphMessage*> msgs(1, &msg);
+	return write(socket, msgs, result);
+}
+
+
+// Send multiple serialised messages, using as few system calls as possible.
+bool NymphSocketWriter::write(Net::StreamSocket &socket, vector<NymphMessage*> &msgs, string &result) {
+	vector<NymphBufferSegment> segs;
+	for (uint32_t i = 0; i < msgs.size(); ++i) {
+		vector<NymphBufferSegment> &ms = msgs[i]->segments();
+		if (ms.empty()) {
+			// Flat message buffer.
+			NymphBufferSegment seg;
+			seg.data = msgs[i]->buffer();
+			seg.length = msgs[i]->buffer_size();
+			segs.push_back(seg);
+		}
+		else { segs.insert(segs.end(), ms.begin(), ms.end()); }
+	}
+	
+#ifdef NYMPH_SENDMSG
+	// Send all segments with as few system calls as possible, continuing after
+	// partial writes.
+	int fd = socket.impl()->sockfd();
+	vector<struct iovec> iov(segs.size());
+	for (uint32_t i = 0; i < segs.size(); ++i) {
+		iov[i].iov_base = (void*) segs[i].data;
+		iov[i].iov_len = segs[i].length;
+	}
+	
+	uint64_t sent = 0;
+	uint32_t idx = 0;
+	while (idx < iov.size()) {
+		struct msghdr mh;
+		memset(&mh, 0, sizeof(mh));
+		mh.msg_iov = &iov[idx];
+		mh.msg_iovlen = iov.size() - idx;
+		if (mh.msg_iovlen > IOV_MAX) { mh.msg_iovlen = IOV_MAX; }
+		
+		ssize_t ret = sendmsg(fd, &mh, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR) { continue; }
+			result = "Failed to send message: " + string(strerror(errno));
+			return false;
+		}
+		
+		sent += ret;
+		
+		// Skip the segments which were fully sent.
+		size_t done = (size_t) ret;
+		while (idx < iov.size() && done >= iov[idx].iov_len) {
+			done -= iov[idx].iov_len;
+			idx++;
+		}
+		
+		if (idx < iov.size()) {
+			iov[idx].iov_base = (uint8_t*) iov[idx].iov_base + done;
+			iov[idx].iov_len -= done;
+		}
+	}
+	
+	NYMPH_LOG_DEBUG("Sent " + NumberFormatter::format(sent) + " bytes in " + 
+					NumberFormatter::format(segs.size()) + " segments.");
+#else
+	// Send each segment separately, in parts of at most 1 GB as the length
+	// passed to the socket is an int.
+	uint64_t sent = 0;
+	for (uint32_t i = 0; i < segs.size(); ++i) {
+#ifndef NPOCO
+		try {
+#endif
+			uint64_t done = 0;
+			while (done < segs[i].length) {
+				int part = (int) std::min<uint64_t>(segs[i].length - done, 1 << 30);
+				int ret = socket.sendBytes((const void*) (segs[i].data + done), part);
+				if (ret != part) {
+					result = "Failed to send message.";
+					return false;
+				}
+				
+				done += ret;
+			}
+			
+			sent += done;
+#ifndef NPOCO
+		}
+		catch (Poco::Exception &e) {
+			result = "Failed to send message: " + e.message();
+			return false;
+		}
+#endif
+	}
+	
+	NYMPH_LOG_DEBUG("Sent " + NumberFormatter::format(sent) + " bytes.");
+#endif
+	
+	return true;
+}
@@ -0,0 +1,40 @@
+/*
+	nymph_socket_writer.h - header file for the NymphRPC Socket Writer class.
+	
+	Revision 0
+	
+	Notes:
+			- Sends serialised messages. Messages serialised with vectored
+				serialisation are sent using a single scatter/gather call where
+				available, avoiding a copy of large values.
+			
+	(c) Nyanko.ws
+*/
+
+
+#pragma once
+#ifndef NYMPH_SOCKET_WRITER_H
+#define NYMPH_SOCKET_WRITER_H
+
+#include "nymph_message.h"
+
+#ifdef NPOCO
+#include <npoco/net/StreamSocket.h>
+#else
+#include <Poco/Net/StreamSocket.h>
+#endif
+
+#include <string>
+#include <vector>
+
+
+class NymphSocketWriter {
+	static std::string loggerName;
+	
+public:
+	static bool write(Poco::Net::StreamSocket &socket, NymphMessage &msg, std::string &result);
+	static bool write(Poco::Net::StreamSocket &socket, std::vector<NymphMessage*> &msgs, 
+																std::string &result);
+};
+
+#endif
@@ -18,6 +18,8 @@
 #include "nymph_utilities.h"
 #include "nymph_logger.h"
 #include "nymph_message.h"
+#include "nymph_arena.h"
+#include "nymph_simd.h"
 
 #include <sstream>
 #include <iostream>
@@ -76,7 +78,7 @@ NymphType::NymphType(float v) 		{ type = NYMPH_FLOAT;	length = 5;	data.fp32 = v;
 NymphType::NymphType(double v) 		{ type = NYMPH_DOUBLE;	length = 9; data.fp64 = v;		}
 
 
-NymphType::NymphType(char* v, uint32_t bytes, bool own) {
+NymphType::NymphType(char* v, uint64_t bytes, bool own) {
 	type = NYMPH_STRING;
 	length = binaryStringLength(bytes);
 	strLength = bytes;
@@ -133,42 +135,104 @@ NymphType::NymphType(std::map<std::string, NymphPair>* v, bool own) {
 }
 
 
+// Packed array of numeric values, stored contiguously in little-endian format.
+NymphType::NymphType(NymphTypes elementType, const void* v, uint64_t count, bool own) {
+	setValue(elementType, v, count, own);
+}
+
+
+// Converts the 'sourceType' elements into an owned packed array of 'elementType'.
+NymphType::NymphType(NymphTypes elementType, NymphTypes sourceType, const void* v, uint64_t count) {
+	uint8_t* buf = new uint8_t[count * packedElementSize(elementType) + 1];
+	if (!NymphSimd::convert(sourceType, v, elementType, buf, count)) {
+		NYMPH_LOG_ERROR("Invalid packed array conversion.");
+		count = 0;
+	}
+	
+	setValue(elementType, buf, count, true);
+}
+
+
+// --- REFERENCES MESSAGE ---
+// Returns whether parsed values of this type refer to their message's data.
+static bool referencesMessage(NymphTypes type) {
+	return (type == NYMPH_ARRAY || type == NYMPH_STRUCT || type == NYMPH_STRING || 
+			type == NYMPH_PACKED_ARRAY);
+}
+
+
+// --- PACKED TYPECODE ---
+// Returns the internal typecode for a packed array element type, or 0.
+static uint8_t packedTypecode(NymphTypes type) {
+	switch (type) {
+		case NYMPH_UINT8:	return NYMPH_TYPE_UINT8;
+		case NYMPH_SINT8:	return NYMPH_TYPE_SINT8;
+		case NYMPH_UINT16:	return NYMPH_TYPE_UINT16;
+		case NYMPH_SINT16:	return NYMPH_TYPE_SINT16;
+		case NYMPH_UINT32:	return NYMPH_TYPE_UINT32;
+		case NYMPH_SINT32:	return NYMPH_TYPE_SINT32;
+		case NYMPH_UINT64:	return NYMPH_TYPE_UINT64;
+		case NYMPH_SINT64:	return NYMPH_TYPE_SINT64;
+		case NYMPH_FLOAT:	return NYMPH_TYPE_FLOAT;
+		case NYMPH_DOUBLE:	return NYMPH_TYPE_DOUBLE;
+		default:			return 0;
+	}
+}
+
+
+// --- PACKED TYPE ---
+// Returns the element type for a packed array element typecode, or NYMPH_NULL.
+static NymphTypes packedType(uint8_t typecode) {
+	switch (typecode) {
+		case NYMPH_TYPE_UINT8:	return NYMPH_UINT8;
+		case NYMPH_TYPE_SINT8:	return NYMPH_SINT8;
+		case NYMPH_TYPE_UINT16:	return NYMPH_UINT16;
+		case NYMPH_TYPE_SINT16:	return NYMPH_SINT16;
+		case NYMPH_TYPE_UINT32:	return NYMPH_UINT32;
+		case NYMPH_TYPE_SINT32:	return NYMPH_SINT32;
+		case NYMPH_TYPE_UINT64:	return NYMPH_UINT64;
+		case NYMPH_TYPE_SINT64:	return NYMPH_SINT64;
+		case NYMPH_TYPE_FLOAT:	return NYMPH_FLOAT;
+		case NYMPH_TYPE_DOUBLE:	return NYMPH_DOUBLE;
+		default:				return NYMPH_NULL;
+	}
+}
+
+
+// --- RELEASE VALUE ---
+// Destroys a child value, which may have been created in a message's arena.
+static void releaseValue(NymphType* value, bool inArena) {
+	if (inArena) { value->~NymphType(); }
+	else { delete value; }
+}
+
+
 // --- DESTRUCTOR ---
 NymphType::~NymphType() {
 	if (type == NYMPH_ARRAY) {
-		if (linkedMsg) {
-			linkedMsg->decrementReferenceCount();
-		}
-		
 		if (own) {
 			// Delete the std::vector & contents as we own it.
 			for (int i = 0; i < data.vector->size(); i++) {
-				delete (*data.vector)[i];
+				releaseValue((*data.vector)[i], inArena);
 			}
 			
-			delete data.vector;
+			if (inArena) 	{ data.vector->~vector(); }
+			else 			{ delete data.vector; }
 		}
 	}
 	else if (type == NYMPH_STRUCT) {
-		if (linkedMsg) {
-			linkedMsg->decrementReferenceCount();
-		}
-		
 		if (own) {
 			std::map<std::string, NymphPair>::iterator it;
 			for (it = data.pairs->begin(); it != data.pairs->end(); it++) {
-				delete it->second.key;
-				delete it->second.value;
+				releaseValue(it->second.key, inArena);
+				releaseValue(it->second.value, inArena);
 			}
 			
-			delete data.pairs;
+			if (inArena) 	{ data.pairs->~map(); }
+			else 			{ delete data.pairs; }
 		}
 	}
 	else if (type == NYMPH_STRING) {
-		if (linkedMsg) {
-			linkedMsg->decrementReferenceCount();
-		}
-		
 		if (own) {
 			if (string == 0) {
 				delete data.chars;
@@ -178,6 +242,14 @@ NymphType::~NymphType() {
 			}
 		}
 	}
+	else if (type == NYMPH_PACKED_ARRAY) {
+		if (own) { delete[] (uint8_t*) data.any; }
+	}
+	
+	// Release the message last, as it may hold the memory of the child values.
+	if (linkedMsg && referencesMessage(type)) {
+		linkedMsg->decrementReferenceCount();
+	}
 }
 
 
@@ -208,6 +280,15 @@ std::map<std::string, NymphPair>* NymphType::getStruct(std::map<std::string, Nym
 }
 
 
+// --- GET PACKED VALUES ---
+// Copies the packed array elements into 'out', converted to the given type. 
+// The output buffer must have room for getPackedCount() elements.
+bool NymphType::getPackedValues(NymphTypes type, void* out) {
+	if (this->type != NYMPH_PACKED_ARRAY) { return false; }
+	return NymphSimd::convert(elementType, data.any, type, out, elementCount);
+}
+
+
 std::string NymphType::getString() {
 	return std::string(data.chars, strLength);
 }
@@ -238,7 +319,7 @@ void NymphType::setValue(float v) 		{ type = NYMPH_FLOAT;	length = 5; data.fp32
 void NymphType::setValue(double v) 		{ type = NYMPH_DOUBLE;	length = 9;	data.fp64 = v;		}
 
 
-void NymphType::setValue(char* v, uint32_t bytes, bool own) {
+void NymphType::setValue(char* v, uint64_t bytes, bool own) {
 	type = NYMPH_STRING;
 	length = binaryStringLength(bytes);
 	strLength = bytes;
@@ -294,8 +375,24 @@ void NymphType::setValue(std::map<std::string, NymphPair>* v, bool own) {
 }
 
 
+void NymphType::setValue(NymphTypes elementType, const void* v, uint64_t count, bool own) {
+	type = NYMPH_PACKED_ARRAY;
+	this->own = own;
+	this->elementType = elementType;
+	elementCount = count;
+	data.any = const_cast<void*>(v);
+	
+	// Typecode, element typecode & element count (uint64), plus the elements.
+	length = 10 + (count * packedElementSize(elementType));
+}
+
+
 // --- PARSE VALUE ---
-bool NymphType::parseValue(uint8_t typecode, uint8_t* binmsg, int &index) {
+// Parses the value at the index, in a buffer of 'bytes' bytes. If an arena is
+// provided, child values and containers are allocated in it, to be released 
+// along with the arena.
+bool NymphType::parseValue(uint8_t typecode, uint8_t* binmsg, uint64_t &index, uint64_t bytes, 
+																		NymphArena* arena) {
 	switch (typecode) {
         case NYMPH_TYPE_NULL:
 			NYMPH_LOG_DEBUG("NYMPH_TYPE_NONE");
@@ -452,7 +549,10 @@ bool NymphType::parseValue(uint8_t typecode, uint8_t* binmsg, int &index) {
 			NYMPH_LOG_DEBUG("Array size: " + NumberFormatter::format(numElements) + " elements.");
 			
 			// Create a vector and read the individual NymphTypes into it.
-			std::vector<NymphType*>* vec = new std::vector<NymphType*>();
+			std::vector<NymphType*>* vec;
+			if (arena) 	{ vec = arena->create<std::vector<NymphType*> >(); }
+			else 		{ vec = new std::vector<NymphType*>(); }
+			
 			vec->reserve(numElements);
 			
 			// Parse the elements.
@@ -460,8 +560,8 @@ bool NymphType::parseValue(uint8_t typecode, uint8_t* binmsg, int &index) {
 			for (uint64_t i = 0; i < numElements; ++i) {
 				NYMPH_LOG_TRACE("Parsing array index " + NumberFormatter::format(i) + " of " + NumberFormatter::format(numElements) + " elements - Index: " + NumberFormatter::format(index) + ".");
 				tc = *(binmsg + index++);
-				NymphType* elVal = new NymphType;
-				elVal->parseValue(tc, binmsg, index);
+				NymphType* elVal = arena ? arena->create<NymphType>() : new NymphType;
+				if (!elVal->parseValue(tc, binmsg, index, bytes, arena)) { return false; }
 				length += elVal->bytes();
 				vec->push_back(elVal);
 			}
@@ -472,6 +572,7 @@ bool NymphType::parseValue(uint8_t typecode, uint8_t* binmsg, int &index) {
 			}
 			
 			own = true;
+			inArena = (arena != 0);
 			type = NYMPH_ARRAY;
 			data.vector = vec;
 	
@@ -484,7 +585,9 @@ bool NymphType::parseValue(uint8_t typecode, uint8_t* binmsg, int &index) {
 			
 			std::string loggerName = "NymphTypes";
 			
-			std::map<std::string, NymphPair>* pairs = new std::map<std::string, NymphPair>();
+			std::map<std::string, NymphPair>* pairs;
+			if (arena) 	{ pairs = arena->create<std::map<std::string, NymphPair> >(); }
+			else 		{ pairs = new std::map<std::string, NymphPair>(); }
 	
 			// Read pairs until NONE type has been found.
 			// FIXME: check that we're not running out of bytes to read.
@@ -492,11 +595,11 @@ bool NymphType::parseValue(uint8_t typecode, uint8_t* binmsg, int &index) {
 				if (*(binmsg + index) != NYMPH_TYPE_STRING) { return false; }
 				uint8_t tc = *(binmsg + index++);
 				NymphPair p;
-				p.key = new NymphType;
-				p.value = new NymphType;
-				if (!p.key->parseValue(tc, binmsg, index)) { return false; }
+				p.key = arena ? arena->create<NymphType>() : new NymphType;
+				p.value = arena ? arena->create<NymphType>() : new NymphType;
+				if (!p.key->parseValue(tc, binmsg, index, bytes, arena)) { return false; }
 				tc = *(binmsg + index++);
-				if (!p.value->parseValue(tc, binmsg, index)) { return false; }
+				if (!p.value->parseValue(tc, binmsg, index, bytes, arena)) { return false; }
 				
 				length += p.key->bytes();
 				length += p.value->bytes();
@@ -509,6 +612,7 @@ bool NymphType::parseValue(uint8_t typecode, uint8_t* binmsg, int &index) {
 			
 			//value.setValue(pairs, true);
 			own = true;
+			inArena = (arena != 0);
 			type = NYMPH_STRUCT;
 			data.pairs = pairs;
 	
@@ -517,6 +621,36 @@ bool NymphType::parseValue(uint8_t typecode, uint8_t* binmsg, int &index) {
 			
 			break;
 		}
+		case NYMPH_TYPE_PACKED_ARRAY: {
+			NYMPH_LOG_DEBUG("NYMPH_TYPE_PACKED_ARRAY");
+			if (index >= bytes || bytes - index < 9) {
+				NYMPH_LOG_ERROR("Packed array header exceeds the message.");
+				return false;
+			}
+			
+			NymphTypes et = packedType(*(binmsg + index));
+			index++;
+			if (et == NYMPH_NULL) {
+				NYMPH_LOG_ERROR("Invalid packed array element type.");
+				return false;
+			}
+			
+			uint64_t count;
+			memcpy(&count, (binmsg + index), 8);
+			index += 8;
+			
+			// Reject elements which run past the end of the message. The views
+			// and conversions of the elements read them in place.
+			if (count > (bytes - index) / packedElementSize(et)) {
+				NYMPH_LOG_ERROR("Packed array elements exceed the message.");
+				return false;
+			}
+			
+			// The elements are referenced in the message buffer.
+			setValue(et, (binmsg + index), count, false);
+			index += count * packedElementSize(et);
+			break;
+		}
         default:
 			NYMPH_LOG_DEBUG("Default case. And nothing happened.");
     }
@@ -525,6 +659,17 @@ bool NymphType::parseValue(uint8_t typecode, uint8_t* binmsg, int &index) {
 }
 
 
+// Parses the value at a 32-bit index, as in earlier versions of this API. The
+// length of the buffer is not known here, so packed arrays are not checked 
+// against it. New code should pass the length.
+bool NymphType::parseValue(uint8_t typecode, uint8_t* binmsg, int &index) {
+	uint64_t pos = index;
+	bool ret = parseValue(typecode, binmsg, pos, UINT64_MAX);
+	index = (int) pos;
+	return ret;
+}
+
+
 
 
 // --- BYTES ---
@@ -534,13 +679,63 @@ uint64_t NymphType::bytes() {
 }
 
 
+// --- REFERENCED BYTES ---
+// Return the number of bytes which vectored serialisation references in place
+// rather than copying, for the provided string size threshold.
+uint64_t NymphType::referencedBytes(uint32_t threshold) {
+	uint64_t total = 0;
+	if (type == NYMPH_STRING) {
+		if (!emptyString && strLength >= threshold) { total = strLength; }
+	}
+	else if (type == NYMPH_ARRAY) {
+		vector<NymphType*>::iterator it;
+		for (it = data.vector->begin(); it != data.vector->end(); ++it) {
+			total += (*it)->referencedBytes(threshold);
+		}
+	}
+	else if (type == NYMPH_STRUCT) {
+		std::map<std::string, NymphPair>::iterator it;
+		for (it = data.pairs->begin(); it != data.pairs->end(); it++) {
+			total += it->second.key->referencedBytes(threshold);
+			total += it->second.value->referencedBytes(threshold);
+		}
+	}
+	else if (type == NYMPH_PACKED_ARRAY) {
+		uint64_t bytes = elementCount * packedElementSize(elementType);
+		if (bytes > 0 && bytes >= threshold) { total = bytes; }
+	}
+	
+	return total;
+}
+
+
 // --- STRING LENGTH ---
 // Returns the length of a string (if NYMPH_STRING type or equivalent).
-uint32_t NymphType::string_length() {
+uint64_t NymphType::string_length() {
 	return strLength;
 }
 
 
+// --- PACKED ELEMENT SIZE ---
+// Returns the size in bytes of a packed array element type, or 0 if the type
+// can not be packed.
+uint32_t NymphType::packedElementSize(NymphTypes type) {
+	switch (type) {
+		case NYMPH_UINT8:
+		case NYMPH_SINT8:	return 1;
+		case NYMPH_UINT16:
+		case NYMPH_SINT16:	return 2;
+		case NYMPH_UINT32:
+		case NYMPH_SINT32:
+		case NYMPH_FLOAT:	return 4;
+		case NYMPH_UINT64:
+		case NYMPH_SINT64:
+		case NYMPH_DOUBLE:	return 8;
+		default:			return 0;
+	}
+}
+
+
 // --- VALUE TYPE ---
 // Return the stored type.
 NymphTypes NymphType::valuetype() {
@@ -549,7 +744,9 @@ NymphTypes NymphType::valuetype() {
 
 
 // --- SERIALIZE ---
-void NymphType::serialize(uint8_t* &index) {
+// Serialise the value at the index, which is advanced past it. If 'segments' is
+// provided, large strings are added to it by reference instead of being copied.
+void NymphType::serialize(uint8_t* &index, NymphSegments* segments) {
 	if (type == NYMPH_ANY) {
 		// ?
 	}
@@ -564,7 +761,7 @@ void NymphType::serialize(uint8_t* &index) {
 		
 		vector<NymphType*>::iterator it;
 		for (it = data.vector->begin(); it != data.vector->end(); ++it) {
-			(*it)->serialize(index);
+			(*it)->serialize(index, segments);
 		}
 		
 		typecode = NYMPH_TYPE_NONE;
@@ -708,8 +905,22 @@ void NymphType::serialize(uint8_t* &index) {
 			}
 		}
 		
-		memcpy(index, (uint8_t*) data.chars, strLength);
-		index += strLength;
+		if (segments && !emptyString && strLength >= segments->threshold) {
+			// End the current local segment and reference the string data.
+			NymphBufferSegment seg;
+			seg.data = segments->start;
+			seg.length = index - segments->start;
+			segments->list.push_back(seg);
+			seg.data = (const uint8_t*) data.chars;
+			seg.length = strLength;
+			segments->list.push_back(seg);
+			segments->start = index;
+			if (!own && !linkedMsg) { segments->external = true; }
+		}
+		else {
+			memcpy(index, (uint8_t*) data.chars, strLength);
+			index += strLength;
+		}
 	}
 	else if (type == NYMPH_STRUCT) {
 		uint8_t typecode = NYMPH_TYPE_STRUCT;
@@ -718,14 +929,42 @@ void NymphType::serialize(uint8_t* &index) {
 		
 		std::map<std::string, NymphPair>::iterator it;
 		for (it = data.pairs->begin(); it != data.pairs->end(); it++) {
-			it->second.key->serialize(index);
-			it->second.value->serialize(index);
+			it->second.key->serialize(index, segments);
+			it->second.value->serialize(index, segments);
 		}
 		
 		typecode = NYMPH_TYPE_NONE;
 		*index = typecode;
 		index++;
 	}
+	else if (type == NYMPH_PACKED_ARRAY) {
+		*index = NYMPH_TYPE_PACKED_ARRAY;
+		index++;
+		*index = packedTypecode(elementType);
+		index++;
+		
+		memcpy(index, &elementCount, 8);
+		index += 8;
+		
+		// The elements are stored in little-endian format, see the constructor.
+		uint64_t bytes = elementCount * packedElementSize(elementType);
+		if (segments && bytes > 0 && bytes >= segments->threshold) {
+			// Reference the elements where they are stored.
+			NymphBufferSegment seg;
+			seg.data = segments->start;
+			seg.length = index - segments->start;
+			segments->list.push_back(seg);
+			seg.data = (const uint8_t*) data.any;
+			seg.length = bytes;
+			segments->list.push_back(seg);
+			segments->start = index;
+			if (!own && !linkedMsg) { segments->external = true; }
+		}
+		else if (bytes > 0) {
+			memcpy(index, data.any, bytes);
+			index += bytes;
+		}
+	}
 	else {
 		// World ends.
 	}
@@ -745,13 +984,7 @@ void NymphType::linkWithMessage(NymphMessage* msg) {
 void NymphType::triggerAddRC() {
 	if (!linkedMsg) { return; }
 	
-	if (type == NYMPH_ARRAY) {
-		linkedMsg->addReferenceCount();
-	}
-	else if (type == NYMPH_STRUCT) {
-		linkedMsg->addReferenceCount();
-	}
-	else if (type == NYMPH_STRING) {
+	if (referencesMessage(type)) {
 		linkedMsg->addReferenceCount();
 	}
 }
@@ -762,13 +995,7 @@ void NymphType::triggerAddRC() {
 void NymphType::discard() {
 	if (!linkedMsg) { return; }
 	
-	if (type == NYMPH_ARRAY) {
-		linkedMsg->decrementReferenceCount();
-	}
-	else if (type == NYMPH_STRUCT) {
-		linkedMsg->decrementReferenceCount();
-	}
-	else if (type == NYMPH_STRING) {
+	if (referencesMessage(type)) {
 		linkedMsg->decrementReferenceCount();
 	}
 }
@@ -28,9 +28,11 @@
 #include <map>
 #include <vector>
 #include <cstdint>
+#include <cstring>
 
 
 class NymphMessage;
+class NymphArena;
 
 
 enum NymphInternalTypes {
@@ -52,7 +54,8 @@ enum NymphInternalTypes {
     NYMPH_TYPE_EMPTY_STRING  	= 0x0f,
     NYMPH_TYPE_STRING        	= 0x10,
     NYMPH_TYPE_STRUCT        	= 0x11,
-    NYMPH_TYPE_VOID           	= 0x12
+    NYMPH_TYPE_VOID           	= 0x12,
+	NYMPH_TYPE_PACKED_ARRAY		= 0x13
 };
 
 
@@ -74,13 +77,55 @@ enum NymphTypes {
 	NYMPH_DOUBLE,
 	NYMPH_STRING,
 	NYMPH_STRUCT,
-	NYMPH_ANY
+	NYMPH_ANY,
+	NYMPH_PACKED_ARRAY
 };
 
 
 struct NymphPair;
 
 
+// Read-only view of the elements of a packed array, without copying them.
+// Elements are read using memcpy, as the data may not be aligned.
+template<class T>
+class NymphSpan {
+	const uint8_t* ptr;
+	uint64_t count;
+	
+public:
+	NymphSpan(const void* data = 0, uint64_t count = 0) : ptr((const uint8_t*) data), count(count) { }
+	
+	uint64_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	const void* data() const { return ptr; }
+	
+	T operator[](uint64_t i) const {
+		T v;
+		memcpy(&v, ptr + (i * sizeof(T)), sizeof(T));
+		return v;
+	}
+	
+	void copyTo(T* out) const { if (count) { memcpy(out, ptr, count * sizeof(T)); } }
+};
+
+
+// A block of serialised message data, used for scatter/gather sending.
+struct NymphBufferSegment {
+	const uint8_t* data;
+	uint64_t length;
+};
+
+
+// Output of vectored serialisation. String values of at least 'threshold' 
+// bytes are referenced in place instead of being copied into the local buffer.
+struct NymphSegments {
+	std::vector<NymphBufferSegment> list;
+	uint8_t* start = 0;			// Start of local buffer data not yet in the list.
+	uint32_t threshold = 4096;
+	bool external = false;		// Set if a segment references memory of the caller.
+};
+
+
 class NymphType {
 	NymphTypes type = NYMPH_NULL;
 	union DataUnion {
@@ -103,9 +148,12 @@ class NymphType {
 	
 	DataUnion data;
 	uint64_t length;			// Length of serialised value in bytes.
-	uint32_t strLength;			// String length (for NYMPH_STRING).
+	uint64_t strLength;			// String length (for NYMPH_STRING).
 	bool emptyString = false;	// Indicates whether a NYMPH_STRING is empty.
 	bool own = false;
+	bool inArena = false;		// Container & child values are in an arena.
+	NymphTypes elementType = NYMPH_NULL;	// Element type (for NYMPH_PACKED_ARRAY).
+	uint64_t elementCount = 0;				// Element count (for NYMPH_PACKED_ARRAY).
 	std::string* string = 0;
 	NymphMessage* linkedMsg = 0;
 	static std::string loggerName;
@@ -123,11 +171,19 @@ public:
 	NymphType(int64_t v);
 	NymphType(float v);
 	NymphType(double v);
-	NymphType(char* v, uint32_t bytes, bool own = false);
+	NymphType(char* v, uint64_t bytes, bool own = false);
 	NymphType(std::string* v, bool own = false);
 	NymphType(std::vector<NymphType*>* v, bool own = false);
 	NymphType(std::map<std::string, NymphPair>* v, bool own = false);
 	
+	// Packed array of 'count' elements. The elements must be stored in 
+	// little-endian format, which is the byte order of the protocol. They are
+	// sent as stored, without conversion. The second form converts the elements
+	// from 'sourceType' into an owned packed array.
+	NymphType(NymphTypes elementType, const void* v, uint64_t count, bool own = false);
+	NymphType(NymphTypes elementType, NymphTypes sourceType, const void* v, uint64_t count);
+	
+	
 	~NymphType();
 	
 	bool getBool(bool* v = 0);
@@ -145,6 +201,21 @@ public:
 	std::vector<NymphType*>* getArray(std::vector<NymphType*>* v = 0);
 	std::map<std::string, NymphPair>* getStruct(std::map<std::string, NymphPair>* v = 0);
 	
+	NymphTypes getPackedType() { return elementType; }
+	uint64_t getPackedCount() { return elementCount; }
+	const void* getPackedData() { return data.any; }
+	bool getPackedValues(NymphTypes type, void* out);
+	
+	// Returns an empty span if T does not match the size of the element type.
+	template<class T>
+	NymphSpan<T> getSpan() {
+		if (type != NYMPH_PACKED_ARRAY || sizeof(T) != packedElementSize(elementType)) {
+			return NymphSpan<T>();
+		}
+		
+		return NymphSpan<T>(data.any, elementCount);
+	}
+	
 	std::string getString();
 	bool getStructValue(std::string key, NymphType* &value);
 	
@@ -159,18 +230,23 @@ public:
 	void setValue(int64_t v);
 	void setValue(float v);
 	void setValue(double v);
-	void setValue(char* v, uint32_t bytes, bool own = false);
+	void setValue(char* v, uint64_t bytes, bool own = false);
 	void setValue(std::string* v, bool own = false);
 	void setValue(std::vector<NymphType*>* v, bool own = false);
 	void setValue(std::map<std::string, NymphPair>* v, bool own = false);
+	void setValue(NymphTypes elementType, const void* v, uint64_t count, bool own = false);
 	
+	bool parseValue(uint8_t typecode, uint8_t* binmsg, uint64_t &index, uint64_t bytes, 
+																	NymphArena* arena = 0);
 	bool parseValue(uint8_t typecode, uint8_t* binmsg, int &index);
 	
 	uint64_t bytes();
-	uint32_t string_length();
+	uint64_t referencedBytes(uint32_t threshold);
+	uint64_t string_length();
 	NymphTypes valuetype();
+	static uint32_t packedElementSize(NymphTypes type);
 	
-	void serialize(uint8_t* &index);
+	void serialize(uint8_t* &index, NymphSegments* segments = 0);
 	
 	void linkWithMessage(NymphMessage* msg);
 	void triggerAddRC();
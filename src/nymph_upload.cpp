@@ -0,0 +1,144 @@
+/*
+	nymph_upload.cpp - implementation file for the NymphRPC Upload Reader class.
+	
+	Revision 0
+	
+	Notes:
+			- Each queued part is the received message, holding one value.
+	
+	(c) Nyanko.ws
+*/
+
+
+#include "nymph_upload.h"
+#include "nymph_message.h"
+
+#include <chrono>
+
+using namespace std;
+
+
+// Static initialisations.
+atomic<uint32_t> NymphUploadReader::queueLimit = { 4 };
+
+
+// --- DECONSTRUCTOR ---
+NymphUploadReader::~NymphUploadReader() {
+	for (uint32_t i = 0; i < parts.size(); ++i) {
+		parts[i]->discard();
+	}
+	
+	if (onSpace) { onSpace(); }
+}
+
+
+// --- SET QUEUE LIMIT ---
+// Sets the number of received parts each upload holds before the receiving
+// thread waits for the method to read them.
+void NymphUploadReader::setQueueLimit(uint32_t parts) {
+	if (parts > 0) { queueLimit = parts; }
+}
+
+
+// --- READ ---
+// Returns the next part of the upload in 'value', which is owned by the caller.
+// Once all parts have been read, 'value' is set to 0. Fails if no part arrived
+// within the timeout (in milliseconds, 0 to wait indefinitely), or once the 
+// call was cancelled or the client disconnected.
+bool NymphUploadReader::read(NymphType* &value, string &result, uint32_t timeout) {
+	value = 0;
+	unique_lock<mutex> ulock(mtx);
+	auto ready = [this] { return !parts.empty() || ended || closed; };
+	if (timeout == 0) { cv.wait(ulock, ready); }
+	else if (!cv.wait_for(ulock, chrono::milliseconds(timeout), ready)) {
+		result = "Timed out waiting for upload part.";
+		return false;
+	}
+	
+	if (closed) {
+		result = "Upload was aborted.";
+		return false;
+	}
+	
+	if (parts.empty()) { return true; } // All parts have been read.
+	
+	NymphMessage* part = parts.front();
+	parts.pop_front();
+	function<void()> resume;
+	if (onSpace && parts.size() < queueLimit) { resume.swap(onSpace); }
+	ulock.unlock();
+	cv.notify_all();
+	if (resume) { resume(); }
+	
+	// A value which uses the message's memory keeps it alive until deleted.
+	value = part->getResponse();
+	if (!part->isReferenced()) { delete part; }
+	
+	return true;
+}
+
+
+// --- PUSH ---
+// Adds a received part and takes ownership of it. Waits while the queue is 
+// full. Returns false if the upload was closed, in which case the part is 
+// deleted.
+bool NymphUploadReader::push(NymphMessage* part) {
+	unique_lock<mutex> ulock(mtx);
+	cv.wait(ulock, [this] { return parts.size() < queueLimit || closed; });
+	if (closed) {
+		ulock.unlock();
+		part->discard();
+		return false;
+	}
+	
+	parts.push_back(part);
+	ulock.unlock();
+	cv.notify_all();
+	return true;
+}
+
+
+// --- ADD ---
+// Adds a received part and takes ownership of it, without waiting. Returns false
+// if the queue is full, in which case the receiver should stop reading until 
+// 'resume' is called, once a part has been read or the upload was closed. The 
+// part is deleted if the upload was closed.
+bool NymphUploadReader::add(NymphMessage* part, function<void()> resume) {
+	unique_lock<mutex> ulock(mtx);
+	if (closed) {
+		ulock.unlock();
+		part->discard();
+		return true;
+	}
+	
+	parts.push_back(part);
+	bool full = (parts.size() >= queueLimit && !onSpace);
+	if (full) { onSpace = resume; }
+	ulock.unlock();
+	cv.notify_all();
+	return !full;
+}
+
+
+// --- END ---
+// Marks the end of the upload. Parts already received can still be read.
+void NymphUploadReader::end() {
+	mtx.lock();
+	ended = true;
+	mtx.unlock();
+	cv.notify_all();
+}
+
+
+// --- CLOSE ---
+// Aborts the upload, waking up both the reading and receiving thread. Further
+// parts are discarded.
+void NymphUploadReader::close() {
+	mtx.lock();
+	closed = true;
+	function<void()> resume;
+	resume.swap(onSpace);
+	mtx.unlock();
+	cv.notify_all();
+	if (resume) { resume(); }
+}
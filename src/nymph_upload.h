@@ -0,0 +1,61 @@
+/*
+	nymph_upload.h - header file for the NymphRPC Upload Reader class.
+	
+	Revision 0
+	
+	Notes:
+			- Passes the parts of an upload from the session receiving them to
+				the method handling the call, which runs on the worker pool.
+			- At most the queue limit of parts is held. Beyond it, the thread
+				receiving the parts waits, which stops reading from the 
+				connection until the method has caught up. A reactor thread
+				instead pauses reading from the socket, see add().
+	
+	(c) Nyanko.ws
+*/
+
+
+#pragma once
+#ifndef NYMPH_UPLOAD_H
+#define NYMPH_UPLOAD_H
+
+#include "nymph_types.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <string>
+
+
+class NymphMessage;
+
+
+class NymphUploadReader {
+	std::deque<NymphMessage*> parts;
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool ended = false;
+	bool closed = false;
+	std::function<void()> onSpace;	// Set while the receiver is paused.
+	
+	static std::atomic<uint32_t> queueLimit;
+	
+	NymphUploadReader(const NymphUploadReader&);
+	NymphUploadReader& operator=(const NymphUploadReader&);
+	
+public:
+	NymphUploadReader() { }
+	~NymphUploadReader();
+	
+	bool read(NymphType* &value, std::string &result, uint32_t timeout = 0);
+	bool push(NymphMessage* part);
+	bool add(NymphMessage* part, std::function<void()> resume);
+	void end();
+	void close();
+	
+	static void setQueueLimit(uint32_t parts);
+};
+
+#endif
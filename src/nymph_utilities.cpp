@@ -38,16 +38,11 @@ using namespace Poco;
 
 
 // Static initialisations.
-Int64 NymphUtilities::messageId = 1;
-Mutex NymphUtilities::idMutex;
+std::atomic<int64_t> NymphUtilities::messageId = { 1 };
 string NymphUtilities::loggerName = "NymphUtilities";
 
 
 // --- GET MESSAGE ID ---
 Int64 NymphUtilities::getMessageId() {
-	Int64 temp;
-	idMutex.lock();
-	temp = messageId++;
-	idMutex.unlock();
-	return temp;
+	return messageId.fetch_add(1, std::memory_order_relaxed);
 }
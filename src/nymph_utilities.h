@@ -29,10 +29,10 @@
 #endif
 
 #include <string>
+#include <atomic>
 
 class NymphUtilities {
-	static int64_t messageId;
-	static Poco::Mutex idMutex;	
+	static std::atomic<int64_t> messageId;
 	static std::string loggerName;
 	
 public:
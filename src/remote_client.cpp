@@ -36,8 +36,6 @@ Poco::Mutex NymphRemoteClient::callbacksMutex;
 Poco::Mutex NymphRemoteClient::sessionsMutex;
 long NymphRemoteClient::timeout = 3000;
 UInt32 NymphRemoteClient::nextMethodId = 0;
-bool NymphRemoteClient::synced = false;
-string NymphRemoteClient::serializedMethods;
 string NymphRemoteClient::loggerName = "NymphRemoteClient";
 map<int, NymphSession*> NymphRemoteClient::sessions;
 
@@ -49,17 +47,33 @@ map<string, NymphMethod>& NymphRemoteClient::callbacks() {
 }
 
 
-// -- METHODS ---
-map<string, NymphMethod>& NymphRemoteClient::methods() {
-	static map<string, NymphMethod>* methodsStatic = new map<string, NymphMethod>();
-	return *methodsStatic;
+// --- REGISTRY ---
+shared_ptr<NymphMethodRegistry>& NymphRemoteClient::registry() {
+	static shared_ptr<NymphMethodRegistry>* registryStatic = 
+								new shared_ptr<NymphMethodRegistry>(new NymphMethodRegistry);
+	return *registryStatic;
 }
 
 
-// --- METHODS HASHES ---
-map<UInt32, NymphMethod*>& NymphRemoteClient::methodsIds() {
-	static map<UInt32, NymphMethod*>* methodsIdsStatic = new map<UInt32, NymphMethod*>();
-	return *methodsIdsStatic;
+// --- METHODS ---
+// Returns the current snapshot of the registered methods.
+shared_ptr<NymphMethodRegistry> NymphRemoteClient::methods() {
+	return atomic_load(&registry());
+}
+
+
+// --- PUBLISH ---
+// Replaces the methods snapshot. Expects the methods mutex to be held.
+void NymphRemoteClient::publish(shared_ptr<NymphMethodRegistry> methods) {
+	// Create updated serialized methods table.
+	methods->serialized = "METHODS";
+	UInt32 size = (UInt32) methods->methods.size();
+	methods->serialized += string(((char*) &size), 4);
+	for (uint32_t i = 0; i < methods->ids.size(); ++i) {
+		if (methods->ids[i]) { methods->serialized += methods->ids[i]->getSerialized(); }
+	}
+	
+	atomic_store(&registry(), methods);
 }
 
 
@@ -68,24 +82,10 @@ map<UInt32, NymphMethod*>& NymphRemoteClient::methodsIds() {
 // the list of custom methods.
 NymphMessage* NymphRemoteClient::syncMethods(int session, NymphMessage* msg, void* data) {
 	NYMPH_LOG_DEBUG("Sync method called by client...");
-	if (!synced) {
-		// Create updated serialized methods table.
-		static map<UInt32, NymphMethod*> &methodsIdsStatic = NymphRemoteClient::methodsIds();
-		methodsMutex.lock();
-		map<UInt32, NymphMethod*>::iterator it;
-		serializedMethods = "METHODS";
-		UInt32 size = (UInt32) methodsIdsStatic.size();
-		serializedMethods += string(((char*) &size), 4);
-		for (it = methodsIdsStatic.begin(); it != methodsIdsStatic.end(); ++it) {
-			serializedMethods += it->second->getSerialized();
-		}
-		
-		methodsMutex.unlock();
-	}
 	
-	// Prepare return message.
+	// Prepare return message. The snapshot may be replaced before it is sent.
 	NymphMessage* returnMsg = msg->getReplyMessage();
-	NymphType* methodsStr = new NymphType(&serializedMethods);
+	NymphType* methodsStr = new NymphType(new string(methods()->serialized), true);
 	returnMsg->setResultValue(methodsStr);
 	msg->discard();
 	return returnMsg;
@@ -104,7 +104,7 @@ bool NymphRemoteClient::init(logFnc logger, int level, long timeout) {
 	setLogger(logger, level);
 	
 	// Start the dispatcher runtime.
-	Dispatcher::init(10); // 10 worker threads.
+	Dispatcher::init(); // One worker per hardware thread.
 	
 	// Register built-in synchronisation method ('nymphsync').
 	vector<NymphTypes> parameters;
@@ -165,9 +165,22 @@ void NymphRemoteClient::setLogger(logFnc logger, int level) {
 
 
 // --- START ---
-bool NymphRemoteClient::start(int port) {
-	NymphServer::start(port);
-	return true;
+// Start the server on the given port. With the NYMPH_SERVER_CONCURRENT flag set
+// requests are executed on the worker pool instead of the session's thread. 
+// This allows a client to have multiple requests being processed in parallel.
+// Responses may then be sent in a different order than the requests arrived.
+// With NYMPH_SERVER_REACTOR set, all sessions are handled by 'ioThreads' I/O
+// threads instead of a thread per session, with requests executed on the 
+// worker pool. This mode is only available on Linux.
+bool NymphRemoteClient::start(int port, uint32_t flags, int ioThreads) {
+	return NymphServer::start(port, flags, ioThreads);
+}
+
+
+// Start the server on the socket specified by the URL, e.g. 'unix://<path>' for
+// a Unix domain socket. See NymphServer::start().
+bool NymphRemoteClient::start(string url, uint32_t flags, int ioThreads) {
+	return NymphServer::start(url, flags, ioThreads);
 }
 
 
@@ -181,18 +194,19 @@ bool NymphRemoteClient::shutdown() {
 
 
 // --- REGISTER METHOD ---
+// Registration copies the current snapshot, so it is best done before 
+// starting the server.
 bool NymphRemoteClient::registerMethod(string name, NymphMethod method) {
-	static map<string, NymphMethod> &methodsStatic = NymphRemoteClient::methods();
-	static map<UInt32, NymphMethod*> &methodsIdsStatic = NymphRemoteClient::methodsIds();
 	methodsMutex.lock();
+	shared_ptr<NymphMethodRegistry> updated(new NymphMethodRegistry(*methods()));
 	method.setId(nextMethodId++);
-	pair<map<string, NymphMethod>::iterator, bool> newPair;
-	newPair = methodsStatic.insert(pair<string, NymphMethod>(name, method));
+	shared_ptr<NymphMethod> entry(new NymphMethod(method));
 	
 	// TODO: check whether a new method was inserted or just overwritten.
-	// Create a reference to the method instance in the methods map here.
-	methodsIdsStatic.insert(pair<UInt32, NymphMethod*>(method.getId(), &(newPair.first->second)));
-	synced = false;
+	updated->methods.insert(pair<string, shared_ptr<NymphMethod> >(name, entry));
+	updated->ids.resize(method.getId() + 1);
+	updated->ids[method.getId()] = entry;
+	publish(updated);
 	methodsMutex.unlock();
 	
 	return true;
@@ -201,19 +215,16 @@ bool NymphRemoteClient::registerMethod(string name, NymphMethod method) {
 
 // --- CALL METHOD CALLBACK ---
 bool NymphRemoteClient::callMethodCallback(int handle, UInt32 methodId, NymphMessage* msg, NymphMessage* &response) {
-	static map<UInt32, NymphMethod*> &methodsIdsStatic = NymphRemoteClient::methodsIds();
-	methodsMutex.lock();
-	map<UInt32, NymphMethod*>::iterator it;
-	it = methodsIdsStatic.find(methodId);
-	if (it == methodsIdsStatic.end()) {
+	// The snapshot keeps the method alive while it runs, even if it is removed
+	// meanwhile. Methods thus run concurrently, without holding any lock.
+	shared_ptr<NymphMethodRegistry> snapshot = methods();
+	if (methodId >= snapshot->ids.size() || !snapshot->ids[methodId]) {
 		NYMPH_LOG_ERROR("Specified method ID " + NumberFormatter::format(methodId) + " was not found.");
-		methodsMutex.unlock();
 		return false;
 	}
 	
 	// Call the callback method.
-	response = it->second->callCallback(handle, msg);
-	methodsMutex.unlock();
+	response = snapshot->ids[methodId]->callCallback(handle, msg);
 	
 	if (response == 0) {
 		return false; 
@@ -225,22 +236,18 @@ bool NymphRemoteClient::callMethodCallback(int handle, UInt32 methodId, NymphMes
 
 // --- REMOVE METHOD ---
 bool NymphRemoteClient::removeMethod(string name) {
-	static map<string, NymphMethod> &methodsStatic = NymphRemoteClient::methods();
-	static map<UInt32, NymphMethod*> &methodsIdsStatic = NymphRemoteClient::methodsIds();
 	methodsMutex.lock();
-	map<string, NymphMethod>::iterator it;
-	it = methodsStatic.find(name);
-	UInt32 id = it->second.getId();
-	if (it != methodsStatic.end()) {
-		methodsStatic.erase(it);
-	}
-	
-	map<UInt32, NymphMethod*>::iterator mit;
-	mit = methodsIdsStatic.find(id);
-	if (mit != methodsIdsStatic.end()) {
-		methodsIdsStatic.erase(mit);
+	shared_ptr<NymphMethodRegistry> updated(new NymphMethodRegistry(*methods()));
+	map<string, shared_ptr<NymphMethod> >::iterator it;
+	it = updated->methods.find(name);
+	if (it == updated->methods.end()) {
+		methodsMutex.unlock();
+		return true;
 	}
 	
+	updated->ids[it->second->getId()].reset();
+	updated->methods.erase(it);
+	publish(updated);
 	methodsMutex.unlock();
 	
 	return true;
@@ -260,6 +267,46 @@ bool NymphRemoteClient::registerCallback(string name, NymphMethod method) {
 }
 
 
+// --- SEND CHUNK ---
+// Sends a part of the reply to the method call in 'msg' to the client, which 
+// receives it on the stream callback of its call. A method can send any number
+// of parts before returning its final reply, which ends the stream. Takes 
+// ownership of the value. Fails once the client cancelled the call.
+bool NymphRemoteClient::sendChunk(int handle, NymphMessage* msg, NymphType* value, 
+																string &result) {
+	if (msg->isCancelled()) {
+		result = "Call was cancelled.";
+		delete value;
+		return false;
+	}
+	
+	NymphMessage* chunk = msg->getReplyMessage();
+	chunk->setChunk();
+	chunk->setResultValue(value);
+	chunk->serializeVectored();
+	
+	// The session stays valid until the chunk is queued.
+	map<int, NymphSession*>::iterator it;
+	sessionsMutex.lock();
+	it = sessions.find(handle);
+	if (it == sessions.end()) { 
+		result = "Provided handle was not found.";
+		sessionsMutex.unlock();
+		delete chunk;
+		return false; 
+	}
+	
+	NymphSession* session = it->second;
+	session->acquire();
+	sessionsMutex.unlock();
+	
+	session->send(chunk);
+	session->requestDone();
+	
+	return true;
+}
+
+
 // --- CALL CALLBACK ---
 bool NymphRemoteClient::callCallback(int handle, string name, 
 									vector<NymphType*> &values, string &result) {
@@ -299,6 +346,89 @@ bool NymphRemoteClient::callCallback(int handle, string name,
 }
 
 
+// --- BROADCAST CALLBACK ---
+// Calls the callback on all connected clients. The callback message is 
+// serialised once and shared by all sessions.
+bool NymphRemoteClient::broadcastCallback(string name, vector<NymphType*> &values, 
+															string &result) {
+	vector<NymphSession*> targets;
+	sessionsMutex.lock();
+	map<int, NymphSession*>::iterator it;
+	for (it = sessions.begin(); it != sessions.end(); ++it) {
+		it->second->acquire();
+		targets.push_back(it->second);
+	}
+	
+	sessionsMutex.unlock();
+	
+	return broadcast(targets, name, values, result);
+}
+
+
+// Calls the callback on the clients with the provided handles. Handles which 
+// are not found, e.g. because the client disconnected, are skipped.
+bool NymphRemoteClient::broadcastCallback(vector<int> &handles, string name, 
+									vector<NymphType*> &values, string &result) {
+	vector<NymphSession*> targets;
+	sessionsMutex.lock();
+	for (uint32_t i = 0; i < handles.size(); ++i) {
+		map<int, NymphSession*>::iterator it = sessions.find(handles[i]);
+		if (it == sessions.end()) { continue; }
+		
+		it->second->acquire();
+		targets.push_back(it->second);
+	}
+	
+	sessionsMutex.unlock();
+	
+	return broadcast(targets, name, values, result);
+}
+
+
+// --- BROADCAST ---
+// Serialises the callback message once, then queues it on each of the sessions,
+// which were acquired by the caller. No lock is held while sending.
+bool NymphRemoteClient::broadcast(vector<NymphSession*> &targets, string name, 
+									vector<NymphType*> &values, string &result) {
+	NYMPH_LOG_DEBUG("Broadcasting callback method: " + name + " to " + 
+						NumberFormatter::format(targets.size()) + " sessions.");
+	
+	static map<string, NymphMethod> &callbacksStatic = NymphRemoteClient::callbacks();
+	NymphMessage* msg = 0;
+	callbacksMutex.lock();
+	map<string, NymphMethod>::iterator mit;
+	mit = callbacksStatic.find(name);
+	if (mit == callbacksStatic.end()) {
+		result = "Specified method name was not found.";
+	}
+	else {
+		msg = mit->second.createMessage(values, result);
+	}
+	
+	callbacksMutex.unlock();
+	
+	if (msg) {
+		// The message is deleted once the last session sent it, which can be
+		// after this returns, so it may not reference the caller's values.
+		msg->serializeVectored();
+		msg->ownData();
+		shared_ptr<NymphMessage> shared(msg);
+		for (uint32_t i = 0; i < targets.size(); ++i) {
+			targets[i]->send(shared);
+		}
+	}
+	else {
+		NYMPH_LOG_ERROR("Broadcasting callback method failed: " + result);
+	}
+	
+	for (uint32_t i = 0; i < targets.size(); ++i) {
+		targets[i]->requestDone();
+	}
+	
+	return msg != 0;
+}
+
+
 // --- REMOVE CALLBACK ---
 bool NymphRemoteClient::removeCallback(string name) {
 	static map<string, NymphMethod> &callbacksStatic = NymphRemoteClient::callbacks();
@@ -19,6 +19,7 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
 
 #ifdef NPOCO
 #include <npoco/Mutex.h>
@@ -34,6 +35,17 @@
 #include "nymph_listener.h"
 #include "nymph_logger.h"
 #include "nymph_session.h"
+#include "nymph_server.h"
+
+
+// Snapshot of the registered methods. It is never modified once published, but
+// replaced as a whole when methods are registered or removed. Lookups can thus
+// use the current snapshot without holding a lock.
+struct NymphMethodRegistry {
+	std::map<std::string, std::shared_ptr<NymphMethod> > methods;
+	std::vector<std::shared_ptr<NymphMethod> > ids;	// Indexed by method ID.
+	std::string serialized;		// Method table as returned by 'nymphsync'.
+};
 
 
 class NymphRemoteClient {
@@ -43,28 +55,35 @@ class NymphRemoteClient {
 	static std::map<int, NymphSession*> sessions;
 	static long timeout;
 	static std::string loggerName;
-	static bool synced;
-	static std::string serializedMethods;
 	static uint32_t nextMethodId;
 	
 	static std::map<std::string, NymphMethod>& callbacks();
-	static std::map<std::string, NymphMethod>& methods();
-	static std::map<uint32_t, NymphMethod*>& methodsIds();
+	static std::shared_ptr<NymphMethodRegistry>& registry();
+	static std::shared_ptr<NymphMethodRegistry> methods();
+	static void publish(std::shared_ptr<NymphMethodRegistry> methods);
 	
 	static NymphMessage* syncMethods(int session, NymphMessage* msg, void* data);
-	
+	static bool broadcast(std::vector<NymphSession*> &targets, std::string name, 
+								std::vector<NymphType*> &values, std::string &result);
+								
 public:
 	static bool init(logFnc logger, int level = NYMPH_LOG_LEVEL_TRACE, long timeout = 3000);
 	static void setLogger(logFnc logger, int level);
-	static bool start(int port = 4004);
+	static bool start(int port = 4004, uint32_t flags = 0, int ioThreads = 2);
+	static bool start(std::string url, uint32_t flags = 0, int ioThreads = 2);
 	static bool shutdown();
 	static bool registerMethod(std::string name, NymphMethod method);
 	static bool callMethodCallback(int handle, uint32_t methodId, NymphMessage* msg, NymphMessage* &response);
 	static bool removeMethod(std::string name);
+	static bool sendChunk(int handle, NymphMessage* msg, NymphType* value, std::string &result);
 	
 	static bool registerCallback(std::string name, NymphMethod method);
 	static bool callCallback(int handle, std::string name, 
 								std::vector<NymphType*> &values, std::string &result);
+	static bool broadcastCallback(std::string name, std::vector<NymphType*> &values, 
+								std::string &result);
+	static bool broadcastCallback(std::vector<int> &handles, std::string name, 
+								std::vector<NymphType*> &values, std::string &result);
 	static bool removeCallback(std::string name);
 	
 	static bool addSession(int handle, NymphSession* session);
@@ -32,6 +32,10 @@ using namespace Poco;
 using namespace std;
 
 #include "dispatcher.h"
+#include "response_request.h"
+
+#include <memory>
+#include <chrono>
 
 
 // Static initialisations
@@ -40,7 +44,7 @@ long NymphRemoteServer::timeout = 3000;
 string NymphRemoteServer::loggerName = "NymphRemoteServer";
 uint32_t NymphRemoteServer::nextMethodId = 0;
 NymphDisconnectCallback NymphRemoteServer::disconnectedCallback;
-std::map<uint32_t, NymphServerInstance*> NymphRemoteServer::instances;
+std::map<uint32_t, std::shared_ptr<NymphServerInstance> > NymphRemoteServer::instances;
 #ifdef HOST_FREERTOS
 //
 #else
@@ -53,6 +57,8 @@ Poco::Mutex NymphRemoteServer::instancesMutex;
 NymphServerInstance::NymphServerInstance(uint32_t handle, Poco::Net::StreamSocket* socket, uint32_t timeout) 
 	: handle(handle), socket(socket), timeout(timeout) {
 	socketSemaphore = new Poco::Semaphore(0, 1);
+	requests = std::make_shared<NymphRequestTable>();
+	sendQueue = new NymphSendQueue(socket, requests.get());
 	
 	// Register built-in synchronisation method ('nymphsync').
 	vector<NymphTypes> parameters;
@@ -62,7 +68,9 @@ NymphServerInstance::NymphServerInstance(uint32_t handle, Poco::Net::StreamSocke
 
 
 // --- DESTRUCTOR ---
-NymphServerInstance::~NymphServerInstance() { }
+NymphServerInstance::~NymphServerInstance() {
+	delete sendQueue;
+}
 	
 
 // --- SET HANDLE ---
@@ -85,6 +93,15 @@ void NymphServerInstance::setDisconnectCallback(NymphDisconnectCallback cb) {
 Poco::Semaphore* NymphServerInstance::semaphore() { return socketSemaphore; }
 
 
+// --- SET CHANNEL ---
+// Sends messages through the shared memory channel instead of the socket. The
+// channel is owned by the connection's listener.
+void NymphServerInstance::setChannel(NymphShmChannel* channel) {
+	this->channel = channel;
+	sendQueue->setRing(channel->output());
+}
+
+
 // --- SYNC ---
 // Synchronises the function list on the client with that of the server.
 // Automatically called once upon connecting to a new Nymph server instance.
@@ -184,65 +201,125 @@ bool NymphServerInstance::addMethod(std::string name, NymphMethod method) {
 	// Add the method to the map for the specified handle.
 	methodsMutex.lock();
 	method.setId(nextMethodId++);
-	std::pair<map<string, NymphMethod>::iterator, bool> newPair;
-	newPair = methods.insert(pair<string, NymphMethod>(name, method));
+	std::pair<map<string, shared_ptr<NymphMethod> >::iterator, bool> newPair;
+	newPair = methods.insert(pair<string, shared_ptr<NymphMethod> >(name, make_shared<NymphMethod>(method)));
 	
 	// TODO: check whether a new method was inserted or just overwritten.
 	// Create a reference to the method instance in the methods map here.
-	methodIds.insert(pair<UInt32, NymphMethod*>(method.getId(), &(newPair.first->second)));
+	if (method.getId() >= methodIds.size()) { methodIds.resize(method.getId() + 1); }
+	methodIds[method.getId()] = newPair.first->second;
 	methodsMutex.unlock();
 	
 	return true;
 }
 
 
+// --- FIND METHOD ---
+// Returns the method with the given name or ID, or an empty pointer. Holding
+// on to the method allows it to be called without holding the methods mutex.
+shared_ptr<NymphMethod> NymphServerInstance::findMethod(std::string name) {
+	shared_ptr<NymphMethod> method;
+	methodsMutex.lock();
+	map<string, shared_ptr<NymphMethod> >::iterator mit;
+	mit = methods.find(name);
+	if (mit != methods.end()) { method = mit->second; }
+	methodsMutex.unlock();
+	
+	return method;
+}
+
+
+shared_ptr<NymphMethod> NymphServerInstance::findMethod(uint32_t id) {
+	shared_ptr<NymphMethod> method;
+	methodsMutex.lock();
+	if (id < methodIds.size()) { method = methodIds[id]; }
+	methodsMutex.unlock();
+	
+	return method;
+}
+
+
 // --- CALL METHOD ---
 bool NymphServerInstance::callMethod(std::string name, std::vector<NymphType*> &values, 
 										NymphType* &returnvalue, std::string &result) {	
 	NYMPH_LOG_DEBUG("Called method: " + name);
 	
-	// Get the method.
-	methodsMutex.lock();
-	map<string, NymphMethod>::iterator mit;
-	mit = methods.find(name);
-	if (mit == methods.end()) {
+	shared_ptr<NymphMethod> method = findMethod(name);
+	if (!method) {
+		result = "Specified method name was not found.";
+		return false;
+	}
+	
+	if (!callSync(method.get(), values, returnvalue, result)) {
+		if (result.empty()) {
+			result = "Method call for " + name + " timed out while waiting for response.";
+		}
+		
+		return false;
+	}
+	
+	return true;
+}
+
+
+// --- CALL METHOD ID ---
+bool NymphServerInstance::callMethodId(uint32_t id, std::vector<NymphType*> &values, NymphType* &returnvalue, std::string &result) {
+	NYMPH_LOG_DEBUG("Called method ID: " + NumberFormatter::format(id));
+	
+	shared_ptr<NymphMethod> method = findMethod(id);
+	if (!method) {
 		result = "Specified method name was not found.";
-		methodsMutex.unlock();
+		return false;
+	}
+	
+	if (!callSync(method.get(), values, returnvalue, result)) {
+		if (result.empty()) {
+			result = "Method call for ID " + NumberFormatter::format(id) + " timed out while waiting for response.";
+		}
 		
-		// Delete the values in the values vector since we own them.
-		/* std::vector<NymphType*>::iterator it;
-		for (it = values.begin(); it != values.end(); ++it) { delete (*it); } */
 		return false;
 	}
 	
-	// Add NymphRequest to listener.
+	return true;
+}
+
+
+// --- CALL SYNC ---
+// Sends the method call and waits for the response. Leaves 'result' empty if
+// the call timed out.
+bool NymphServerInstance::callSync(NymphMethod* method, std::vector<NymphType*> &values, 
+										NymphType* &returnvalue, std::string &result) {
 	NymphRequest* request = new NymphRequest;
 	request->response = 0;
 	request->exception = false;
 	request->handle = handle;
+	request->deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout);
 	request->mutex.lock();
 	
 	// Call the method instance. Ownership of the values vector is transferred
 	// to this instance.
-	bool ret = mit->second.call(socket, request, values, result);
-	methodsMutex.unlock();
-	
-	if (!ret) { return false; }
-	
-	// Wait for the message response, else return time-out error.
-	// We use tryWait() since it's exception-free.
-	if (!request->condition.tryWait(request->mutex, timeout)) {
-		// Handle timeout of the message.
-		result = "Method call for " + name + " timed out while waiting for response.";
+	NymphRequest* pending = request;
+	uint64_t messageId;
+	if (!method->call(sendQueue, requests.get(), pending, values, messageId, result)) {
+		// Only delete the request if it was not taken by the listener.
 		request->mutex.unlock();
-		NymphListener::removeMessage(handle, request->messageId);
+		if (pending) { delete request; }
 		return false;
 	}
 	
-	request->mutex.unlock();
+	// Wait for the message response, else return time-out error. If this thread
+	// wrote the message itself and failed, the request has already failed.
+	if (request->error.empty()) {
+		if (!waitRequest(request)) { return false; }
+	}
+	else { request->mutex.unlock(); }
 	
-	// Remove message from listener since we're done with it.
-	NymphListener::removeMessage(handle, request->messageId);
+	// Check whether the message could be sent.
+	if (!request->error.empty()) {
+		result = request->error;
+		delete request;
+		return false;
+	}
 	
 	// Check for an exception.
 	if (request->exception) {
@@ -262,73 +339,339 @@ bool NymphServerInstance::callMethod(std::string name, std::vector<NymphType*> &
 }
 
 
-// --- CALL METHOD ID ---
-bool NymphServerInstance::callMethodId(uint32_t id, std::vector<NymphType*> &values, NymphType* &returnvalue, std::string &result) {
-	NYMPH_LOG_DEBUG("Called method ID: " + NumberFormatter::format(id));
+// --- CALL METHOD ASYNC ---
+// Sends the method call without waiting for the response. The callback is 
+// called on a worker thread once the response has arrived, or the call timed 
+// out or otherwise failed.
+bool NymphServerInstance::callMethodAsync(std::string name, std::vector<NymphType*> &values, 
+							NymphAsyncCallback callback, void* data, uint64_t &messageId, 
+							std::string &result) {
+	NYMPH_LOG_DEBUG("Called method asynchronously: " + name);
+	
+	shared_ptr<NymphMethod> method = findMethod(name);
+	if (!method) {
+		result = "Specified method name was not found.";
+		return false;
+	}
 	
-	// Get the method.
-	methodsMutex.lock();
-	map<uint32_t, NymphMethod*>::iterator mit;
-	mit = methodIds.find(id);
-	if (mit == methodIds.end()) {
+	return callAsync(method.get(), values, 0, false, callback, data, messageId, result);
+}
+
+
+// --- CALL METHOD ID ASYNC ---
+bool NymphServerInstance::callMethodIdAsync(uint32_t id, std::vector<NymphType*> &values, 
+							NymphAsyncCallback callback, void* data, uint64_t &messageId, 
+							std::string &result) {
+	NYMPH_LOG_DEBUG("Called method ID asynchronously: " + NumberFormatter::format(id));
+	
+	shared_ptr<NymphMethod> method = findMethod(id);
+	if (!method) {
+		result = "Specified method name was not found.";
+		return false;
+	}
+	
+	return callAsync(method.get(), values, 0, false, callback, data, messageId, result);
+}
+
+
+// --- CALL METHOD STREAM ---
+// Sends the method call, with the stream callback receiving each part of the 
+// reply the server sends before its final reply. The parts are delivered in 
+// order on the connection's receiving thread, so no further data is read until
+// the stream callback returns. With the reactor (see NymphRemoteServer::init),
+// that thread is shared with other connections, which wait as well, so a slow
+// consumer should hand the parts to another thread. The timeout applies to the
+// time between parts.
+bool NymphServerInstance::callMethodStream(std::string name, std::vector<NymphType*> &values, 
+							NymphStreamCallback stream, NymphAsyncCallback callback, 
+							void* data, uint64_t &messageId, std::string &result) {
+	NYMPH_LOG_DEBUG("Called method as stream: " + name);
+	
+	if (!stream) {
+		result = "No stream callback provided.";
+		return false;
+	}
+	
+	shared_ptr<NymphMethod> method = findMethod(name);
+	if (!method) {
 		result = "Specified method name was not found.";
-		methodsMutex.unlock();
 		return false;
 	}
 	
-	// Add NymphRequest to listener.
+	return callAsync(method.get(), values, stream, false, callback, data, messageId, result);
+}
+
+
+// --- CALL METHOD UPLOAD ---
+// Sends the method call, which is followed by the parts of its upload sent 
+// with sendChunk(), and ends with endUpload(). The callback is called once the
+// server replied, usually after the upload ended. The timeout applies to the 
+// time between parts.
+bool NymphServerInstance::callMethodUpload(std::string name, std::vector<NymphType*> &values, 
+							NymphAsyncCallback callback, void* data, uint64_t &messageId, 
+							std::string &result) {
+	NYMPH_LOG_DEBUG("Called method as upload: " + name);
+	
+	shared_ptr<NymphMethod> method = findMethod(name);
+	if (!method) {
+		result = "Specified method name was not found.";
+		return false;
+	}
+	
+	return callAsync(method.get(), values, 0, true, callback, data, messageId, result);
+}
+
+
+// --- SEND CHUNK ---
+// Sends a part of the upload for the call. Takes ownership of the value.
+bool NymphServerInstance::sendChunk(uint64_t messageId, NymphType* value, std::string &result) {
+	if (!value) {
+		result = "No value provided.";
+		return false;
+	}
+	
+	return sendPart(messageId, value, result);
+}
+
+
+// --- END UPLOAD ---
+// Sends the final part of the upload for the call, which carries no value.
+bool NymphServerInstance::endUpload(uint64_t messageId, std::string &result) {
+	return sendPart(messageId, 0, result);
+}
+
+
+// --- SEND PART ---
+// Writes the part of the upload on the calling thread, so that only one part is
+// held in memory at a time. Each part extends the time the call waits for its
+// reply by the timeout.
+bool NymphServerInstance::sendPart(uint64_t messageId, NymphType* value, std::string &result) {
+	NymphRequest* request = requests->borrow(messageId);
+	if (!request) {
+		result = "Call is not awaiting a reply.";
+		delete value;
+		return false;
+	}
+	
+	bool upload = request->upload;
+	if (upload) { request->deadline = chrono::steady_clock::now() + request->idleTimeout; }
+	requests->restore(messageId, request->deadline.time_since_epoch().count());
+	if (!upload) {
+		result = "Call is not an upload.";
+		delete value;
+		return false;
+	}
+	
+	NymphMessage* msg = new NymphMessage;
+	msg->setPart(messageId, value);
+	msg->serializeVectored();
+	
+	return sendQueue->sendNow(msg, result);
+}
+
+
+// --- CALL ASYNC ---
+// Creates an asynchronous request and sends the method call.
+bool NymphServerInstance::callAsync(NymphMethod* method, std::vector<NymphType*> &values, 
+							NymphStreamCallback stream, bool upload, NymphAsyncCallback callback, 
+							void* data, uint64_t &messageId, std::string &result) {
 	NymphRequest* request = new NymphRequest;
-	request->response = 0;
 	request->handle = handle;
-	request->mutex.lock();
+	request->callback = callback;
+	request->stream = stream;
+	request->upload = upload;
+	request->data = data;
+	request->idleTimeout = chrono::milliseconds(timeout);
+	request->deadline = chrono::steady_clock::now() + request->idleTimeout;
+	
+	if (!method->call(sendQueue, requests.get(), request, values, messageId, result)) {
+		// If the listener took the request, it will complete it.
+		if (request) { delete request; }
+		
+		return false;
+	}
 	
-	bool ret = mit->second->call(socket, request, values, result);
-	methodsMutex.unlock();
+	return true;
+}
+
+
+// --- CALL METHOD BATCH ---
+// Sends the calls together in a single batch message, and waits until all of 
+// them have completed. The server returns the replies in a single batch message
+// as well. Nothing is sent if any of the calls is invalid. Each call's reply 
+// indicates whether it succeeded, with calls that received no reply failing 
+// once they time out.
+bool NymphServerInstance::callMethodBatch(std::vector<NymphBatchCall> &calls, std::string &result) {
+	if (calls.empty()) {
+		result = "No calls in batch.";
+		return false;
+	}
 	
-	if (!ret) { return false; }
+	NymphMessage* batch = new NymphMessage;
+	for (uint32_t i = 0; i < calls.size(); ++i) {
+		shared_ptr<NymphMethod> method = findMethod(calls[i].methodId);
+		NymphMessage* msg = 0;
+		if (!method) { result = "Specified method name was not found."; }
+		else { msg = method->createMessage(calls[i].values, result); }
+		
+		if (!msg) {
+			result = "Call " + NumberFormatter::format(i) + " in batch: " + result;
+			delete batch;
+			return false;
+		}
+		
+		batch->addMessage(msg);
+	}
 	
-	// Wait for the message response, else return time-out error.
-	// We use tryWait() since it's exception-free.
-	if (!request->condition.tryWait(request->mutex, timeout)) {
-		// Handle timeout of the message.
-		result = "Method call for ID " + NumberFormatter::format(id) + " timed out while waiting for response.";
-		request->mutex.unlock();
-		NymphListener::removeMessage(handle, request->messageId);
-		return false;
+	// Each call is completed like an asynchronous request. The last one to
+	// complete signals this thread.
+	struct BatchState {
+		Poco::Mutex mutex;
+		Poco::Condition condition;
+		uint32_t remaining;
+		vector<NymphAsyncResult> replies;
+	};
+	
+	shared_ptr<BatchState> state = make_shared<BatchState>();
+	state->remaining = calls.size();
+	state->replies.resize(calls.size());
+	
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + 
+													chrono::milliseconds(timeout);
+	vector<NymphMessage*> &msgs = batch->messages();
+	for (uint32_t i = 0; i < msgs.size(); ++i) {
+		NymphRequest* request = new NymphRequest;
+		request->handle = handle;
+		request->deadline = deadline;
+		request->callback = [state, i](uint32_t, NymphAsyncResult &res, void*) {
+			state->mutex.lock();
+			state->replies[i] = res;
+			if (--state->remaining == 0) { state->condition.signal(); }
+			state->mutex.unlock();
+		};
+		
+		uint64_t messageId;
+		if (!requests->add(request, messageId, deadline.time_since_epoch().count())) {
+			// Withdraw the requests added so far. Any of these which was 
+			// already taken has expired and is completed by the listener.
+			delete request;
+			state->mutex.lock();
+			state->remaining -= (msgs.size() - i);
+			for (uint32_t j = 0; j < i; ++j) {
+				NymphRequest* added = requests->take(msgs[j]->getMessageId());
+				if (added) {
+					state->remaining--;
+					delete added;
+				}
+			}
+			
+			while (state->remaining > 0) { state->condition.wait(state->mutex); }
+			state->mutex.unlock();
+			
+			result = "Too many requests awaiting a reply.";
+			delete batch;
+			return false;
+		}
+		
+		msgs[i]->setMessageId(messageId);
+		msgs[i]->setDeadline(deadline);
 	}
 	
-	request->mutex.unlock();
+	state->mutex.lock();
 	
-	// Remove message from listener since we're done with it.
-	NymphListener::removeMessage(handle, request->messageId);
+	// Queue the batch. The requests are failed if it can not be sent.
+	batch->serializeVectored();
+	sendQueue->send(batch, 0);
 	
-	// Check for an exception.
-	if (request->exception) {
-		result = to_string(request->exceptionData.id) + " - " + request->exceptionData.value;
-		returnvalue = 0;
+	// Requests which receive no reply are expired by the listener, so this
+	// wait always ends.
+	while (state->remaining > 0) { state->condition.wait(state->mutex); }
+	state->mutex.unlock();
+	
+	for (uint32_t i = 0; i < calls.size(); ++i) {
+		calls[i].reply = state->replies[i];
 	}
-	else {
-		// Set output result. This is a singular NymphType value.
-		returnvalue = request->response;
+	
+	return true;
+}
+
+
+// --- WAIT REQUEST ---
+// Waits for the response to a synchronous request, whose mutex is held. Returns
+// false and deletes the request if it timed out.
+bool NymphServerInstance::waitRequest(NymphRequest* request) {
+	// We use tryWait() since it's exception-free. A signal which arrives as the
+	// wait times out is lost, so the done flag is checked as well.
+	if (!request->done && !request->condition.tryWait(request->mutex, timeout) && 
+																	!request->done) {
+		// If the listener took the request, the response arrived just now and
+		// it is waiting for the mutex to signal us.
+		if (requests->take(request->messageId)) {
+			sendCancel(request->messageId);
+			request->mutex.unlock();
+			delete request;
+			return false;
+		}
 	}
 	
-	delete request;
+	while (!request->done) { request->condition.wait(request->mutex); }
+	request->mutex.unlock();
+	return true;
+}
+
+
+// --- CANCEL ---
+// Cancels a call which is still awaiting its response. The server is asked to 
+// drop the call, and the call fails right away. Returns false if the call 
+// already completed.
+bool NymphServerInstance::cancel(uint64_t messageId, std::string &result) {
+	NymphRequest* request = requests->take(messageId);
+	if (!request) {
+		result = "No call awaiting a reply with message ID " + NumberFormatter::format(messageId) + ".";
+		return false;
+	}
+	
+	sendCancel(messageId);
+	
+	string error = "Method call was cancelled.";
+	if (request->callback) {
+		ResponseRequest* rr = new ResponseRequest;
+		rr->setRequest(request, error);
+		Dispatcher::addRequest(rr);
+		return true;
+	}
+	
+	// A synchronous caller is waiting on the request.
+	request->mutex.lock();
+	request->error = error;
+	request->done = true;
+	request->condition.signal();
+	request->mutex.unlock();
 	
 	return true;
 }
 
 
+// --- SEND CANCEL ---
+// Asks the server to drop the call with the message ID. Nothing is sent back.
+void NymphServerInstance::sendCancel(uint64_t messageId) {
+	NymphMessage* msg = new NymphMessage;
+	msg->setCancel(messageId);
+	msg->serialize();
+	sendQueue->send(msg, 0);
+}
+
+
 // --- REMOVE METHOD ---
 bool NymphServerInstance::removeMethod(std::string name) {
 	methodsMutex.lock();
-	map<string, NymphMethod>::iterator it;
+	map<string, shared_ptr<NymphMethod> >::iterator it;
 	it = methods.find(name);
 	if (it != methods.end()) {
+		methodIds[it->second->getId()].reset();
 		methods.erase(it);
 	}
 	
-	// TODO: remove from methods ID map as well.
-	
 	methodsMutex.unlock();
 	
 	return true;
@@ -337,6 +680,11 @@ bool NymphServerInstance::removeMethod(std::string name) {
 
 // --- DISCONNECT ---
 bool NymphServerInstance::disconnect(std::string& result) {
+	// Stop sending, as the listener deletes the socket once disconnected. A 
+	// writer waiting for space in the channel is woken up by closing it.
+	if (channel) { channel->close(); }
+	sendQueue->close();
+	
 	// Shutdown socket. Set the semaphore once done to signal that the socket's 
 	// listener thread that it's safe to delete the socket.
 	bool res = true;
@@ -344,12 +692,17 @@ bool NymphServerInstance::disconnect(std::string& result) {
 	// TODO: return value.
 	res = socket->shutdown();
 	if (!res) { return res; }
-	res = socket->close();
-	if (!res) { return res; }
+	if (!NymphListener::usingReactor()) {
+		res = socket->close();
+		if (!res) { return res; }
+	}
 #else
 	try {
 		socket->shutdown();
-		socket->close();
+		
+		// With the reactor, the listener closes the socket once it has been 
+		// removed from the reactor, so the descriptor can't be reused before.
+		if (!NymphListener::usingReactor()) { socket->close(); }
 	}
 	catch (Poco::Net::NetException &ex) {
 		result = "Net exception: " + ex.displayText();
@@ -392,7 +745,9 @@ bool NymphServerInstance::disconnect(std::string& result) {
 // NYMPH_LOG_LEVEL_INFO,
 // NYMPH_LOG_LEVEL_DEBUG,
 // NYMPH_LOG_LEVEL_TRACE
-bool NymphRemoteServer::init(logFnc logger, int level, long timeout) {
+// If 'ioThreads' is larger than zero, all connections are handled by a reactor
+// with that many I/O threads, instead of a thread per connection (Linux only).
+bool NymphRemoteServer::init(logFnc logger, int level, long timeout, int ioThreads) {
 #ifndef NPOCO	
 	// FIXME: Added to work around Poco issue on Windows. Also see auto lib init disable in Makefile.
 	Poco::Net::initializeNetwork();
@@ -402,7 +757,10 @@ bool NymphRemoteServer::init(logFnc logger, int level, long timeout) {
 	setLogger(logger, level);
 	
 	// Start the dispatcher runtime.
-	Dispatcher::init(10); // 10 worker threads.
+	Dispatcher::init(); // One worker per hardware thread.
+	
+	// Optionally handle all connections using a reactor.
+	if (ioThreads > 0 && !NymphListener::start(ioThreads)) { return false; }
 	
 	return true;
 }
@@ -435,12 +793,9 @@ void NymphRemoteServer::setDisconnectCallback(NymphDisconnectCallback cb) {
 // --- SHUTDOWN ---
 // Shutdown the runtime. Close any open connections and clean up resources.
 bool NymphRemoteServer::shutdown() {
-	map<uint32_t, NymphServerInstance*>::iterator it;
+	map<uint32_t, shared_ptr<NymphServerInstance> >::iterator it;
 	for (it = instances.begin(); it != instances.end(); ++it) {
-		// Remove socket from listener.
-		NymphListener::removeConnection(it->first);
-		
-		// Disconnect.
+		// Disconnect. This also removes the socket from the listener.
 		std::string result;
 		it->second->disconnect(result);
 	}
@@ -482,9 +837,33 @@ bool NymphRemoteServer::connect(string host, int port, uint32_t &handle, void* d
 }
 
 
+// Connect using a URL. This is either a Unix domain socket ('unix://<path>') or
+// a shared memory channel ('shm://<path>') for a server on the same host, or a 
+// TCP socket ('tcp://<host>:<port>' or just '<host>:<port>').
 bool NymphRemoteServer::connect(string url, uint32_t &handle, void* data, 
 															string &result) {
-
+	if (url.compare(0, 7, "unix://") == 0) {
+#if defined NPOCO || !defined POCO_HAS_UNIX_SOCKET
+		result = "Unix domain sockets are not supported.";
+		return false;
+#else
+		try {
+			Poco::Net::SocketAddress sa(Poco::Net::SocketAddress::UNIX_LOCAL, url.substr(7));
+			return connect(sa, handle, data, result);
+		}
+		catch (...) {
+			result = "Invalid socket path.";
+			return false;
+		}
+#endif
+	}
+	
+	if (url.compare(0, 6, "shm://") == 0) {
+		return connectChannel(url.substr(6), handle, data, result);
+	}
+	
+	if (url.compare(0, 6, "tcp://") == 0) { url = url.substr(6); }
+	
 #if defined NPOCO
 	Poco::Net::SocketAddress sa(url);
 	return connect(sa, handle, data, result);
@@ -542,20 +921,68 @@ bool NymphRemoteServer::connect(Poco::Net::SocketAddress sa, uint32_t &handle,
 	}
 #endif
 	
+	return addConnection(socket, 0, handle, data, result);
+}
+//#endif
+
+
+// --- CONNECT CHANNEL ---
+// Connects to the Unix domain socket of a server on the same host, and sets up
+// a shared memory channel with it, through which all messages are sent.
+bool NymphRemoteServer::connectChannel(string path, uint32_t &handle, void* data, 
+															string &result) {
+#if defined NPOCO || !defined POCO_HAS_UNIX_SOCKET
+	result = "Shared memory channels are not supported.";
+	return false;
+#else
+	Poco::Net::StreamSocket* socket;
+	try {
+		NYMPH_LOG_INFORMATION("Connect remote server using shared memory...");
+		socket = new Poco::Net::StreamSocket(Poco::Net::SocketAddress(
+										Poco::Net::SocketAddress::UNIX_LOCAL, path));
+	}
+	catch (Poco::Exception &ex) {
+		result = "Unable to connect: " + ex.displayText();
+		return false;
+	}
+	catch (...) {
+		result = "Invalid socket path.";
+		return false;
+	}
+	
+	NymphShmChannel* channel = NymphShmChannel::connect(*socket, result);
+	if (!channel) {
+		delete socket;
+		return false;
+	}
+	
+	return addConnection(socket, channel, handle, data, result);
+#endif
+}
+
+
+// --- ADD CONNECTION ---
+// Creates the server instance & listener for a newly connected socket, then
+// synchronises the methods with the server.
+bool NymphRemoteServer::addConnection(Poco::Net::StreamSocket* socket, NymphShmChannel* channel, 
+										uint32_t &handle, void* data, string &result) {
 	// Create new NymphServerInstance instance for this connection.
 	// Add it to the instances map.
 	instancesMutex.lock();
-	NymphServerInstance* si = new NymphServerInstance(lastHandle, socket);
-	instances.insert(std::pair<uint32_t, NymphServerInstance*>(lastHandle, si));
+	shared_ptr<NymphServerInstance> si = make_shared<NymphServerInstance>(lastHandle, socket);
+	instances.insert(std::pair<uint32_t, shared_ptr<NymphServerInstance> >(lastHandle, si));
 	instancesMutex.unlock();
 	
 	si->setDisconnectCallback(disconnectedCallback);
+	if (channel) { si->setChannel(channel); }
 	
 	NymphSocket ns;
 	ns.socket = socket;
+	ns.channel = channel;
 	ns.semaphore = si->semaphore();
 	ns.data = data;
 	ns.handle = lastHandle;
+	ns.requests = si->requestTable();
 	NymphListener::addConnection(lastHandle, ns);
 	handle = lastHandle++;
 	
@@ -568,11 +995,10 @@ bool NymphRemoteServer::connect(Poco::Net::SocketAddress sa, uint32_t &handle,
 
 	return true;
 }
-//#endif
 
 // --- DISCONNECT ---
 bool NymphRemoteServer::disconnect(uint32_t handle, string &result) {
-	map<uint32_t, NymphServerInstance*>::iterator it;
+	map<uint32_t, shared_ptr<NymphServerInstance> >::iterator it;
 	instancesMutex.lock();
 	it = instances.find(handle);
 	if (it == instances.end()) { 
@@ -588,8 +1014,7 @@ bool NymphRemoteServer::disconnect(uint32_t handle, string &result) {
 		return false;
 	}
 	
-	// Delete instance.
-	delete it->second;
+	// Remove instance. It is deleted once no call is using it any more.
 	instances.erase(it);
 	
 	// Remove socket from listener.
@@ -604,76 +1029,216 @@ bool NymphRemoteServer::disconnect(uint32_t handle, string &result) {
 }
 
 
-// --- CALL METHOD ---
-bool NymphRemoteServer::callMethod(uint32_t handle, string name, vector<NymphType*> &values,
-										NymphType* &returnvalue, string &result) {
-	map<uint32_t, NymphServerInstance*>::iterator it;
+// --- GET INSTANCE ---
+// Returns the server instance for the handle. The instance remains valid while
+// the returned pointer is held, even if it gets disconnected.
+shared_ptr<NymphServerInstance> NymphRemoteServer::getInstance(uint32_t handle, string &result) {
+	shared_ptr<NymphServerInstance> si;
+	map<uint32_t, shared_ptr<NymphServerInstance> >::iterator it;
 	instancesMutex.lock();
 	it = instances.find(handle);
 	if (it == instances.end()) { 
 		result = "Provided handle " + NumberFormatter::format(handle) + " was not found.";
-		instancesMutex.unlock();
-		return false; 
-	}
-	
-	// TODO: try/catch.
-	// Tell server instance to disconnect.
-	if (!it->second->callMethod(name, values, returnvalue, result)) {
-		instancesMutex.unlock();
-		return false;
 	}
+	else { si = it->second; }
 	
 	instancesMutex.unlock();
+	return si;
+}
+
+
+// --- CALL METHOD ---
+// The instances mutex is not held during the call, so that calls on the same
+// or other connections can proceed in parallel.
+bool NymphRemoteServer::callMethod(uint32_t handle, string name, vector<NymphType*> &values,
+										NymphType* &returnvalue, string &result) {
+	shared_ptr<NymphServerInstance> si = getInstance(handle, result);
+	if (!si) { return false; }
 	
-	return true;
+	// TODO: try/catch.
+	return si->callMethod(name, values, returnvalue, result);
 }
 
 
 // --- CALL METHOD ID ---
 bool NymphRemoteServer::callMethodId(uint32_t handle, uint32_t id, vector<NymphType*> &values, NymphType* &returnvalue, string &result) {
-	std::map<uint32_t, NymphServerInstance*>::iterator it;
-	instancesMutex.lock();
-	it = instances.find(handle);
-	if (it == instances.end()) { 
-		result = "Provided handle " + NumberFormatter::format(handle) + " was not found.";
-		instancesMutex.unlock();
-		return false; 
-	}
+	shared_ptr<NymphServerInstance> si = getInstance(handle, result);
+	if (!si) { return false; }
 	
 	// TODO: try/catch.
-	// Tell server instance to disconnect.
-	if (!it->second->callMethodId(id, values, returnvalue, result)) {
-		instancesMutex.unlock();
+	return si->callMethodId(id, values, returnvalue, result);
+}
+
+
+// --- CALL METHOD ASYNC ---
+// Calls the remote method without blocking. The callback is called with the
+// result once it is available. The returned value in the result is owned by the 
+// receiver of the callback.
+bool NymphRemoteServer::callMethodAsync(uint32_t handle, string name, vector<NymphType*> &values, 
+								NymphAsyncCallback callback, void* data, string &result) {
+	shared_ptr<NymphServerInstance> si = getInstance(handle, result);
+	if (!si) { return false; }
+	
+	uint64_t messageId;
+	return si->callMethodAsync(name, values, callback, data, messageId, result);
+}
+
+
+// Returns the message ID of the call, which can be passed to cancelCall().
+bool NymphRemoteServer::callMethodAsync(uint32_t handle, string name, vector<NymphType*> &values, 
+								NymphAsyncCallback callback, void* data, uint64_t &messageId, 
+								string &result) {
+	shared_ptr<NymphServerInstance> si = getInstance(handle, result);
+	if (!si) { return false; }
+	
+	return si->callMethodAsync(name, values, callback, data, messageId, result);
+}
+
+
+// Future-based version. The future becomes ready once the result is available.
+bool NymphRemoteServer::callMethodAsync(uint32_t handle, string name, vector<NymphType*> &values, 
+								future<NymphAsyncResult> &future, string &result) {
+	shared_ptr<promise<NymphAsyncResult> > prom = make_shared<promise<NymphAsyncResult> >();
+	future = prom->get_future();
+	return callMethodAsync(handle, name, values, 
+							[prom](uint32_t, NymphAsyncResult &res, void*) {
+								prom->set_value(res);
+							}, 0, result);
+}
+
+
+// --- CALL METHOD ID ASYNC ---
+bool NymphRemoteServer::callMethodIdAsync(uint32_t handle, uint32_t id, vector<NymphType*> &values, 
+								NymphAsyncCallback callback, void* data, string &result) {
+	shared_ptr<NymphServerInstance> si = getInstance(handle, result);
+	if (!si) { return false; }
+	
+	uint64_t messageId;
+	return si->callMethodIdAsync(id, values, callback, data, messageId, result);
+}
+
+
+// Returns the message ID of the call, which can be passed to cancelCall().
+bool NymphRemoteServer::callMethodIdAsync(uint32_t handle, uint32_t id, vector<NymphType*> &values, 
+								NymphAsyncCallback callback, void* data, uint64_t &messageId, 
+								string &result) {
+	shared_ptr<NymphServerInstance> si = getInstance(handle, result);
+	if (!si) { return false; }
+	
+	return si->callMethodIdAsync(id, values, callback, data, messageId, result);
+}
+
+
+bool NymphRemoteServer::callMethodIdAsync(uint32_t handle, uint32_t id, vector<NymphType*> &values, 
+								future<NymphAsyncResult> &future, string &result) {
+	shared_ptr<promise<NymphAsyncResult> > prom = make_shared<promise<NymphAsyncResult> >();
+	future = prom->get_future();
+	return callMethodIdAsync(handle, id, values, 
+							[prom](uint32_t, NymphAsyncResult &res, void*) {
+								prom->set_value(res);
+							}, 0, result);
+}
+
+
+// --- CALL METHOD BATCH ---
+// Calls multiple methods using a single message each way. Blocks until all 
+// calls have completed. The returned values in the replies are owned by the 
+// caller.
+bool NymphRemoteServer::callMethodBatch(uint32_t handle, vector<NymphBatchCall> &calls, string &result) {
+	shared_ptr<NymphServerInstance> si = getInstance(handle, result);
+	if (!si) { return false; }
+	
+	return si->callMethodBatch(calls, result);
+}
+
+
+// --- CALL METHOD STREAM ---
+// Calls the remote method without blocking, with the stream callback receiving
+// each part of the result as the server sends it. The values passed to the 
+// stream callback are owned by its receiver. The stream callback runs on the
+// thread receiving from the connection, which with the reactor also serves 
+// other connections, so it should return quickly. The callback is called once
+// the stream has ended with the final result. The call times out once no part 
+// arrived within the timeout.
+bool NymphRemoteServer::callMethodStream(uint32_t handle, string name, vector<NymphType*> &values, 
+								NymphStreamCallback stream, NymphAsyncCallback callback, 
+								void* data, string &result) {
+	uint64_t messageId;
+	return callMethodStream(handle, name, values, stream, callback, data, messageId, result);
+}
+
+
+// Returns the message ID of the call, which can be passed to cancelCall().
+bool NymphRemoteServer::callMethodStream(uint32_t handle, string name, vector<NymphType*> &values, 
+								NymphStreamCallback stream, NymphAsyncCallback callback, 
+								void* data, uint64_t &messageId, string &result) {
+	shared_ptr<NymphServerInstance> si = getInstance(handle, result);
+	if (!si) { return false; }
+	
+	return si->callMethodStream(name, values, stream, callback, data, messageId, result);
+}
+
+
+// --- CALL METHOD UPLOAD ---
+// Calls the remote method without blocking, with the call followed by the parts
+// of its upload. Each part is sent with sendChunk(), which returns once it has 
+// been written, after which endUpload() ends the upload. The method on the 
+// server reads the parts with the upload reader of its message. The callback is
+// called with the result of the call. The call times out once no part was sent
+// within the timeout.
+bool NymphRemoteServer::callMethodUpload(uint32_t handle, string name, vector<NymphType*> &values, 
+								NymphAsyncCallback callback, void* data, uint64_t &messageId, 
+								string &result) {
+	shared_ptr<NymphServerInstance> si = getInstance(handle, result);
+	if (!si) { return false; }
+	
+	return si->callMethodUpload(name, values, callback, data, messageId, result);
+}
+
+
+// --- SEND CHUNK ---
+// Sends the next part of the upload for the call. Takes ownership of the value.
+bool NymphRemoteServer::sendChunk(uint32_t handle, uint64_t messageId, NymphType* value, 
+																string &result) {
+	shared_ptr<NymphServerInstance> si = getInstance(handle, result);
+	if (!si) {
+		delete value;
 		return false;
 	}
 	
-	instancesMutex.unlock();
-		
-	return true;
+	return si->sendChunk(messageId, value, result);
+}
+
+
+// --- END UPLOAD ---
+bool NymphRemoteServer::endUpload(uint32_t handle, uint64_t messageId, string &result) {
+	shared_ptr<NymphServerInstance> si = getInstance(handle, result);
+	if (!si) { return false; }
+	
+	return si->endUpload(messageId, result);
+}
+
+
+// --- CANCEL CALL ---
+// Cancels an asynchronous call which has not completed yet. Its callback is 
+// called with a failed result, and the server drops the call if it has not 
+// processed it yet. A method running on the server can check whether its call
+// was cancelled with NymphMessage::isCancelled().
+bool NymphRemoteServer::cancelCall(uint32_t handle, uint64_t messageId, string &result) {
+	shared_ptr<NymphServerInstance> si = getInstance(handle, result);
+	if (!si) { return false; }
+	
+	return si->cancel(messageId, result);
 }
 
 
 // --- REMOVE METHOD ---
 bool NymphRemoteServer::removeMethod(uint32_t handle, string name) {
-	map<uint32_t, NymphServerInstance*>::iterator it;
-	instancesMutex.lock();
-	it = instances.find(handle);
-	if (it == instances.end()) { 
-		//result = "Provided handle " + NumberFormatter::format(handle) + " was not found.";
-		instancesMutex.unlock();
-		return false; 
-	}
+	string result;
+	shared_ptr<NymphServerInstance> si = getInstance(handle, result);
+	if (!si) { return false; }
 	
-	// TODO: try/catch.
-	// Tell server instance to disconnect.
-	if (!it->second->removeMethod(name)) {
-		instancesMutex.unlock();
-		return false;
-	}
-	
-	instancesMutex.unlock();
-	
-	return true;
+	return si->removeMethod(name);
 }
 
 
@@ -698,3 +1263,12 @@ bool NymphRemoteServer::removeCallback(string name) {
 	
 	return true;
 }
+
+
+// --- SET CALLBACK ORDERING ---
+// Callbacks from one server are called in the order they were received by 
+// default, while those from different servers run concurrently. Disabling this
+// runs all callbacks concurrently. See NymphListener::setCallbackOrdering().
+void NymphRemoteServer::setCallbackOrdering(bool ordered) {
+	NymphListener::setCallbackOrdering(ordered);
+}
@@ -19,6 +19,8 @@
 #include <string>
 #include <map>
 #include <functional>
+#include <future>
+#include <memory>
 
 #ifdef HOST_FREERTOS
 #include <freertos/FreeRTOS.h>
@@ -48,6 +50,16 @@
 typedef std::function<void(uint32_t)> NymphDisconnectCallback;
 
 
+// A single call in a batch of method calls. The batch takes ownership of the
+// values. Once completed, the reply holds the outcome of the call, as for an
+// asynchronous call.
+struct NymphBatchCall {
+	uint32_t methodId;					// ID of the method to call.
+	std::vector<NymphType*> values;		// Parameter values.
+	NymphAsyncResult reply;				// Outcome of the call.
+};
+
+
 class NymphServerInstance {
 	std::string loggerName = "NymphServerInstance";
 	uint32_t handle;
@@ -59,8 +71,11 @@ class NymphServerInstance {
 	Poco::Semaphore* socketSemaphore = 0;
 	uint32_t nextMethodId = 0;
 	NymphDisconnectCallback disconnectCallback = 0;
-	std::map<std::string, NymphMethod> methods;
-	std::map<uint32_t, NymphMethod*> methodIds;
+	std::map<std::string, std::shared_ptr<NymphMethod> > methods;
+	std::vector<std::shared_ptr<NymphMethod> > methodIds;	// Indexed by method ID.
+	std::shared_ptr<NymphRequestTable> requests;
+	NymphSendQueue* sendQueue;
+	NymphShmChannel* channel = 0;
 #ifdef HOST_FREERTOS
 	//
 #else
@@ -68,6 +83,17 @@ class NymphServerInstance {
 #endif
 	uint32_t timeout;
 	
+	std::shared_ptr<NymphMethod> findMethod(std::string name);
+	std::shared_ptr<NymphMethod> findMethod(uint32_t id);
+	bool callSync(NymphMethod* method, std::vector<NymphType*> &values, 
+										NymphType* &returnvalue, std::string &result);
+	bool callAsync(NymphMethod* method, std::vector<NymphType*> &values, 
+							NymphStreamCallback stream, bool upload, NymphAsyncCallback callback, 
+							void* data, uint64_t &messageId, std::string &result);
+	bool waitRequest(NymphRequest* request);
+	void sendCancel(uint64_t messageId);
+	bool sendPart(uint64_t messageId, NymphType* value, std::string &result);
+	
 public:
 #ifdef HOST_FREERTOS
 	//
@@ -79,11 +105,13 @@ public:
 	void setHandle(uint32_t handle);
 	uint32_t getHandle();
 	void setDisconnectCallback(NymphDisconnectCallback cb);
+	void setChannel(NymphShmChannel* channel);
 #ifdef HOST_FREERTOS
 	//
 #else
 	Poco::Semaphore* semaphore();
 #endif
+	std::shared_ptr<NymphRequestTable> requestTable() { return requests; }
 	bool sync(std::string &result);
 	bool addMethod(std::string name, NymphMethod method);
 	bool removeMethod(std::string name);
@@ -91,11 +119,27 @@ public:
 	bool callMethod(std::string name, std::vector<NymphType*> &values, 
 										NymphType* &returnvalue, std::string &result);
 	bool callMethodId(uint32_t id, std::vector<NymphType*> &values, NymphType* &returnvalue, std::string &result);
+	bool callMethodAsync(std::string name, std::vector<NymphType*> &values, 
+							NymphAsyncCallback callback, void* data, uint64_t &messageId, 
+							std::string &result);
+	bool callMethodIdAsync(uint32_t id, std::vector<NymphType*> &values, 
+							NymphAsyncCallback callback, void* data, uint64_t &messageId, 
+							std::string &result);
+	bool callMethodStream(std::string name, std::vector<NymphType*> &values, 
+							NymphStreamCallback stream, NymphAsyncCallback callback, 
+							void* data, uint64_t &messageId, std::string &result);
+	bool callMethodUpload(std::string name, std::vector<NymphType*> &values, 
+							NymphAsyncCallback callback, void* data, uint64_t &messageId, 
+							std::string &result);
+	bool sendChunk(uint64_t messageId, NymphType* value, std::string &result);
+	bool endUpload(uint64_t messageId, std::string &result);
+	bool callMethodBatch(std::vector<NymphBatchCall> &calls, std::string &result);
+	bool cancel(uint64_t messageId, std::string &result);
 };
 
 
 class NymphRemoteServer {
-	static std::map<uint32_t, NymphServerInstance*> instances;
+	static std::map<uint32_t, std::shared_ptr<NymphServerInstance> > instances;
 #ifdef HOST_FREERTOS
 	//
 #else
@@ -107,8 +151,14 @@ class NymphRemoteServer {
 	static uint32_t nextMethodId;
 	static NymphDisconnectCallback disconnectedCallback;
 	
+	static std::shared_ptr<NymphServerInstance> getInstance(uint32_t handle, std::string &result);
+	static bool connectChannel(std::string path, uint32_t &handle, void* data, std::string &result);
+	static bool addConnection(Poco::Net::StreamSocket* socket, NymphShmChannel* channel, 
+										uint32_t &handle, void* data, std::string &result);
+	
 public:
-	static bool init(logFnc logger, int level = NYMPH_LOG_LEVEL_TRACE, long timeout = 3000);
+	static bool init(logFnc logger, int level = NYMPH_LOG_LEVEL_TRACE, long timeout = 3000, 
+								int ioThreads = 0);
 	static void setLogger(logFnc logger, int level);
 	static void setDisconnectCallback(NymphDisconnectCallback cb);
 	static bool shutdown();
@@ -121,10 +171,38 @@ public:
 	static bool callMethod(uint32_t handle, std::string name, std::vector<NymphType*> &values, 
 										NymphType* &returnvalue, std::string &result);
 	static bool callMethodId(uint32_t handle, uint32_t id, std::vector<NymphType*> &values, NymphType* &returnvalue, std::string &result);
+	static bool callMethodAsync(uint32_t handle, std::string name, std::vector<NymphType*> &values, 
+								NymphAsyncCallback callback, void* data, std::string &result);
+	static bool callMethodAsync(uint32_t handle, std::string name, std::vector<NymphType*> &values, 
+								std::future<NymphAsyncResult> &future, std::string &result);
+	static bool callMethodAsync(uint32_t handle, std::string name, std::vector<NymphType*> &values, 
+								NymphAsyncCallback callback, void* data, uint64_t &messageId, 
+								std::string &result);
+	static bool callMethodIdAsync(uint32_t handle, uint32_t id, std::vector<NymphType*> &values, 
+								NymphAsyncCallback callback, void* data, std::string &result);
+	static bool callMethodIdAsync(uint32_t handle, uint32_t id, std::vector<NymphType*> &values, 
+								std::future<NymphAsyncResult> &future, std::string &result);
+	static bool callMethodIdAsync(uint32_t handle, uint32_t id, std::vector<NymphType*> &values, 
+								NymphAsyncCallback callback, void* data, uint64_t &messageId, 
+								std::string &result);
+	static bool callMethodStream(uint32_t handle, std::string name, std::vector<NymphType*> &values, 
+								NymphStreamCallback stream, NymphAsyncCallback callback, 
+								void* data, std::string &result);
+	static bool callMethodStream(uint32_t handle, std::string name, std::vector<NymphType*> &values, 
+								NymphStreamCallback stream, NymphAsyncCallback callback, 
+								void* data, uint64_t &messageId, std::string &result);
+	static bool callMethodUpload(uint32_t handle, std::string name, std::vector<NymphType*> &values, 
+								NymphAsyncCallback callback, void* data, uint64_t &messageId, 
+								std::string &result);
+	static bool sendChunk(uint32_t handle, uint64_t messageId, NymphType* value, std::string &result);
+	static bool endUpload(uint32_t handle, uint64_t messageId, std::string &result);
+	static bool cancelCall(uint32_t handle, uint64_t messageId, std::string &result);
+	static bool callMethodBatch(uint32_t handle, std::vector<NymphBatchCall> &calls, std::string &result);
 	static bool removeMethod(uint32_t handle, std::string name);
 	
 	static bool registerCallback(std::string name, NymphCallbackMethod method, void* data);
 	static bool removeCallback(std::string name);
+	static void setCallbackOrdering(bool ordered);
 };
 
 #endif
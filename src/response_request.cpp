@@ -0,0 +1,53 @@
+/*
+	response_request.cpp - implementation of the ResponseRequest class.
+	
+	Revision 0
+	
+	Notes:
+			- 
+			
+	(c) Nyanko.ws
+*/
+
+
+#include "response_request.h"
+#include "nymph_logger.h"
+
+
+// --- SET REQUEST ---
+// Takes ownership of the request. If the error string is not empty, the request
+// is completed as having failed with this error.
+void ResponseRequest::setRequest(NymphRequest* request, std::string error) {
+	this->request = request;
+	this->error = error;
+}
+
+
+// --- PROCESS ---
+void ResponseRequest::process() {
+	NymphAsyncResult res;
+	res.success = false;
+	res.value = 0;
+	if (!error.empty()) {
+		res.result = error;
+	}
+	else if (request->exception) {
+		res.result = std::to_string(request->exceptionData.id) + " - " + 
+												request->exceptionData.value;
+	}
+	else {
+		res.success = true;
+		res.value = request->response;
+	}
+	
+	request->callback(request->handle, res, request->data);
+}
+
+
+// --- FINISH ---
+void ResponseRequest::finish() {
+	delete request;
+	
+	// Call own destructor.
+	delete this;
+}
@@ -0,0 +1,36 @@
+/*
+	response_request.h - header file for the ResponseRequest class.
+	
+	Revision 0
+	
+	Notes:
+			- Completes an asynchronous method call on a worker thread.
+			
+	(c) Nyanko.ws
+*/
+
+
+#pragma once
+#ifndef RESPONSE_REQUEST_H
+#define RESPONSE_REQUEST_H
+
+
+#include "abstract_request.h"
+#include "nymph_socket_listener.h"
+
+#include <string>
+
+
+class ResponseRequest : public AbstractRequest {
+	NymphRequest* request;
+	std::string error;
+	std::string loggerName;
+	
+public:
+	ResponseRequest() { loggerName = "ResponseRequest"; }
+	void setRequest(NymphRequest* request, std::string error);
+	void process();
+	void finish();
+};
+
+#endif
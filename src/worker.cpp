@@ -7,8 +7,9 @@
 			- 
 			
 	Notes:
-			- 
-			
+			- A worker takes requests from the front of its own queue, while
+				other workers steal from the back.
+	
 	2016/11/19, Maya Posch
 	(c) Nyanko.ws
 */
@@ -22,39 +23,105 @@
 using namespace std;
 
 
-// --- GET CONDITION ---
-void Worker::getCondition(condition_variable* &cv) {
-	cv = &(this)->cv;
-}
-
-
-// --- GET MUTEX ---
-void Worker::getMutex(mutex* &mtx) {
-	mtx = &(this)->mtx;
-}
+// Static initialisations.
+thread_local Worker* Worker::current = 0;
 
 
 // --- RUN ---
 // Runs the worker instance.
 void Worker::run() {
+	current = this;
 	while (running) {
-		if (ready) {
+		AbstractRequest* request = Dispatcher::getRequest(this);
+		if (request) {
 			// Execute the request.
-			ready = false;
 			request->process();
 			request->finish();
+			continue;
 		}
 		
-		// Add self to Dispatcher queue and execute next request or wait.
-		if (Dispatcher::addWorker(this)) {
-			// Use the ready loop to deal with spurious wake-ups.
-			while (!ready && running) {
-				unique_lock<mutex> ulock(mtx);
-				if (cv.wait_for(ulock, chrono::seconds(1)) == cv_status::timeout) {
-					// We timed out, but we keep waiting unless the worker is
-					// stopped by the dispatcher.
-				}
-			}
-		}
+		park();
+	}
+	
+	current = 0;
+}
+
+
+// --- PARK ---
+// Waits until the worker is woken up for a new request. The worker is marked
+// as parked before checking for requests one last time, while the Dispatcher
+// counts a request before looking for a parked worker, so no request is missed.
+void Worker::park() {
+	unique_lock<mutex> ulock(mtx);
+	parked.store(true);
+	if (Dispatcher::hasRequests() || !running) {
+		parked.store(false);
+		return;
+	}
+	
+	// Wake up regularly to deal with spurious wake-ups and missed stops.
+	cv.wait_for(ulock, chrono::milliseconds(100), [this] { return !parked.load() || !running; });
+	parked.store(false);
+}
+
+
+// --- WAKE ---
+// Wakes up the worker if it is parked. Returns false if it was not parked.
+bool Worker::wake() {
+	bool expected = true;
+	if (!parked.compare_exchange_strong(expected, false)) { return false; }
+	
+	// Taking the mutex ensures the worker is either waiting or will see the flag.
+	mtx.lock();
+	mtx.unlock();
+	cv.notify_one();
+	return true;
+}
+
+
+// --- STOP ---
+void Worker::stop() {
+	running = false;
+	mtx.lock();
+	mtx.unlock();
+	cv.notify_one();
+}
+
+
+// --- PUSH ---
+void Worker::push(AbstractRequest* request) {
+	requestsMutex.lock();
+	requests.push_back(request);
+	requestsMutex.unlock();
+}
+
+
+// --- POP ---
+// Takes the oldest request from the worker's own queue. Returns 0 if empty.
+AbstractRequest* Worker::pop() {
+	AbstractRequest* request = 0;
+	requestsMutex.lock();
+	if (!requests.empty()) {
+		request = requests.front();
+		requests.pop_front();
+	}
+	
+	requestsMutex.unlock();
+	return request;
+}
+
+
+// --- STEAL ---
+// Takes the newest request from the worker's queue for another worker. Returns
+// 0 if empty.
+AbstractRequest* Worker::steal() {
+	AbstractRequest* request = 0;
+	if (!requestsMutex.try_lock()) { return 0; }
+	if (!requests.empty()) {
+		request = requests.back();
+		requests.pop_back();
 	}
+	
+	requestsMutex.unlock();
+	return request;
 }
@@ -4,8 +4,10 @@
 	Revision 0
 	
 	Notes:
-			- 
-			
+			- Each worker has its own queue of requests. Requests added by a
+				worker thread go into its own queue, which other workers steal
+				from when they run out of requests.
+	
 	2016/11/19, Maya Posch
 	(c) Nyanko.ws
 */
@@ -19,22 +21,34 @@
 
 #include <condition_variable>
 #include <mutex>
+#include <deque>
+#include <atomic>
 
 
 class Worker {
 	std::condition_variable cv;
 	std::mutex mtx;
-	AbstractRequest* request;
-	bool running;
-	bool ready;
+	std::deque<AbstractRequest*> requests;
+	std::mutex requestsMutex;
+	std::atomic<bool> running;
+	std::atomic<bool> parked;
+	int index;
+	
+	static thread_local Worker* current;
+	
+	void park();
 	
 public:
-	Worker() { running = true; ready = false; }
+	Worker(int index) : running(true), parked(false) { this->index = index; }
 	void run();
-	void stop() { running = false; }
-	void setRequest(AbstractRequest* request) { this->request = request; ready = true; }
-	void getCondition(std::condition_variable* &cv);
-	void getMutex(std::mutex* &mtx);
+	void stop();
+	bool wake();
+	bool isParked() { return parked.load(); }
+	void push(AbstractRequest* request);
+	AbstractRequest* pop();
+	AbstractRequest* steal();
+	int getIndex() { return index; }
+	static Worker* self() { return current; }
 };
 
 #endif
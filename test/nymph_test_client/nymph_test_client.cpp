@@ -7,7 +7,12 @@
 				- 
 				
 	Notes:
-				-
+				- Connects to port 4004, or to the URL passed on the command line,
+					e.g. 'unix:///tmp/nymph_test.sock' or 'shm:///tmp/nymph_test.sock'
+					for a server started with the same URL.
+				- With 'reactor' passed after the URL, or on its own, connections
+					are handled on the reactor instead of each having their own 
+					listener thread.
 				
 	2017/06/24, Maya Posch	: Initial version.
 	(c) Nyanko.ws
@@ -19,6 +24,10 @@
 
 #include <iostream>
 #include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
 
 
 void logFunction(int level, std::string logStr) {
@@ -40,15 +49,35 @@ void callbackFunction(uint32_t session, NymphMessage* msg, void* data) {
 }
 
 
-int main() {
+// Completion callback for asynchronous calls, which passes the outcome to the
+// promise in 'data'.
+void asyncCallback(uint32_t session, NymphAsyncResult &asyncResult, void* data) {
+	((std::promise<NymphAsyncResult>*) data)->set_value(asyncResult);
+}
+
+
+int main(int argc, char* argv[]) {
+	std::string url;
+	int ioThreads = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (std::string(argv[i]) == "reactor") { ioThreads = 2; }
+		else { url = argv[i]; }
+	}
+	
 	// Initialise the remote client instance.
 	long timeout = 5000; // 5 seconds.
-	NymphRemoteServer::init(logFunction, NYMPH_LOG_LEVEL_TRACE, timeout);
+	if (!NymphRemoteServer::init(logFunction, NYMPH_LOG_LEVEL_TRACE, timeout, ioThreads)) {
+		std::cout << "Initialising the client failed." << std::endl;
+		return 1;
+	}
 	
-	// Connect to the remote server.
+	// Connect to the remote server, at the URL if provided.
 	uint32_t handle;
 	std::string result;
-	if (!NymphRemoteServer::connect("localhost", 4004, handle, 0, result)) {
+	bool connected = false;
+	if (!url.empty()) { connected = NymphRemoteServer::connect(url, handle, 0, result); }
+	else { connected = NymphRemoteServer::connect("localhost", 4004, handle, 0, result); }
+	if (!connected) {
 		std::cout << "Connecting to remote server failed: " << result << std::endl;
 		NymphRemoteServer::disconnect(handle, result);
 		NymphRemoteServer::shutdown();
@@ -73,6 +102,207 @@ int main() {
 	
 	delete returnValue;
 	
+	// Send the same message asynchronously, then wait for the future to be ready.
+	values.clear();
+	values.push_back(new NymphType(&hello));
+	std::future<NymphAsyncResult> future;
+	if (!NymphRemoteServer::callMethodAsync(handle, "helloFunction", values, future, result)) {
+		std::cout << "Error calling remote method asynchronously: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	NymphAsyncResult asyncResult = future.get();
+	if (!asyncResult.success) {
+		std::cout << "Asynchronous call failed: " << asyncResult.result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	std::cout << "Async response string: " << asyncResult.value->getString() << std::endl;
+	
+	delete asyncResult.value;
+	
+	// Call the hello and array methods together in a single batch message. The
+	// method IDs follow the order in which the server registered its methods.
+	std::vector<NymphBatchCall> calls(2);
+	calls[0].methodId = 1; // helloFunction
+	calls[0].values.push_back(new NymphType(&hello));
+	calls[1].methodId = 3; // arrayFunction
+	if (!NymphRemoteServer::callMethodBatch(handle, calls, result)) {
+		std::cout << "Error calling remote methods in batch: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	for (uint32_t i = 0; i < calls.size(); ++i) {
+		if (!calls[i].reply.success) {
+			std::cout << "Batched call " << i << " failed: " << calls[i].reply.result << std::endl;
+			NymphRemoteServer::disconnect(handle, result);
+			NymphRemoteServer::shutdown();
+			return 1;
+		}
+	}
+	
+	std::cout << "Batch response string: " << calls[0].reply.value->getString() 
+				<< ", array size: " << calls[1].reply.value->getArray()->size() << std::endl;
+	
+	delete calls[0].reply.value;
+	delete calls[1].reply.value;
+	
+	// Call the wait method asynchronously, then cancel it. The callback is called
+	// right away with the call failed, while the server stops waiting.
+	std::promise<NymphAsyncResult> cancelled;
+	uint64_t messageId = 0;
+	values.clear();
+	if (!NymphRemoteServer::callMethodAsync(handle, "waitFunction", values, asyncCallback, 
+												&cancelled, messageId, result)) {
+		std::cout << "Error calling remote method asynchronously: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	if (!NymphRemoteServer::cancelCall(handle, messageId, result)) {
+		std::cout << "Cancelling call failed: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	asyncResult = cancelled.get_future().get();
+	if (asyncResult.success) {
+		std::cout << "Cancelled call succeeded." << std::endl;
+		delete asyncResult.value;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	std::cout << "Cancelled call: " << asyncResult.result << std::endl;
+	
+	// Occupy both workers of the server with wait calls, then queue an echo call
+	// behind them and cancel it. The server drops the queued call, along with 
+	// its string parameter, without running it.
+	std::promise<NymphAsyncResult> waits[2];
+	uint64_t waitIds[2];
+	for (int i = 0; i < 2; ++i) {
+		values.clear();
+		if (!NymphRemoteServer::callMethodAsync(handle, "waitFunction", values, asyncCallback, 
+													&waits[i], waitIds[i], result)) {
+			std::cout << "Error calling remote method asynchronously: " << result << std::endl;
+			NymphRemoteServer::disconnect(handle, result);
+			NymphRemoteServer::shutdown();
+			return 1;
+		}
+	}
+	
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	
+	std::promise<NymphAsyncResult> queued;
+	values.clear();
+	values.push_back(new NymphType(&hello));
+	if (!NymphRemoteServer::callMethodAsync(handle, "echoFunction", values, asyncCallback, 
+												&queued, messageId, result) ||
+		!NymphRemoteServer::cancelCall(handle, messageId, result)) {
+		std::cout << "Cancelling queued call failed: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	for (int i = 0; i < 2; ++i) {
+		NymphRemoteServer::cancelCall(handle, waitIds[i], result);
+		waits[i].get_future().get();
+	}
+	
+	asyncResult = queued.get_future().get();
+	if (asyncResult.success) {
+		std::cout << "Cancelled queued call succeeded." << std::endl;
+		delete asyncResult.value;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	std::cout << "Cancelled queued call: " << asyncResult.result << std::endl;
+	
+	// Call the count method, which replies in parts. Each part is passed to the
+	// stream callback, before the completion callback receives the final reply.
+	std::promise<NymphAsyncResult> counted;
+	uint32_t parts = 0;
+	NymphStreamCallback stream = [&parts](uint32_t session, NymphType* value, void* data) {
+		std::cout << "Received part: " << value->getUint32() << std::endl;
+		parts++;
+		delete value;
+	};
+	
+	values.clear();
+	if (!NymphRemoteServer::callMethodStream(handle, "countFunction", values, stream, 
+												asyncCallback, &counted, result)) {
+		std::cout << "Error calling remote method as stream: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	asyncResult = counted.get_future().get();
+	if (!asyncResult.success || asyncResult.value->getUint32() != parts) {
+		std::cout << "Streamed call failed: " << asyncResult.result << std::endl;
+		delete asyncResult.value;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	std::cout << "Streamed call completed with " << parts << " parts." << std::endl;
+	
+	delete asyncResult.value;
+	
+	// Call the sum method and upload the numbers 1 to 10 to it, each in its own
+	// part. The completion callback receives their sum.
+	std::promise<NymphAsyncResult> summed;
+	values.clear();
+	if (!NymphRemoteServer::callMethodUpload(handle, "sumFunction", values, asyncCallback, 
+												&summed, messageId, result)) {
+		std::cout << "Error calling remote method with upload: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	for (uint32_t i = 1; i <= 10; ++i) {
+		if (!NymphRemoteServer::sendChunk(handle, messageId, new NymphType(i), result)) {
+			std::cout << "Sending upload part failed: " << result << std::endl;
+			NymphRemoteServer::disconnect(handle, result);
+			NymphRemoteServer::shutdown();
+			return 1;
+		}
+	}
+	
+	if (!NymphRemoteServer::endUpload(handle, messageId, result)) {
+		std::cout << "Ending upload failed: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	asyncResult = summed.get_future().get();
+	if (!asyncResult.success || asyncResult.value->getUint32() != 55) {
+		std::cout << "Upload call failed: " << asyncResult.result << std::endl;
+		delete asyncResult.value;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	std::cout << "Upload sum: " << asyncResult.value->getUint32() << std::endl;
+	
+	delete asyncResult.value;
+	
 	// Register callback and send message with its ID to the server. Then wait
 	// for the callback to be called.
 	NymphRemoteServer::registerCallback("callbackFunction", callbackFunction, 0);
@@ -154,6 +384,587 @@ int main() {
 	
 	delete returnValue;
 	
+	// Echo a string larger than a shared memory ring (8 MB by default), which
+	// is then passed through the ring in parts.
+	std::string blob(16 * 1024 * 1024, 'n');
+	values.clear();
+	values.push_back(new NymphType(&blob));
+	returnValue = 0;
+	if (!NymphRemoteServer::callMethod(handle, "echoFunction", values, returnValue, result)) {
+		std::cout << "Error calling remote method: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	if (returnValue->getString() != blob) {
+		std::cout << "Echoed string does not match." << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	std::cout << "Echoed " << returnValue->string_length() << " bytes." << std::endl;
+	
+	delete returnValue;
+	
+	// Call the delay method twice without waiting for the first reply. As the 
+	// server runs both calls at the same time, they complete in less time than 
+	// running them one after the other would take.
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::future<NymphAsyncResult> delays[2];
+	for (int i = 0; i < 2; ++i) {
+		values.clear();
+		values.push_back(new NymphType((uint32_t) 500));
+		if (!NymphRemoteServer::callMethodAsync(handle, "delayFunction", values, delays[i], result)) {
+			std::cout << "Error calling remote method asynchronously: " << result << std::endl;
+			NymphRemoteServer::disconnect(handle, result);
+			NymphRemoteServer::shutdown();
+			return 1;
+		}
+	}
+	
+	for (int i = 0; i < 2; ++i) {
+		asyncResult = delays[i].get();
+		if (!asyncResult.success) {
+			std::cout << "Delayed call failed: " << asyncResult.result << std::endl;
+			NymphRemoteServer::disconnect(handle, result);
+			NymphRemoteServer::shutdown();
+			return 1;
+		}
+		
+		delete asyncResult.value;
+	}
+	
+	int64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+									std::chrono::steady_clock::now() - start).count();
+	if (elapsed >= 1000) {
+		std::cout << "Delayed calls did not run concurrently: " << elapsed << " ms." << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	std::cout << "Two delayed calls took " << elapsed << " ms." << std::endl;
+	
+	// Open further connections and call the hello method on each of them. The
+	// server handles these sessions alongside the first one, on its reactor if
+	// it was started with 'reactor'.
+	std::vector<uint32_t> handles(8);
+	for (uint32_t i = 0; i < handles.size(); ++i) {
+		if (!url.empty()) { connected = NymphRemoteServer::connect(url, handles[i], 0, result); }
+		else { connected = NymphRemoteServer::connect("localhost", 4004, handles[i], 0, result); }
+		if (!connected) {
+			std::cout << "Connecting to remote server failed: " << result << std::endl;
+			NymphRemoteServer::shutdown();
+			return 1;
+		}
+	}
+	
+	for (uint32_t i = 0; i < handles.size(); ++i) {
+		values.clear();
+		values.push_back(new NymphType(&hello));
+		returnValue = 0;
+		if (!NymphRemoteServer::callMethod(handles[i], "helloFunction", values, returnValue, result)) {
+			std::cout << "Error calling remote method: " << result << std::endl;
+			NymphRemoteServer::shutdown();
+			return 1;
+		}
+		
+		if (returnValue->getString() != hello) {
+			std::cout << "Response string does not match." << std::endl;
+			delete returnValue;
+			NymphRemoteServer::shutdown();
+			return 1;
+		}
+		
+		delete returnValue;
+	}
+	
+	std::cout << "Called the hello method on " << handles.size() << " more connections." << std::endl;
+	
+	// Call the hello method from a thread per connection at the same time. The
+	// replies are received on the client's reactor if it was started with 
+	// 'reactor', else on the listener thread of each connection.
+	std::atomic<uint32_t> failed(0);
+	std::vector<std::thread> callers;
+	for (uint32_t i = 0; i < handles.size(); ++i) {
+		callers.push_back(std::thread([&hello, &failed](uint32_t callHandle) {
+			for (int j = 0; j < 50; ++j) {
+				std::vector<NymphType*> callValues;
+				callValues.push_back(new NymphType(&hello));
+				NymphType* callValue = 0;
+				std::string callResult;
+				if (!NymphRemoteServer::callMethod(callHandle, "helloFunction", callValues, 
+															callValue, callResult)) {
+					std::cout << "Error calling remote method: " << callResult << std::endl;
+					failed++;
+					return;
+				}
+				
+				if (callValue->getString() != hello) { failed++; }
+				delete callValue;
+			}
+		}, handles[i]));
+	}
+	
+	for (uint32_t i = 0; i < callers.size(); ++i) {
+		callers[i].join();
+	}
+	
+	if (failed > 0) {
+		std::cout << failed << " concurrent calls failed." << std::endl;
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	for (uint32_t i = 0; i < handles.size(); ++i) {
+		NymphRemoteServer::disconnect(handles[i], result);
+	}
+	
+	std::cout << "Called the hello method concurrently on " << handles.size() 
+				<< " connections." << std::endl;
+	
+	// Request an array of structs, which hold a string and an array in turn. All
+	// values within the reply are decoded into the arena of the reply message.
+	returnValue = 0;
+	values.clear();
+	if (!NymphRemoteServer::callMethod(handle, "nestedFunction", values, returnValue, result)) {
+		std::cout << "Error calling remote method: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	std::vector<NymphType*>* items = returnValue->getArray();
+	bool matches = (items->size() == 100);
+	for (uint32_t i = 0; matches && i < items->size(); ++i) {
+		std::map<std::string, NymphPair>* item = (*items)[i]->getStruct();
+		std::vector<NymphType*>* itemNumbers = (*item)["numbers"].value->getArray();
+		matches = (*item)["index"].value->getUint32() == i && 
+					(*item)["name"].value->getString() == "item " + std::to_string(i) && 
+					itemNumbers->size() == i % 10;
+		for (uint32_t j = 0; matches && j < itemNumbers->size(); ++j) {
+			matches = ((*itemNumbers)[j]->getUint32() == j);
+		}
+	}
+	
+	if (!matches) {
+		std::cout << "Nested values do not match." << std::endl;
+		delete returnValue;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	std::cout << "Got " << items->size() << " nested structs." << std::endl;
+	
+	delete returnValue;
+	
+	// Make three rounds of 3000 asynchronous echo calls. As the calls of later 
+	// rounds reuse the slots of earlier ones in the table of pending requests, 
+	// each reply is checked against the number sent with its call.
+	std::atomic<uint32_t> completed(0);
+	std::atomic<uint32_t> mismatched(0);
+	NymphAsyncCallback echoed = [&completed, &mismatched](uint32_t session, 
+												NymphAsyncResult &res, void* data) {
+		if (!res.success || res.value->getString() != std::to_string((uintptr_t) data)) {
+			mismatched++;
+		}
+		
+		delete res.value;
+		completed++;
+	};
+	
+	for (int round = 0; round < 3; ++round) {
+		completed = 0;
+		for (uint32_t i = 0; i < 3000; ++i) {
+			std::string number = std::to_string(i);
+			values.clear();
+			values.push_back(new NymphType(&number));
+			if (!NymphRemoteServer::callMethodAsync(handle, "echoFunction", values, echoed, 
+														(void*) (uintptr_t) i, result)) {
+				std::cout << "Error calling remote method asynchronously: " << result << std::endl;
+				NymphRemoteServer::disconnect(handle, result);
+				NymphRemoteServer::shutdown();
+				return 1;
+			}
+		}
+		
+		for (int i = 0; i < 1000 && completed < 3000; ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		
+		if (completed < 3000 || mismatched > 0) {
+			std::cout << "Echo round " << round << " failed: " << completed << " completed, " 
+						<< mismatched << " mismatched." << std::endl;
+			NymphRemoteServer::disconnect(handle, result);
+			NymphRemoteServer::shutdown();
+			return 1;
+		}
+	}
+	
+	std::cout << "Completed three rounds of 3000 asynchronous calls." << std::endl;
+	
+	// Call the delay method with a delay beyond the timeout, so that the call 
+	// expires. Its late reply is then dropped, while the next call gets its own.
+	std::future<NymphAsyncResult> expiring;
+	values.clear();
+	values.push_back(new NymphType((uint32_t) (timeout + 1000)));
+	if (!NymphRemoteServer::callMethodAsync(handle, "delayFunction", values, expiring, result)) {
+		std::cout << "Error calling remote method asynchronously: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	asyncResult = expiring.get();
+	if (asyncResult.success) {
+		std::cout << "Delayed call did not expire." << std::endl;
+		delete asyncResult.value;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	std::cout << "Expired call: " << asyncResult.result << std::endl;
+	
+	std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+	
+	values.clear();
+	values.push_back(new NymphType(&hello));
+	returnValue = 0;
+	if (!NymphRemoteServer::callMethod(handle, "echoFunction", values, returnValue, result)) {
+		std::cout << "Error calling remote method: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	if (returnValue->getString() != hello) {
+		std::cout << "Response string does not match." << std::endl;
+		delete returnValue;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	delete returnValue;
+	
+	// Have the server register a method while a delayed call runs, then call it
+	// on a new connection, which receives the updated list of methods. Once the
+	// method has been removed again, connections made after that lack it.
+	std::future<NymphAsyncResult> running;
+	values.clear();
+	values.push_back(new NymphType((uint32_t) 500));
+	if (!NymphRemoteServer::callMethodAsync(handle, "delayFunction", values, running, result)) {
+		std::cout << "Error calling remote method asynchronously: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	std::string lateName = "lateFunction";
+	values.clear();
+	values.push_back(new NymphType(&lateName));
+	returnValue = 0;
+	if (!NymphRemoteServer::callMethod(handle, "addMethodFunction", values, returnValue, result) || 
+			!returnValue->getBool()) {
+		std::cout << "Adding remote method failed: " << result << std::endl;
+		delete returnValue;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	delete returnValue;
+	
+	asyncResult = running.get();
+	if (!asyncResult.success) {
+		std::cout << "Delayed call failed: " << asyncResult.result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	delete asyncResult.value;
+	
+	uint32_t lateHandle;
+	if (!url.empty()) { connected = NymphRemoteServer::connect(url, lateHandle, 0, result); }
+	else { connected = NymphRemoteServer::connect("localhost", 4004, lateHandle, 0, result); }
+	if (!connected) {
+		std::cout << "Connecting to remote server failed: " << result << std::endl;
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	values.clear();
+	values.push_back(new NymphType(&hello));
+	returnValue = 0;
+	if (!NymphRemoteServer::callMethod(lateHandle, lateName, values, returnValue, result)) {
+		std::cout << "Error calling added remote method: " << result << std::endl;
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	if (returnValue->getString() != hello) {
+		std::cout << "Response string does not match." << std::endl;
+		delete returnValue;
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	delete returnValue;
+	NymphRemoteServer::disconnect(lateHandle, result);
+	
+	values.clear();
+	values.push_back(new NymphType(&lateName));
+	returnValue = 0;
+	if (!NymphRemoteServer::callMethod(handle, "removeMethodFunction", values, returnValue, result) || 
+			!returnValue->getBool()) {
+		std::cout << "Removing remote method failed: " << result << std::endl;
+		delete returnValue;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	delete returnValue;
+	
+	if (!url.empty()) { connected = NymphRemoteServer::connect(url, lateHandle, 0, result); }
+	else { connected = NymphRemoteServer::connect("localhost", 4004, lateHandle, 0, result); }
+	if (!connected) {
+		std::cout << "Connecting to remote server failed: " << result << std::endl;
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	values.clear();
+	returnValue = 0;
+	if (NymphRemoteServer::callMethod(lateHandle, lateName, values, returnValue, result)) {
+		std::cout << "Removed remote method could still be called." << std::endl;
+		delete returnValue;
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	NymphRemoteServer::disconnect(lateHandle, result);
+	
+	std::cout << "Called a method added while another call ran." << std::endl;
+	
+	// Call the hello and echo methods by their IDs, which index the tables of 
+	// methods on both sides directly. See the batch call for the ID order.
+	values.clear();
+	values.push_back(new NymphType(&hello));
+	returnValue = 0;
+	if (!NymphRemoteServer::callMethodId(handle, 1, values, returnValue, result)) {
+		std::cout << "Error calling remote method by ID: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	std::cout << "Response string by ID: " << returnValue->getString() << std::endl;
+	
+	delete returnValue;
+	
+	values.clear();
+	values.push_back(new NymphType(&hello));
+	if (!NymphRemoteServer::callMethodIdAsync(handle, 8, values, future, result)) {
+		std::cout << "Error calling remote method by ID asynchronously: " << result << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	asyncResult = future.get();
+	if (!asyncResult.success || asyncResult.value->getString() != hello) {
+		std::cout << "Asynchronous call by ID failed: " << asyncResult.result << std::endl;
+		delete asyncResult.value;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	delete asyncResult.value;
+	
+	// Remove the nested method (ID 10) from this connection. Its ID then leaves
+	// a gap in the table, and calling it fails without contacting the server.
+	NymphRemoteServer::removeMethod(handle, "nestedFunction");
+	values.clear();
+	returnValue = 0;
+	if (NymphRemoteServer::callMethodId(handle, 10, values, returnValue, result)) {
+		std::cout << "Removed method ID could still be called." << std::endl;
+		delete returnValue;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	std::cout << "Called methods by ID." << std::endl;
+	
+	// Enable coalescing of outgoing messages, then make asynchronous echo calls 
+	// from four threads at once. Messages which are queued together are sent in
+	// a single write of up to 16 kB, waiting up to 50 microseconds for more.
+	NymphSendQueue::setCoalescing(16 * 1024, 50);
+	NymphSendStats before = NymphSendQueue::stats();
+	completed = 0;
+	mismatched = 0;
+	failed = 0;
+	callers.clear();
+	for (int i = 0; i < 4; ++i) {
+		callers.push_back(std::thread([handle, &echoed, &failed]() {
+			for (uint32_t j = 0; j < 500; ++j) {
+				std::string number = std::to_string(j);
+				std::vector<NymphType*> callValues;
+				callValues.push_back(new NymphType(&number));
+				std::string callResult;
+				if (!NymphRemoteServer::callMethodAsync(handle, "echoFunction", callValues, 
+											echoed, (void*) (uintptr_t) j, callResult)) {
+					std::cout << "Error calling remote method asynchronously: " << callResult << std::endl;
+					failed++;
+					return;
+				}
+			}
+		}));
+	}
+	
+	for (uint32_t i = 0; i < callers.size(); ++i) {
+		callers[i].join();
+	}
+	
+	for (int i = 0; i < 1000 && failed == 0 && completed < 2000; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	
+	NymphSendQueue::setCoalescing(0);
+	if (failed > 0 || completed < 2000 || mismatched > 0) {
+		std::cout << "Coalesced calls failed: " << completed << " completed, " 
+					<< mismatched << " mismatched." << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	NymphSendStats after = NymphSendQueue::stats();
+	std::cout << "Sent " << (after.frames - before.frames) << " messages in " 
+				<< (after.writes - before.writes) << " writes." << std::endl;
+	
+	// Open a second connection, then have the server broadcast the numbers 0 to
+	// 9 to all of its clients, serialising each callback message only once. The
+	// numbers received are recorded for each connection.
+	uint32_t castHandle;
+	if (!url.empty()) { connected = NymphRemoteServer::connect(url, castHandle, 0, result); }
+	else { connected = NymphRemoteServer::connect("localhost", 4004, castHandle, 0, result); }
+	if (!connected) {
+		std::cout << "Connecting to remote server failed: " << result << std::endl;
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	// Callbacks from one connection are called in the order they were received,
+	// while those of the two connections run concurrently. Each callback also 
+	// registers and removes another callback, while the others look theirs up.
+	NymphRemoteServer::setCallbackOrdering(true);
+	std::mutex receivedMutex;
+	std::map<uint32_t, std::vector<uint32_t> > received;
+	NymphRemoteServer::registerCallback("numberCallback", 
+						[&receivedMutex, &received](uint32_t session, NymphMessage* msg, void* data) {
+		uint32_t number = msg->parameters()[0]->getUint32();
+		NymphRemoteServer::registerCallback("unusedCallback", callbackFunction, 0);
+		NymphRemoteServer::removeCallback("unusedCallback");
+		
+		receivedMutex.lock();
+		received[session].push_back(number);
+		receivedMutex.unlock();
+		msg->discard();
+	}, 0);
+	
+	std::string cbName = "numberCallback";
+	values.clear();
+	values.push_back(new NymphType(&cbName));
+	returnValue = 0;
+	if (!NymphRemoteServer::callMethod(handle, "broadcastFunction", values, returnValue, result) || 
+			!returnValue->getBool()) {
+		std::cout << "Broadcasting failed: " << result << std::endl;
+		delete returnValue;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	delete returnValue;
+	
+	bool allReceived = false;
+	for (int i = 0; i < 500 && !allReceived; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		receivedMutex.lock();
+		allReceived = received[handle].size() == 10 && received[castHandle].size() == 10;
+		receivedMutex.unlock();
+	}
+	
+	if (!allReceived) {
+		std::cout << "Broadcast callbacks were not received on both connections." << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	for (uint32_t i = 0; i < 10; ++i) {
+		if (received[handle][i] != i || received[castHandle][i] != i) {
+			std::cout << "Broadcast callbacks were received out of order." << std::endl;
+			NymphRemoteServer::disconnect(handle, result);
+			NymphRemoteServer::shutdown();
+			return 1;
+		}
+	}
+	
+	NymphRemoteServer::removeCallback("numberCallback");
+	NymphRemoteServer::disconnect(castHandle, result);
+	
+	std::cout << "Received ten broadcast callbacks in order on both connections." << std::endl;
+	
+	// Make a burst of 400 asynchronous calls to the delay method, with delays of
+	// 0 to 3 milliseconds. The server's workers take the calls from each other's
+	// queues as they become idle, and each call must return its own delay.
+	completed = 0;
+	mismatched = 0;
+	NymphAsyncCallback delayed = [&completed, &mismatched](uint32_t session, 
+												NymphAsyncResult &res, void* data) {
+		if (!res.success || res.value->getUint32() != (uint32_t) (uintptr_t) data) {
+			mismatched++;
+		}
+		
+		delete res.value;
+		completed++;
+	};
+	
+	for (uint32_t i = 0; i < 400; ++i) {
+		values.clear();
+		values.push_back(new NymphType(i % 4));
+		if (!NymphRemoteServer::callMethodAsync(handle, "delayFunction", values, delayed, 
+													(void*) (uintptr_t) (i % 4), result)) {
+			std::cout << "Error calling remote method asynchronously: " << result << std::endl;
+			NymphRemoteServer::disconnect(handle, result);
+			NymphRemoteServer::shutdown();
+			return 1;
+		}
+	}
+	
+	for (int i = 0; i < 1000 && completed < 400; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	
+	if (completed < 400 || mismatched > 0) {
+		std::cout << "Delayed calls failed: " << completed << " completed, " 
+					<< mismatched << " mismatched." << std::endl;
+		NymphRemoteServer::disconnect(handle, result);
+		NymphRemoteServer::shutdown();
+		return 1;
+	}
+	
+	std::cout << "Completed a burst of 400 delayed calls." << std::endl;
+	
 	std::cout << "Test completed." << std::endl;
 	
 	std::cout << "Shutting down client...\n";
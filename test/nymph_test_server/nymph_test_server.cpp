@@ -7,7 +7,11 @@
 				- 
 				
 	Notes:
-				-
+				- Listens on port 4004, or on the URL passed on the command line,
+					e.g. 'unix:///tmp/nymph_test.sock'. With 'shm://<path>', clients
+					exchange messages through shared memory.
+				- With 'reactor' passed after the URL, or on its own, sessions are
+					handled on the reactor instead of each having their own thread.
 				
 	2017/06/24, Maya Posch	: Initial version.
 	(c) Nyanko.ws
@@ -15,6 +19,7 @@
 
 
 #include "../../src/nymph.h"
+#include "../../src/dispatcher.h"
 
 
 #include <iostream>
@@ -190,10 +195,199 @@ NymphMessage* structCallback(int session, NymphMessage* msg, void* data) {
 }
 
 
-int main() {
+// --- WAIT ---
+// Waits for the client to cancel the call, for at most three seconds. No reply
+// is sent for a cancelled call.
+NymphMessage* waitCallback(int session, NymphMessage* msg, void* data) {
+	for (int i = 0; i < 30 && !msg->isCancelled(); ++i) {
+		Poco::Thread::sleep(100);
+	}
+	
+	bool cancelled = msg->isCancelled();
+	std::cout << "Wait function " << (cancelled ? "was cancelled." : "timed out.") << std::endl;
+	
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	returnMsg->setResultValue(new NymphType(cancelled));
+	msg->discard();
+	return returnMsg;
+}
+
+
+// --- COUNT ---
+// Sends the numbers 0 to 4 as the parts of a streamed reply, followed by the
+// final reply with the number of parts sent.
+NymphMessage* countCallback(int session, NymphMessage* msg, void* data) {
+	std::string result;
+	uint32_t parts = 0;
+	for (uint32_t i = 0; i < 5; ++i) {
+		if (!NymphRemoteClient::sendChunk(session, msg, new NymphType(i), result)) {
+			std::cerr << "Sending part failed: " << result << std::endl;
+			break;
+		}
+		
+		parts++;
+	}
+	
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	returnMsg->setResultValue(new NymphType(parts));
+	msg->discard();
+	return returnMsg;
+}
+
+
+// --- SUM ---
+// Returns the sum of the numbers received as the parts of the upload.
+NymphMessage* sumCallback(int session, NymphMessage* msg, void* data) {
+	std::shared_ptr<NymphUploadReader> reader = msg->getUploadReader();
+	uint32_t sum = 0;
+	std::string result;
+	NymphType* value = 0;
+	while (reader && reader->read(value, result, 5000) && value) {
+		sum += value->getUint32();
+		delete value;
+	}
+	
+	if (!result.empty()) { std::cerr << "Reading upload failed: " << result << std::endl; }
+	
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	returnMsg->setResultValue(new NymphType(sum));
+	msg->discard();
+	return returnMsg;
+}
+
+
+// --- ECHO ---
+// Returns the received string, without printing it as it may be large.
+NymphMessage* echo(int session, NymphMessage* msg, void* data) {
+	NymphType* nt = msg->parameters()[0];
+	std::string* echoStr = new std::string(nt->getChar(), nt->string_length());
+	
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	returnMsg->setResultValue(new NymphType(echoStr, true));
+	msg->discard();
+	return returnMsg;
+}
+
+
+// --- DELAY ---
+// Waits for the received number of milliseconds, then returns it.
+NymphMessage* delay(int session, NymphMessage* msg, void* data) {
+	uint32_t ms = msg->parameters()[0]->getUint32();
+	Poco::Thread::sleep(ms);
+	
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	returnMsg->setResultValue(new NymphType(ms));
+	msg->discard();
+	return returnMsg;
+}
+
+
+// --- NESTED ---
+// Returns an array of 100 structs, each holding its index, a name and an array
+// with as many numbers as its index modulo ten.
+NymphMessage* nested(int session, NymphMessage* msg, void* data) {
+	std::vector<NymphType*>* items = new std::vector<NymphType*>;
+	for (uint32_t i = 0; i < 100; ++i) {
+		std::map<std::string, NymphPair>* pairs = new std::map<std::string, NymphPair>;
+		
+		NymphPair pair;
+		std::string* key = new std::string("index");
+		pair.key = new NymphType(key, true);
+		pair.value = new NymphType(i);
+		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
+		
+		key = new std::string("name");
+		pair.key = new NymphType(key, true);
+		pair.value = new NymphType(new std::string("item " + std::to_string(i)), true);
+		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
+		
+		std::vector<NymphType*>* numbers = new std::vector<NymphType*>;
+		for (uint32_t j = 0; j < i % 10; ++j) {
+			numbers->push_back(new NymphType(j));
+		}
+		
+		key = new std::string("numbers");
+		pair.key = new NymphType(key, true);
+		pair.value = new NymphType(numbers, true);
+		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
+		
+		items->push_back(new NymphType(pairs, true));
+	}
+	
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	returnMsg->setResultValue(new NymphType(items, true));
+	msg->discard();
+	return returnMsg;
+}
+
+
+// --- ADD METHOD ---
+// Registers the echo method under the received name, while other calls may be
+// running.
+NymphMessage* addMethodCallback(int session, NymphMessage* msg, void* data) {
+	NymphType* nt = msg->parameters()[0];
+	std::string name(nt->getChar(), nt->string_length());
+	std::vector<NymphTypes> parameters;
+	parameters.push_back(NYMPH_STRING);
+	NymphMethod method(name, parameters, NYMPH_STRING, echo);
+	
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	returnMsg->setResultValue(new NymphType(NymphRemoteClient::registerMethod(name, method)));
+	msg->discard();
+	return returnMsg;
+}
+
+
+// --- REMOVE METHOD ---
+// Removes the method with the received name.
+NymphMessage* removeMethodCallback(int session, NymphMessage* msg, void* data) {
+	NymphType* nt = msg->parameters()[0];
+	std::string name(nt->getChar(), nt->string_length());
+	
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	returnMsg->setResultValue(new NymphType(NymphRemoteClient::removeMethod(name)));
+	msg->discard();
+	return returnMsg;
+}
+
+
+// --- BROADCAST ---
+// Registers the client callback with the received name, then calls it on all
+// connected clients with the numbers 0 to 9, one after the other.
+NymphMessage* broadcast(int session, NymphMessage* msg, void* data) {
+	NymphType* nt = msg->parameters()[0];
+	std::string name(nt->getChar(), nt->string_length());
+	std::vector<NymphTypes> parameters;
+	parameters.push_back(NYMPH_UINT32);
+	NymphMethod remoteMethod(name, parameters, NYMPH_NULL);
+	remoteMethod.enableCallback();
+	NymphRemoteClient::registerCallback(name, remoteMethod);
+	
+	bool sent = true;
+	std::string result;
+	for (uint32_t i = 0; i < 10 && sent; ++i) {
+		std::vector<NymphType*> values;
+		values.push_back(new NymphType(i));
+		sent = NymphRemoteClient::broadcastCallback(name, values, result);
+	}
+	
+	if (!sent) { std::cerr << "Broadcasting callback failed: " << result << std::endl; }
+	
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	returnMsg->setResultValue(new NymphType(sent));
+	msg->discard();
+	return returnMsg;
+}
+
+
+int main(int argc, char* argv[]) {
 	// Initialise the server instance.
 	std::cout << "Initialising server..." << std::endl;
 	long timeout = 5000; // 5 seconds.
+	
+	// Use two workers, so that the client can fill the worker pool and have
+	// further calls wait in its queues.
+	Dispatcher::init(2);
 	NymphRemoteClient::init(logFunction, NYMPH_LOG_LEVEL_TRACE, timeout);
 	
 	// Register methods to expose to the clients.
@@ -214,13 +408,61 @@ int main() {
 	NymphMethod structFunction("structFunction", parameters, NYMPH_STRUCT, structCallback);
 	NymphRemoteClient::registerMethod("structFunction", structFunction);
 	
+	NymphMethod waitFunction("waitFunction", parameters, NYMPH_BOOL, waitCallback);
+	NymphRemoteClient::registerMethod("waitFunction", waitFunction);
+	
+	NymphMethod countFunction("countFunction", parameters, NYMPH_UINT32, countCallback);
+	NymphRemoteClient::registerMethod("countFunction", countFunction);
+	
+	NymphMethod sumFunction("sumFunction", parameters, NYMPH_UINT32, sumCallback);
+	NymphRemoteClient::registerMethod("sumFunction", sumFunction);
+	
+	parameters.push_back(NYMPH_STRING);
+	NymphMethod echoFunction("echoFunction", parameters, NYMPH_STRING, echo);
+	NymphRemoteClient::registerMethod("echoFunction", echoFunction);
+	
+	parameters.clear();
+	parameters.push_back(NYMPH_UINT32);
+	NymphMethod delayFunction("delayFunction", parameters, NYMPH_UINT32, delay);
+	NymphRemoteClient::registerMethod("delayFunction", delayFunction);
+	
+	parameters.clear();
+	NymphMethod nestedFunction("nestedFunction", parameters, NYMPH_ARRAY, nested);
+	NymphRemoteClient::registerMethod("nestedFunction", nestedFunction);
+	
+	parameters.push_back(NYMPH_STRING);
+	NymphMethod addMethodFunction("addMethodFunction", parameters, NYMPH_BOOL, addMethodCallback);
+	NymphRemoteClient::registerMethod("addMethodFunction", addMethodFunction);
+	
+	NymphMethod removeMethodFunction("removeMethodFunction", parameters, NYMPH_BOOL, 
+														removeMethodCallback);
+	NymphRemoteClient::registerMethod("removeMethodFunction", removeMethodFunction);
+	
+	NymphMethod broadcastFunction("broadcastFunction", parameters, NYMPH_BOOL, broadcast);
+	NymphRemoteClient::registerMethod("broadcastFunction", broadcastFunction);
+	
 	
 	// Install signal handler to terminate the server.
 	signal(SIGINT, signal_handler);
 	
-	// Start server on port 4004.
+	// Start server on port 4004, or on the URL if provided. Requests are executed
+	// on the worker pool, so that a call can be cancelled while it runs.
 	std::cout << "Starting server..." << std::endl;
-	NymphRemoteClient::start(4004);
+	uint32_t flags = NYMPH_SERVER_CONCURRENT;
+	std::string url;
+	for (int i = 1; i < argc; ++i) {
+		if (std::string(argv[i]) == "reactor") { flags |= NYMPH_SERVER_REACTOR; }
+		else { url = argv[i]; }
+	}
+	
+	bool started = false;
+	if (!url.empty()) { started = NymphRemoteClient::start(url, flags); }
+	else { started = NymphRemoteClient::start(4004, flags); }
+	if (!started) {
+		std::cerr << "Starting server failed." << std::endl;
+		NymphRemoteClient::shutdown();
+		return 1;
+	}
 	
 	// Loop until the SIGINT signal has been received.
 	std::cout << "Waiting for clients..." << std::endl;
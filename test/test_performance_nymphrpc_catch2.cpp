@@ -32,11 +32,13 @@
 #include "catch.hpp"
 
 #include "../src/nymph.h"
+#include "../src/nymph_continuation.h"
 
 #include <Poco/Condition.h>
 #include <Poco/Thread.h>
 
 #include <csignal>
+#include <cstring>
 #include <thread>
 
 Poco::Condition gCon;
@@ -172,6 +174,29 @@ NymphMessage* arrayCallback100(int session, NymphMessage* msg, void* data) { ret
 NymphMessage* arrayCallback1000(int session, NymphMessage* msg, void* data) { return arrayCallbackBase(session, msg, data, 1000); }
 NymphMessage* arrayCallback10000(int session, NymphMessage* msg, void* data) { return arrayCallbackBase(session, msg, data, 10000); }
 
+#if NeoNymphRPC
+
+// Return the same numbers as a packed array.
+
+NymphMessage* packedCallback10000(int session, NymphMessage* msg, void* data)
+{
+	static std::vector<uint32_t> numbers;
+
+	if (numbers.empty())
+	{
+		for (uint32_t i = 0; i < 10000; i++) { numbers.push_back(i); }
+	}
+
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	returnMsg->setResultValue(new NymphType(NYMPH_UINT32, numbers.data(), numbers.size()));
+
+	msg->discard();
+
+	return returnMsg;
+}
+
+#endif // NeoNymphRPC
+
 NymphMessage* blobCallback(int session, NymphMessage* msg, void* data)
 {
 #if NeoNymphRPC
@@ -228,6 +253,8 @@ void setup_server()
 		NymphRemoteClient::registerMethod("arrayFunction100"  , NymphMethod("arrayFunction100"  , parameters, NYMPH_ARRAY, arrayCallback100  ));
 		NymphRemoteClient::registerMethod("arrayFunction1000" , NymphMethod("arrayFunction1000" , parameters, NYMPH_ARRAY, arrayCallback1000 ));
 		NymphRemoteClient::registerMethod("arrayFunction10000", NymphMethod("arrayFunction10000", parameters, NYMPH_ARRAY, arrayCallback10000));
+
+		NymphRemoteClient::registerMethod("packedFunction10000", NymphMethod("packedFunction10000", parameters, NYMPH_PACKED_ARRAY, packedCallback10000));
 #else
 		NymphMethod uint32Function("uint32Function"        , parameters, NYMPH_UINT32);
 		NymphMethod doubleFunction("doubleFunction"        , parameters, NYMPH_UINT32);
@@ -427,6 +454,9 @@ TEST_CASE("NymphRPC")
 	BENCHMARK("array   100:") { return call(handle, "arrayFunction100"  ); };
 	BENCHMARK("array  1000:") { return call(handle, "arrayFunction1000" ); };
 	BENCHMARK("array 10000:") { return call(handle, "arrayFunction10000"); };
+#if NeoNymphRPC
+	BENCHMARK("packed 10000:") { return call(handle, "packedFunction10000"); };
+#endif
 
 	BENCHMARK("blob       1:") { return call(handle, "blobFunction", 1); };
 	BENCHMARK("blob      10:") { return call(handle, "blobFunction", 10); };
@@ -444,6 +474,144 @@ TEST_CASE("NymphRPC")
 	server.join();
 }
 
+// Continuation frames: a message larger than the frame limit is split into
+// frames, which are reassembled into the original message. A small limit is
+// used, so that no 4 GB of data is needed.
+
+NymphMessage* make_message(size_t length)
+{
+	std::string* value = new std::string(length, 'x');
+	(*value)[length - 1] = 'y';
+
+	NymphMessage* msg = new NymphMessage(7);
+	msg->setMessageId(1);
+	msg->addValue(new NymphType(value, true));
+	msg->addValue(new NymphType((uint32_t) 42));
+	return msg;
+}
+
+// Return the serialised message as sent on the wire.
+
+std::string get_frames(NymphMessage& msg)
+{
+	if (msg.segments().empty())
+	{
+		return std::string((char const*) msg.buffer(), msg.buffer_size());
+	}
+
+	std::string frames;
+	for (auto const& seg : msg.segments())
+	{
+		frames.append((char const*) seg.data, seg.length);
+	}
+
+	return frames;
+}
+
+// Feed the frames through a continuation, as a receiver does.
+
+NymphMessage* reassemble(std::string const& frames, uint32_t limit, int& count)
+{
+	NymphContinuation continuation;
+	NymphMessage* msg = 0;
+	size_t offset = 0;
+	count = 0;
+	while (!msg)
+	{
+		REQUIRE(offset + 8 <= frames.size());
+
+		uint32_t signature, length;
+		memcpy(&signature, frames.data() + offset, 4);
+		memcpy(&length, frames.data() + offset + 4, 4);
+		offset += 8;
+		REQUIRE(length <= limit);
+		REQUIRE(offset + length <= frames.size());
+
+		uint8_t* dest = continuation.frame(signature, length);
+		REQUIRE(dest != nullptr);
+		memcpy(dest, frames.data() + offset, length);
+		offset += length;
+		count++;
+
+		msg = continuation.frameDone();
+		if (!msg)
+		{
+			REQUIRE(signature == nymphContinuationSignature);
+			REQUIRE(continuation.active());
+		}
+	}
+
+	REQUIRE(offset == frames.size());
+	return msg;
+}
+
+TEST_CASE("Continuation frames")
+{
+	uint32_t const limit = 64;
+
+	// Find the string length for which the body is a multiple of the limit.
+
+	NymphMessage::setFrameLimit(UINT32_MAX);
+	NymphMessage* probe = make_message(1000);
+	probe->serialize();
+	uint64_t body = probe->buffer_size() - 8;
+	delete probe;
+	size_t exact = 1000 + (limit - body % limit) % limit;
+
+	struct Case { size_t length; bool vectored; };
+	Case cases[] = {
+		{ exact, false },
+		{ exact + 1, false },
+		{ exact, true },
+		{ exact + 1, true },
+	};
+
+	for (auto const& c : cases)
+	{
+		// With vectored serialisation the string is referenced, so that a segment
+		// boundary falls inside a frame.
+
+		NymphMessage::setFrameLimit(UINT32_MAX);
+		NymphMessage* plain = make_message(c.length);
+		if (c.vectored)
+		{
+			plain->serializeVectored(256);
+			REQUIRE(plain->segments().size() > 1);
+			REQUIRE((plain->segments()[0].length - 8) % limit != 0);
+		}
+		else
+		{
+			plain->serialize();
+		}
+		std::string expected = get_frames(*plain);
+		delete plain;
+
+		NymphMessage::setFrameLimit(limit);
+		NymphMessage* msg = make_message(c.length);
+		if (c.vectored) msg->serializeVectored(256);
+		else msg->serialize();
+		std::string frames = get_frames(*msg);
+		delete msg;
+
+		int count = 0;
+		NymphMessage* received = reassemble(frames, limit, count);
+		uint64_t bodyLength = expected.size() - 8;
+		CHECK(count == 1 + (bodyLength + limit - 1) / limit);
+		REQUIRE(!received->isCorrupt());
+		REQUIRE(received->buffer_size() == bodyLength);
+		CHECK(memcmp(received->buffer(), expected.data() + 8, bodyLength) == 0);
+
+		std::vector<NymphType*>& values = received->parameters();
+		REQUIRE(values.size() == 2);
+		CHECK(values[0]->string_length() == c.length);
+		CHECK(std::string(values[0]->getChar(), values[0]->string_length()) == std::string(c.length - 1, 'x') + "y");
+		CHECK(values[1]->getUint32() == 42);
+		received->discard();
+	}
+
+	NymphMessage::setFrameLimit(UINT32_MAX);
+}
+
 // TODO Create Makefile
 
 // cmake -S . -B build -G Ninja -DCMAKE_BUILD_TYPE=Release